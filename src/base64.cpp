@@ -0,0 +1,321 @@
+
+#include <array>
+
+#include "base64.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BASE64_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace max_eq3 { namespace base64 {
+
+namespace {
+
+const char enc_table[65] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+constexpr uint8_t bad = 0xff;
+
+constexpr std::array<uint8_t, 256> make_dec_table()
+{
+    std::array<uint8_t, 256> t{};
+    for (auto &v: t)
+        v = bad;
+    for (unsigned u = 0; u < 26; ++u)
+    {
+        t['A' + u] = uint8_t(u);
+        t['a' + u] = uint8_t(26 + u);
+    }
+    for (unsigned u = 0; u < 10; ++u)
+        t['0' + u] = uint8_t(52 + u);
+    t['+'] = 62;
+    t['/'] = 63;
+    return t;
+}
+
+constexpr std::array<uint8_t, 256> dec_table = make_dec_table();
+
+std::size_t strip_padding(const char *in, std::size_t len)
+{
+    if (len && in[len - 1] == '=')
+    {
+        --len;
+        if (len && in[len - 1] == '=') --len;
+    }
+    return len;
+}
+
+std::size_t encode_scalar(const uint8_t *in, std::size_t len, char *out)
+{
+    char *o = out;
+    for (; len >= 3; len -= 3, in += 3)
+    {
+        uint32_t v = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+        *o++ = enc_table[(v >> 18) & 0x3f];
+        *o++ = enc_table[(v >> 12) & 0x3f];
+        *o++ = enc_table[(v >> 6) & 0x3f];
+        *o++ = enc_table[v & 0x3f];
+    }
+    if (len)
+    {
+        uint32_t v = uint32_t(in[0]) << 16;
+        if (len == 2)
+            v |= uint32_t(in[1]) << 8;
+        *o++ = enc_table[(v >> 18) & 0x3f];
+        *o++ = enc_table[(v >> 12) & 0x3f];
+        *o++ = (len == 2) ? enc_table[(v >> 6) & 0x3f] : '=';
+        *o++ = '=';
+    }
+    return std::size_t(o - out);
+}
+
+// expects the padding already removed
+std::size_t decode_scalar(const char *in, std::size_t len, uint8_t *out)
+{
+    uint8_t *o = out;
+    for (; len >= 4; len -= 4, in += 4)
+    {
+        uint8_t a = dec_table[uint8_t(in[0])];
+        uint8_t b = dec_table[uint8_t(in[1])];
+        uint8_t c = dec_table[uint8_t(in[2])];
+        uint8_t d = dec_table[uint8_t(in[3])];
+        if ((a | b | c | d) == bad)
+            return invalid;
+        uint32_t v = (uint32_t(a) << 18) | (uint32_t(b) << 12) | (uint32_t(c) << 6) | d;
+        *o++ = uint8_t(v >> 16);
+        *o++ = uint8_t(v >> 8);
+        *o++ = uint8_t(v);
+    }
+    // trailing incomplete group, 6 bits of a single character are dropped
+    uint32_t v = 0;
+    for (std::size_t u = 0; u < len; ++u)
+    {
+        uint8_t c = dec_table[uint8_t(in[u])];
+        if (c == bad)
+            return invalid;
+        v = (v << 6) | c;
+    }
+    if (len == 2)
+        *o++ = uint8_t(v >> 4);
+    else if (len == 3)
+    {
+        *o++ = uint8_t(v >> 10);
+        *o++ = uint8_t(v >> 2);
+    }
+    return std::size_t(o - out);
+}
+
+#if defined(BASE64_X86_SIMD)
+
+// Vector algorithms after W. Mula / D. Lemire, "Faster Base64 Encoding
+// and Decoding using AVX2 Instructions"
+
+__attribute__((target("ssse3")))
+__m128i enc_reshuffle(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+__m128i enc_translate(__m128i in)
+{
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    const __m128i mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+    indices = _mm_sub_epi8(indices, mask);
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+
+__attribute__((target("ssse3")))
+std::size_t encode_ssse3(const uint8_t *in, std::size_t len, char *out)
+{
+    char *o = out;
+    while (len >= 16)       // 12 bytes consumed, 16 loaded
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        v = enc_translate(enc_reshuffle(v));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(o), v);
+        in += 12;
+        len -= 12;
+        o += 16;
+    }
+    return std::size_t(o - out) + encode_scalar(in, len, o);
+}
+
+__attribute__((target("ssse3")))
+bool dec_translate(__m128i &str)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2F = _mm_set1_epi8(0x2f);
+
+    const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2F);
+    const __m128i lo_nibbles = _mm_and_si128(str, mask_2F);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+        return false;
+    const __m128i eq_2F = _mm_cmpeq_epi8(str, mask_2F);
+    const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2F, hi_nibbles));
+    str = _mm_add_epi8(str, roll);
+    return true;
+}
+
+__attribute__((target("ssse3")))
+__m128i dec_reshuffle(__m128i in)
+{
+    const __m128i merge_ab_and_bc = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    const __m128i out = _mm_madd_epi16(merge_ab_and_bc, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+std::size_t decode_ssse3(const char *in, std::size_t len, uint8_t *out)
+{
+    uint8_t *o = out;
+    while (len >= 24)       // 16 characters consumed, 16 bytes stored
+    {
+        __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        if (!dec_translate(str))
+            break;          // the scalar tail reports the invalid character
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(o), dec_reshuffle(str));
+        in += 16;
+        len -= 16;
+        o += 12;
+    }
+    std::size_t rest = decode_scalar(in, len, o);
+    return (rest == invalid) ? invalid : std::size_t(o - out) + rest;
+}
+
+__attribute__((target("avx2")))
+std::size_t encode_avx2(const uint8_t *in, std::size_t len, char *out)
+{
+    const __m256i shuf = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                         10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                                         65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    char *o = out;
+    while (len >= 28)       // 24 bytes consumed, 12 + 16 loaded
+    {
+        __m256i v = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in))),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 12)), 1);
+        v = _mm256_shuffle_epi8(v, shuf);
+        const __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        v = _mm256_or_si256(t1, t3);
+
+        __m256i indices = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+        indices = _mm256_sub_epi8(indices, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(25)));
+        v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut, indices));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(o), v);
+        in += 24;
+        len -= 24;
+        o += 32;
+    }
+    return std::size_t(o - out) + encode_ssse3(in, len, o);
+}
+
+__attribute__((target("avx2")))
+std::size_t decode_avx2(const char *in, std::size_t len, uint8_t *out)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2F = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    uint8_t *o = out;
+    while (len >= 48)       // 32 characters consumed, 32 bytes stored
+    {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2F);
+        const __m256i lo_nibbles = _mm256_and_si256(str, mask_2F);
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+        const __m256i eq_2F = _mm256_cmpeq_epi8(str, mask_2F);
+        const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2F, hi_nibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        const __m256i merge_ab_and_bc = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        __m256i v = _mm256_madd_epi16(merge_ab_and_bc, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(o), v);
+        in += 32;
+        len -= 32;
+        o += 24;
+    }
+    std::size_t rest = decode_ssse3(in, len, o);
+    return (rest == invalid) ? invalid : std::size_t(o - out) + rest;
+}
+
+#endif
+
+struct codec
+{
+    std::size_t (*enc)(const uint8_t *, std::size_t, char *);
+    std::size_t (*dec)(const char *, std::size_t, uint8_t *);
+    const char *name;
+};
+
+codec select_codec()
+{
+#if defined(BASE64_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return codec{encode_avx2, decode_avx2, "avx2"};
+    if (__builtin_cpu_supports("ssse3"))
+        return codec{encode_ssse3, decode_ssse3, "ssse3"};
+#endif
+    return codec{encode_scalar, decode_scalar, "scalar"};
+}
+
+const codec &selected()
+{
+    static const codec c = select_codec();
+    return c;
+}
+
+}
+
+std::size_t encode(const uint8_t *in, std::size_t len, char *out)
+{
+    return selected().enc(in, len, out);
+}
+
+std::size_t decode(const char *in, std::size_t len, uint8_t *out)
+{
+    return selected().dec(in, strip_padding(in, len), out);
+}
+
+const char *implementation()
+{
+    return selected().name;
+}
+
+}}
@@ -0,0 +1,52 @@
+#ifndef BASE64_H
+#define BASE64_H
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace max_eq3 { namespace base64 {
+
+/**
+ * table driven base64 codec working on caller supplied buffers.
+ *
+ * On x86 an SSSE3 or AVX2 implementation is selected at runtime,
+ * all other targets use the scalar lookup tables.
+ */
+
+constexpr std::size_t invalid = std::size_t(-1);
+
+// number of characters produced by encode (padding included)
+constexpr std::size_t encoded_size(std::size_t binlen)
+{
+    return (binlen + 2) / 3 * 4;
+}
+
+// upper bound of the bytes produced by decode
+constexpr std::size_t decoded_size(std::size_t textlen)
+{
+    return textlen / 4 * 3 + 2;
+}
+
+/**
+ * @brief encode
+ * @param out needs room for encoded_size(len) characters
+ * @return number of characters written, '=' padding included
+ */
+std::size_t encode(const uint8_t *in, std::size_t len, char *out);
+
+/**
+ * @brief decode
+ * up to two trailing '=' are ignored, a trailing incomplete group
+ * yields the complete bytes it contains.
+ * @param out needs room for decoded_size(len) bytes
+ * @return number of bytes written or invalid on characters outside the alphabet
+ */
+std::size_t decode(const char *in, std::size_t len, uint8_t *out);
+
+// name of the implementation selected for this cpu ("scalar", "ssse3", "avx2")
+const char *implementation();
+
+}}
+
+#endif // BASE64_H
@@ -0,0 +1,948 @@
+/**
+ * protocol micro benchmarks
+ *
+ * usage: maxcube2mqtt_bench [iterations] [filter]
+ *        maxcube2mqtt_bench replay <capture file> [speed]
+ *        maxcube2mqtt_bench sim [rooms] [seconds]
+ *        maxcube2mqtt_bench warm [rooms]
+ *        maxcube2mqtt_bench multi [cubes] [rooms] [seconds] [threads]
+ *        maxcube2mqtt_bench reconnect [down ms] [reboots]
+ *        maxcube2mqtt_bench burst [commands] [recovery ms]
+ *        maxcube2mqtt_bench pipeline [commands]
+ *        maxcube2mqtt_bench poll [seconds]
+ *        maxcube2mqtt_bench slider [changes] [interval ms]
+ *
+ * reports per operation: time (ns), heap allocations and allocated bytes,
+ * replay feeds a recorded session (see capture.h) through an offline cube_io,
+ * sim connects a cube_io to a local cube simulator (see cube_sim.h) and
+ * measures the round trip of temperature changes, warm compares the time
+ * to a complete room table with and without a state file (warm_start),
+ * multi serves several simulated cubes (127.0.0.x) by one cube_manager
+ * on an io_pool of the given threads, reconnect restarts the simulator
+ * and measures the time until a cube_io (standalone and managed) is
+ * connected again, burst fires commands at a simulator with a scarce duty
+ * cycle budget and reports how the command queue paces them, pipeline
+ * awaits the command tickets of changes to all rooms, poll counts the l:
+ * of the adaptive refresh against a fixed interval, slider drags the
+ * temperature of one room and counts the s: after settling
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cubio_io_p.h"
+#include "cube_manager.h"
+#include "msg_builder.h"
+#include "msg_parser.h"
+#include "l_msg_reader.h"
+#include "cube_proto.h"
+#include "cube_sim.h"
+#include "base64.h"
+#include "utils.h"
+
+namespace {
+
+std::atomic<std::size_t> alloc_count{0};
+std::atomic<std::size_t> alloc_bytes{0};
+
+}
+
+void *operator new(std::size_t n)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace max_eq3 {
+
+// access to the processing steps of cube_io
+class cube_io_probe
+{
+public:
+    static void mark_rooms_changed(cube_io &cio)
+    {
+        for (const auto &r: cio._p->devconfigs.roomconf)
+            if (cio._p->devconfigs.has_room(r.id))
+                cio._p->changeset[r.id].insert(changeflags::act_temp);
+    }
+    static void emit_changed_data(cube_io &cio)
+    {
+        cio.emit_changed_data();
+    }
+};
+
+}
+
+using namespace max_eq3;
+
+namespace {
+
+// keeps the optimizer from dropping results
+template <typename T>
+void keep(const T &v)
+{
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+class null_target : public cube_event_target
+{
+public:
+    void device_info(device_sp) override {}
+    void room_changed(room_sp rsp) override { keep(rsp); }
+    void connected() override {}
+    void disconnected() override {}
+};
+
+struct bench_env
+{
+    std::size_t iterations{100000};
+    std::string filter;
+};
+
+template <typename F>
+void run(const bench_env &env, const std::string &name, F &&op)
+{
+    if (!env.filter.empty() && (name.find(env.filter) == std::string::npos))
+        return;
+
+    for (std::size_t u = 0; u < env.iterations / 10 + 1; ++u)        // warm up
+        op();
+
+    std::size_t c0 = alloc_count.load();
+    std::size_t b0 = alloc_bytes.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t u = 0; u < env.iterations; ++u)
+        op();
+    auto t1 = std::chrono::steady_clock::now();
+    double n = double(env.iterations);
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed
+              << std::setw(12) << std::setprecision(1) << ns / n << " ns/op"
+              << std::setw(10) << std::setprecision(2) << (alloc_count.load() - c0) / n << " allocs/op"
+              << std::setw(12) << std::setprecision(1) << (alloc_bytes.load() - b0) / n << " bytes/op"
+              << std::endl;
+}
+
+week_schedule sample_schedule()
+{
+    week_schedule ws;
+    for (auto &ds: ws)
+    {
+        for (unsigned x = 0; x < SCHED_POINTS; ++x)
+            ds[x] = schedule_point{x % 2 ? 21.0 : 17.0, std::min(1440u, 360u + x * 90)};
+    }
+    return ws;
+}
+
+// a house with 12 rooms, one wall thermostat and two radiator thermostats each
+void sample_house(std::vector<m_room> &rooms, std::vector<m_device> &devices)
+{
+    rfaddr_t addr = 0x100000;
+    for (uint8_t id = 1; id <= 12; ++id)
+    {
+        rooms.push_back(m_room{id, "Room " + std::to_string(id), addr});
+        devices.push_back(m_device{devicetype::WallThermostat, addr++,
+                                   "WT0000" + std::to_string(1000 + id), "Wall " + std::to_string(id), id});
+        for (unsigned u = 0; u < 2; ++u)
+            devices.push_back(m_device{devicetype::RadiatorThermostat, addr++,
+                                       "RT0000" + std::to_string(2000 + id * 2 + u), "Radiator " + std::to_string(id), id});
+    }
+}
+
+std::vector<l_submsg_data> sample_l_data(const std::vector<m_device> &devices)
+{
+    std::vector<l_submsg_data> lv;
+    for (const m_device &d: devices)
+    {
+        l_submsg_data ld;
+        ld.submsg_src = d.type;
+        ld.rfaddr = d.rfaddr;
+        ld.flags = 0x1018;
+        ld.valve_pos = d.rfaddr % 100;
+        ld.set_temp = 21.0;
+        ld.act_temp = 20.4;
+        ld.dateuntil = 0;
+        ld.minutes_since_midnight = 0;
+        lv.push_back(ld);
+    }
+    return lv;
+}
+
+int replay_capture(const std::string &path, double speed)
+{
+    null_target target;
+    cube_io cio(&target, "", cube_io::offline_t{});
+
+    std::size_t c0 = alloc_count.load();
+    std::size_t b0 = alloc_bytes.load();
+    auto t0 = std::chrono::steady_clock::now();
+    std::size_t lines = cio.replay(path, speed);
+    auto t1 = std::chrono::steady_clock::now();
+    if (!lines)
+    {
+        std::cerr << "nothing replayed from " << path << std::endl;
+        return 1;
+    }
+    double n = double(lines);
+    std::cout << "replayed " << lines << " lines in "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, "
+              << std::fixed << std::setprecision(1)
+              << std::chrono::duration<double, std::nano>(t1 - t0).count() / n << " ns/line "
+              << std::setprecision(2) << (alloc_count.load() - c0) / n << " allocs/line "
+              << std::setprecision(1) << (alloc_bytes.load() - b0) / n << " bytes/line"
+              << std::endl;
+    return 0;
+}
+
+// waits for the set temperature of a room to show up in room_changed
+class roundtrip_target : public cube_event_target
+{
+public:
+    void device_info(device_sp) override {}
+    void room_changed(room_sp rsp) override
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        ++_changes;
+        if ((rsp->name == _room) && (rsp->set_temp.first == _temp))
+            _room.clear();
+        _cv.notify_all();
+    }
+    void connected() override {}
+    void disconnected() override {}
+
+    void expect(const std::string &room, double temp)
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _room = room;
+        _temp = temp;
+    }
+    bool wait_done(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        return _cv.wait_for(lock, timeout, [this]{ return _room.empty(); });
+    }
+    bool wait_changes(std::size_t n, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        return _cv.wait_for(lock, timeout, [this, n]{ return _changes >= n; });
+    }
+
+private:
+    std::mutex              _mtx;
+    std::condition_variable _cv;
+    std::size_t             _changes{0};
+    std::string             _room;
+    double                  _temp{0.0};
+};
+
+int simulate_house(unsigned rooms, unsigned seconds)
+{
+    using clock = std::chrono::steady_clock;
+
+    sim_config cfg;
+    cfg.rooms = rooms;
+    cube_simulator sim(cfg);
+    if (!sim.start())
+    {
+        std::cerr << "can't start the cube simulator" << std::endl;
+        return 1;
+    }
+    rooms = sim.config().rooms;
+
+    roundtrip_target target;
+    auto t0 = clock::now();
+    cube_io cio(&target, cfg.serial);
+    if (!target.wait_changes(rooms, std::chrono::seconds(10)))
+    {
+        std::cerr << "cube_io didn't connect to the simulator" << std::endl;
+        return 1;
+    }
+    auto t1 = clock::now();
+    session_timing timing = cio.session();
+    std::cout << "discovery and initial burst of " << rooms << " rooms: "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms (discover "
+              << timing.discover.count() << " us, connect " << timing.connect.count()
+              << " us, handshake " << timing.handshake.count() << " us)" << std::endl;
+
+    // the protocol round trip, no settling of the changes and the refresh
+    command_config ccfg;
+    ccfg.settle = std::chrono::milliseconds(0);
+    ccfg.refresh_settle = std::chrono::milliseconds(0);
+    cio.configure_commands(ccfg);
+
+    std::vector<room_handle> handles;
+    for (unsigned u = 0; u < rooms; ++u)
+        handles.push_back(cio.find_room("Room " + std::to_string(u + 1)));
+
+    std::vector<double> latencies;
+    std::size_t timeouts = 0;
+    std::size_t allocs0 = alloc_count.load();
+    auto end = clock::now() + std::chrono::seconds(seconds);
+    for (unsigned u = 0; clock::now() < end; ++u)
+    {
+        double temp = (u / rooms) % 2 ? 21.0 : 19.5;
+        target.expect("Room " + std::to_string(u % rooms + 1), temp);
+        auto c0 = clock::now();
+        cio.change_temp(handles[u % rooms], temp);
+        if (target.wait_done(std::chrono::seconds(2)))
+            latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - c0).count());
+        else
+            ++timeouts;
+    }
+    if (latencies.empty())
+    {
+        std::cerr << "no temperature change completed, " << timeouts << " timeouts" << std::endl;
+        return 1;
+    }
+
+    double allocs = double(alloc_count.load() - allocs0) / (latencies.size() + timeouts);
+    std::sort(latencies.begin(), latencies.end());
+    const sim_stats &st = sim.stats();
+    std::cout << latencies.size() << " temperature changes in " << seconds << " s, "
+              << timeouts << " timeouts, " << st.s_failed << " refused by duty cycle\n"
+              << std::fixed << std::setprecision(1)
+              << "round trip us: p50 " << latencies[latencies.size() / 2]
+              << " p99 " << latencies[latencies.size() * 99 / 100]
+              << " max " << latencies.back() << "\n"
+              << "cube lines sent " << st.lines_sent << " l: " << st.l_cmds << " s: " << st.s_cmds << "\n"
+              << std::setprecision(1) << allocs << " allocs per change (cube_io and simulator)"
+              << std::endl;
+    return 0;
+}
+
+
+int warm_start_house(unsigned rooms)
+{
+    using clock = std::chrono::steady_clock;
+    const std::string path = "maxcube2mqtt_bench.state";
+    std::remove(path.c_str());
+
+    sim_config cfg;
+    cfg.rooms = rooms;
+    double cold_ms = 0.0;
+    {
+        cube_simulator sim(cfg);
+        if (!sim.start())
+        {
+            std::cerr << "can't start the cube simulator" << std::endl;
+            return 1;
+        }
+        rooms = sim.config().rooms;
+
+        roundtrip_target target;
+        auto t0 = clock::now();
+        cube_io cio(&target, cfg.serial);
+        cio.warm_start(path);
+        if (!target.wait_changes(rooms, std::chrono::seconds(10)))
+        {
+            std::cerr << "cube_io didn't connect to the simulator" << std::endl;
+            return 1;
+        }
+        cold_ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+    }
+
+    // no cube this time, everything comes from the state file
+    null_target target;
+    auto t0 = clock::now();
+    cube_io cio(&target, cfg.serial);
+    std::size_t lines = cio.warm_start(path);
+    std::size_t restored = cio.rooms()->rooms.size();
+    double warm_ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+    std::remove(path.c_str());
+
+    std::cout << std::fixed << std::setprecision(2)
+              << rooms << " rooms, cold start " << cold_ms << " ms, warm start "
+              << warm_ms << " ms (" << lines << " lines, " << restored << " rooms restored)"
+              << std::endl;
+    return restored == rooms ? 0 : 1;
+}
+
+
+int manage_houses(unsigned cubes, unsigned rooms, unsigned seconds, unsigned threads)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<std::unique_ptr<cube_simulator>> sims;
+    for (unsigned c = 0; c < cubes; ++c)
+    {
+        sim_config cfg;
+        cfg.serial = "KEQ000000" + std::to_string(c + 1);
+        cfg.serial = cfg.serial.substr(cfg.serial.size() - 10);
+        cfg.rfaddr = 0x0abc00 + c;
+        cfg.rooms = rooms;
+        cfg.seed = c + 1;
+        cfg.address = "127.0.0." + std::to_string(c + 2);
+        sims.push_back(std::make_unique<cube_simulator>(cfg));
+        if (!sims.back()->start())
+        {
+            std::cerr << "can't start the cube simulator at " << cfg.address << std::endl;
+            return 1;
+        }
+    }
+    rooms = sims.front()->config().rooms;
+
+    roundtrip_target target;
+    auto t0 = clock::now();
+    io_pool_config pcfg;
+    pcfg.threads = threads;
+    io_pool pool(pcfg);
+    cube_manager_config mcfg;
+    mcfg.commands.settle = std::chrono::milliseconds(0);
+    mcfg.commands.refresh_settle = std::chrono::milliseconds(0);
+    cube_manager mgr(&target, mcfg, pool);
+    if (!target.wait_changes(cubes * rooms, std::chrono::seconds(10)))
+    {
+        std::cerr << "cube_manager didn't connect to all simulators, "
+                  << mgr.serials().size() << " cubes found" << std::endl;
+        return 1;
+    }
+    auto t1 = clock::now();
+    std::cout << "discovery and initial burst of " << cubes << " cubes with " << rooms << " rooms on "
+              << pool.size() << " io threads: "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms" << std::endl;
+
+    std::vector<managed_room> handles;
+    for (const auto &sim: sims)
+    {
+        for (unsigned u = 0; u < rooms; ++u)
+            handles.push_back(mgr.find_room(sim->config().serial + "/Room " + std::to_string(u + 1)));
+    }
+
+    std::vector<double> latencies;
+    std::size_t timeouts = 0;
+    auto end = clock::now() + std::chrono::seconds(seconds);
+    for (unsigned u = 0; clock::now() < end; ++u)
+    {
+        const managed_room &mr = handles[u % handles.size()];
+        double temp = (u / handles.size()) % 2 ? 21.0 : 19.5;
+        target.expect("Room " + std::to_string(u % rooms + 1), temp);
+        auto c0 = clock::now();
+        mr.cube->change_temp(mr.room, temp);
+        if (target.wait_done(std::chrono::seconds(2)))
+            latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - c0).count());
+        else
+            ++timeouts;
+    }
+    if (latencies.empty())
+    {
+        std::cerr << "no temperature change completed, " << timeouts << " timeouts" << std::endl;
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << latencies.size() << " temperature changes on " << cubes << " cubes in " << seconds << " s, "
+              << timeouts << " timeouts\n"
+              << std::fixed << std::setprecision(1)
+              << "round trip us: p50 " << latencies[latencies.size() / 2]
+              << " p99 " << latencies[latencies.size() * 99 / 100]
+              << " max " << latencies.back() << std::endl;
+    return 0;
+}
+
+int reconnect_house(unsigned down_ms, unsigned reboots)
+{
+    using clock = std::chrono::steady_clock;
+
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    if (!sim.start())
+    {
+        std::cerr << "can't start the cube simulator" << std::endl;
+        return 1;
+    }
+    unsigned rooms = sim.config().rooms;
+
+    for (bool managed: {false, true})
+    {
+        roundtrip_target target;
+        io_pool pool;
+        std::unique_ptr<cube_manager> mgr;
+        std::unique_ptr<cube_io> cio;
+        if (managed)
+        {
+            cube_manager_config mcfg;
+            mcfg.serials.push_back(cfg.serial);
+            mgr = std::make_unique<cube_manager>(&target, mcfg, pool);
+        }
+        else
+            cio = std::make_unique<cube_io>(&target, cfg.serial);
+        if (!target.wait_changes(rooms, std::chrono::seconds(10)))
+        {
+            std::cerr << "didn't connect to the simulator" << std::endl;
+            return 1;
+        }
+
+        auto session = [&]() { return (managed ? mgr->cube(cfg.serial) : cio.get())->session(); };
+        std::vector<double> times;
+        for (unsigned r = 0; r < reboots; ++r)
+        {
+            unsigned reconnects = session().reconnects;
+            sim.stop();
+            std::this_thread::sleep_for(std::chrono::milliseconds(down_ms));
+            std::size_t connects = sim.stats().connects;
+            auto t0 = clock::now();
+            if (!sim.start())
+            {
+                std::cerr << "can't restart the cube simulator" << std::endl;
+                return 1;
+            }
+            while ((sim.stats().connects == connects) && (clock::now() - t0 < std::chrono::seconds(30)))
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            if (sim.stats().connects == connects)
+            {
+                std::cerr << "no reconnect within 30 s" << std::endl;
+                return 1;
+            }
+            times.push_back(std::chrono::duration<double, std::milli>(clock::now() - t0).count());
+            // the next reboot after steady, an interrupted handshake would extend this outage
+            while ((session().reconnects == reconnects) && (clock::now() - t0 < std::chrono::seconds(30)))
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        // the cube_io's own view, the link lost until the first L-Msg of the last reconnect
+        session_timing timing = session();
+        std::sort(times.begin(), times.end());
+        std::cout << (managed ? "managed" : "standalone") << " cube_io, " << reboots << " reboots of "
+                  << down_ms << " ms, reconnected after ms: "
+                  << std::fixed << std::setprecision(1)
+                  << "min " << times.front() << " p50 " << times[times.size() / 2]
+                  << " max " << times.back() << "\n  last outage " << timing.outage.count() / 1000.0
+                  << " ms (connect " << timing.connect.count() << " us, handshake " << timing.handshake.count()
+                  << " us), " << timing.reconnects << " reconnects, " << timing.timeouts << " timeouts" << std::endl;
+    }
+    return 0;
+}
+
+int burst_house(unsigned commands, unsigned recovery_ms)
+{
+    using clock = std::chrono::steady_clock;
+
+    sim_config cfg;
+    cfg.duty_recovery = std::chrono::milliseconds(recovery_ms);
+    cube_simulator sim(cfg);
+    if (!sim.start())
+    {
+        std::cerr << "can't start the cube simulator" << std::endl;
+        return 1;
+    }
+    unsigned rooms = sim.config().rooms;
+
+    roundtrip_target target;
+    cube_io cio(&target, cfg.serial);
+    if (!target.wait_changes(rooms, std::chrono::seconds(10)))
+    {
+        std::cerr << "cube_io didn't connect to the simulator" << std::endl;
+        return 1;
+    }
+    command_config ccfg;
+    ccfg.recovery = cfg.duty_recovery;
+    ccfg.max_queued = std::max<std::size_t>(ccfg.max_queued, commands);
+    ccfg.settle = std::chrono::milliseconds(0);
+    cio.configure_commands(ccfg);
+
+    std::vector<room_handle> handles;
+    for (unsigned u = 0; u < rooms; ++u)
+        handles.push_back(cio.find_room("Room " + std::to_string(u + 1)));
+
+    std::size_t sent0 = sim.stats().s_cmds;
+    std::size_t failed0 = sim.stats().s_failed;
+    std::size_t l0 = sim.stats().l_cmds;
+    auto t0 = clock::now();
+    for (unsigned u = 0; u < commands; ++u)
+    {
+        double temp = (u / rooms) % 2 ? 21.0 : 19.5;
+        cio.change_temp(handles[u % rooms], temp, (u % 10) ? command_priority::normal : command_priority::high);
+    }
+    command_queue_state st = cio.commands();
+    auto accepted = [&sim, sent0, failed0]() {
+        return (sim.stats().s_cmds - sent0) - (sim.stats().s_failed - failed0);
+    };
+    // queued changes of a room replace each other, done when the queue is empty
+    while (cio.commands().depth && (clock::now() - t0 < std::chrono::seconds(120)))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+    // the refresh after the burst
+    std::this_thread::sleep_for(ccfg.refresh_settle * 2);
+
+    std::cout << commands << " commands, budget recovers 1% per " << recovery_ms << " ms\n"
+              << "after queueing: depth " << st.depth << ", duty cycle " << st.duty_cycle
+              << "%, estimated delay " << st.estimated_delay.count() << " ms\n"
+              << std::fixed << std::setprecision(1)
+              << accepted() << " accepted in " << ms << " ms, "
+              << (sim.stats().s_failed - failed0) << " refused by duty cycle, "
+              << (sim.stats().l_cmds - l0) << " l: refreshes" << std::endl;
+    return cio.commands().depth ? 1 : 0;
+}
+
+int pipeline_house(unsigned commands)
+{
+    using clock = std::chrono::steady_clock;
+
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    if (!sim.start())
+    {
+        std::cerr << "can't start the cube simulator" << std::endl;
+        return 1;
+    }
+    unsigned rooms = sim.config().rooms;
+
+    roundtrip_target target;
+    cube_io cio(&target, cfg.serial);
+    if (!target.wait_changes(rooms, std::chrono::seconds(10)))
+    {
+        std::cerr << "cube_io didn't connect to the simulator" << std::endl;
+        return 1;
+    }
+    command_config ccfg;
+    ccfg.settle = std::chrono::milliseconds(0);
+    ccfg.refresh_settle = std::chrono::milliseconds(0);
+    cio.configure_commands(ccfg);
+
+    // in MANUAL the L-Msg shows the temperature sent, in AUTO the one of the schedule
+    std::vector<room_handle> handles;
+    for (unsigned u = 0; u < rooms; ++u)
+    {
+        handles.push_back(cio.find_room("Room " + std::to_string(u + 1)));
+        command_ticket t = cio.change_mode(handles.back(), opmode::MANUAL);
+        if ((t.confirmed.wait_for(std::chrono::seconds(30)) != std::future_status::ready)
+                || (t.confirmed.get().status != command_status::confirmed))
+        {
+            std::cerr << "room " << (u + 1) << " didn't switch to MANUAL" << std::endl;
+            return 1;
+        }
+    }
+    std::size_t s0 = sim.stats().s_cmds, l0 = sim.stats().l_cmds;
+
+    // every command is issued at once, the tickets tell when each took effect.
+    // The temperatures of a room rise by round, a command superseded by the next
+    // one to its room never shows up in an L-Msg
+    std::vector<command_ticket> tickets;
+    std::vector<double> sent_us(commands), shown_us(commands);
+    auto t0 = clock::now();
+    for (unsigned u = 0; u < commands; ++u)
+    {
+        double temp = 5.0 + 0.5 * ((u / rooms) % 50);
+        tickets.push_back(cio.change_temp(handles[u % rooms], temp, command_priority::normal,
+            [&sent_us, &shown_us, u, t0](const command_result &r) {
+                double us = std::chrono::duration<double, std::micro>(clock::now() - t0).count();
+                if (r.status == command_status::accepted)
+                    sent_us[u] = us;
+                else if (r.status == command_status::confirmed)
+                    shown_us[u] = us;
+            }));
+    }
+    std::array<std::size_t, 6> count{};
+    std::size_t last_confirmed = 0;
+    for (unsigned u = 0; u < commands; ++u)
+    {
+        const command_ticket &t = tickets[u];
+        if (t.confirmed.wait_for(std::chrono::seconds(30)) != std::future_status::ready)
+        {
+            std::cerr << "a command didn't complete within 30 s" << std::endl;
+            return 1;
+        }
+        command_status st = t.confirmed.get().status;
+        ++count[std::size_t(st)];
+        if ((u + rooms >= commands) && (st == command_status::confirmed))
+            ++last_confirmed;                   // the last one of its room
+    }
+    double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+    std::sort(sent_us.begin(), sent_us.end());
+    std::sort(shown_us.begin(), shown_us.end());
+    std::cout << commands << " commands to " << rooms << " rooms pipelined, all done in "
+              << std::fixed << std::setprecision(1) << ms << " ms\n"
+              << count[std::size_t(command_status::confirmed)] << " confirmed, "
+              << count[std::size_t(command_status::superseded)] << " superseded, "
+              << count[std::size_t(command_status::unconfirmed)] << " unconfirmed, "
+              << count[std::size_t(command_status::dropped)] << " dropped\n"
+              << "accepted after us: p50 " << sent_us[commands / 2] << " max " << sent_us.back()
+              << ", confirmed after us: p50 " << shown_us[commands / 2] << " max " << shown_us.back()
+              << "\ncube lines sent s: " << (sim.stats().s_cmds - s0) << " l: " << (sim.stats().l_cmds - l0) << std::endl;
+    std::size_t last = std::min<std::size_t>(commands, rooms);
+    bool complete = (count[std::size_t(command_status::confirmed)]
+                     + count[std::size_t(command_status::superseded)] == commands);
+    return (complete && (last_confirmed == last)) ? 0 : 1;
+}
+
+int poll_house(unsigned seconds)
+{
+    using clock = std::chrono::steady_clock;
+
+    // nothing moves but by commands
+    sim_config cfg;
+    cfg.quiet = true;
+    cube_simulator sim(cfg);
+    if (!sim.start())
+    {
+        std::cerr << "can't start the cube simulator" << std::endl;
+        return 1;
+    }
+    unsigned rooms = sim.config().rooms;
+
+    roundtrip_target target;
+    cube_io cio(&target, cfg.serial);
+    if (!target.wait_changes(rooms, std::chrono::seconds(10)))
+    {
+        std::cerr << "cube_io didn't connect to the simulator" << std::endl;
+        return 1;
+    }
+    // the defaults scaled from 10 s .. 300 s down to seconds
+    refresh_config rcfg;
+    rcfg.min = std::chrono::seconds(1);
+    rcfg.base = std::chrono::seconds(2);
+    rcfg.max = std::chrono::seconds(16);
+    rcfg.after_command = std::chrono::seconds(1);
+    rcfg.schedule_lag = std::chrono::seconds(1);
+    cio.configure_refresh(rcfg);
+    room_handle room = cio.find_room("Room 1");
+
+    std::size_t l0 = sim.stats().l_cmds;
+    auto t0 = clock::now();
+    auto command_at = t0 + std::chrono::seconds(seconds) * 2 / 3;
+    bool commanded = false;
+    refresh_state last = cio.refresh();
+    while (clock::now() - t0 < std::chrono::seconds(seconds))
+    {
+        if (!commanded && (clock::now() >= command_at))
+        {
+            cio.change_temp(room, 22.5);
+            commanded = true;
+        }
+        refresh_state st = cio.refresh();
+        if ((st.interval != last.interval) || (st.reason != last.reason))
+        {
+            std::cout << std::fixed << std::setprecision(1)
+                      << std::chrono::duration<double>(clock::now() - t0).count() << " s: poll every "
+                      << st.interval.count() << " s (" << to_string(st.reason) << ")" << std::endl;
+            last = st;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    std::cout << (sim.stats().l_cmds - l0) << " l: in " << seconds << " s, "
+              << seconds / rcfg.base.count() << " at a fixed interval" << std::endl;
+    return 0;
+}
+
+int slide_room(unsigned moves, unsigned interval_ms)
+{
+    using clock = std::chrono::steady_clock;
+
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    if (!sim.start())
+    {
+        std::cerr << "can't start the cube simulator" << std::endl;
+        return 1;
+    }
+    unsigned rooms = sim.config().rooms;
+
+    roundtrip_target target;
+    cube_io cio(&target, cfg.serial);
+    if (!target.wait_changes(rooms, std::chrono::seconds(10)))
+    {
+        std::cerr << "cube_io didn't connect to the simulator" << std::endl;
+        return 1;
+    }
+    command_config ccfg;
+    room_handle room = cio.find_room("Room 1");
+
+    // a slider dragged up in half degrees, the mode switched on the way. The
+    // last value is expected from the start, a max_settle flush may send it
+    // before the drag ended
+    moves = std::max(1u, std::min(moves, 50u));
+    target.expect("Room 1", 5.0 + 0.5 * (moves - 1));
+    std::size_t sent0 = sim.stats().s_cmds;
+    for (unsigned u = 0; u < moves; ++u)
+    {
+        cio.change_temp(room, 5.0 + 0.5 * u);
+        if (u == moves / 2)
+            cio.change_mode(room, opmode::MANUAL);
+        if (u + 1 < moves)
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    }
+    auto t0 = clock::now();
+    bool done = target.wait_done(std::chrono::seconds(10));
+    double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+    std::cout << moves << " changes every " << interval_ms << " ms, settle "
+              << ccfg.settle.count() << " ms, max " << ccfg.max_settle.count() << " ms\n"
+              << (sim.stats().s_cmds - sent0) << " s: sent, "
+              << std::fixed << std::setprecision(1)
+              << (done ? "final temperature after " : "final temperature missing after ")
+              << ms << " ms" << std::endl;
+    return done ? 0 : 1;
+}
+
+int usage()
+{
+    std::cerr << "usage: maxcube2mqtt_bench [iterations] [filter]\n"
+                 "       maxcube2mqtt_bench replay <capture file> [speed]\n"
+                 "       maxcube2mqtt_bench sim [rooms] [seconds]\n"
+                 "       maxcube2mqtt_bench warm [rooms]\n"
+                 "       maxcube2mqtt_bench multi [cubes] [rooms] [seconds] [threads]\n"
+                 "       maxcube2mqtt_bench reconnect [down ms] [reboots]\n"
+                 "       maxcube2mqtt_bench burst [commands] [recovery ms]\n"
+                 "       maxcube2mqtt_bench pipeline [commands]\n"
+                 "       maxcube2mqtt_bench poll [seconds]\n"
+                 "       maxcube2mqtt_bench slider [changes] [interval ms]" << std::endl;
+    return 2;
+}
+
+// all digits, strtoul alone takes "abc" as 0
+bool to_number(const char *arg, unsigned long &v)
+{
+    char *end = nullptr;
+    v = std::strtoul(arg, &end, 10);
+    return (*arg >= '0') && (*arg <= '9') && !*end;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string mode = (argc > 1) ? argv[1] : "";
+    if (mode == "replay")
+    {
+        char *end = nullptr;
+        double speed = (argc > 3) ? std::strtod(argv[3], &end) : 0.0;
+        if ((argc < 3) || (argc > 4) || (end && *end) || (speed < 0))
+            return usage();
+        return replay_capture(argv[2], speed);
+    }
+
+    // the numeric arguments following the mode, defaults for the missing ones
+    std::vector<unsigned long> n;
+    auto numbers = [&](std::initializer_list<unsigned long> defaults) {
+        n.assign(defaults);
+        if (std::size_t(argc) > n.size() + 2)
+            return false;
+        for (int i = 2; i < argc; ++i)
+        {
+            if (!to_number(argv[i], n[i - 2]))
+                return false;
+        }
+        return true;
+    };
+    if (mode == "sim")
+        return numbers({12, 5}) && n[0] ? simulate_house(n[0], n[1]) : usage();
+    if (mode == "multi")
+        return numbers({3, 12, 2, 1}) && n[0] && n[1] ? manage_houses(n[0], n[1], n[2], n[3]) : usage();
+    if (mode == "reconnect")
+        return numbers({300, 5}) && n[1] ? reconnect_house(n[0], n[1]) : usage();
+    if (mode == "burst")
+        return numbers({300, 10}) && n[0] ? burst_house(n[0], n[1]) : usage();
+    if (mode == "pipeline")
+        return numbers({100}) && n[0] ? pipeline_house(n[0]) : usage();
+    if (mode == "poll")
+        return numbers({30}) && n[0] ? poll_house(n[0]) : usage();
+    if (mode == "slider")
+        return numbers({20, 50}) && n[0] ? slide_room(n[0], n[1]) : usage();
+    if (mode == "warm")
+        return numbers({12}) && n[0] ? warm_start_house(n[0]) : usage();
+
+    bench_env env;
+    unsigned long iterations = env.iterations;
+    if ((argc > 3) || ((argc > 1) && (!to_number(argv[1], iterations) || !iterations)))
+        return usage();
+    env.iterations = iterations;
+    if (argc > 2)
+        env.filter = argv[2];
+
+    std::cout << "base64: " << base64::implementation()
+              << ", iterations: " << env.iterations << std::endl;
+
+    std::vector<m_room> rooms;
+    std::vector<m_device> devices;
+    sample_house(rooms, devices);
+    std::vector<l_submsg_data> ldata = sample_l_data(devices);
+
+    thermostat_settings ts;
+    ts.schedule = sample_schedule();
+
+    const std::string h_line = build_h_msg("KEQ0000001", 0x0abcde, 0x0113, 0, 50);
+    const std::vector<std::string> m_lines = build_m_msgs(rooms, devices);
+    const std::string l_line = build_l_msg(ldata);
+    const std::string c_line = build_c_msg(devices[1], ts);
+
+    const std::string l_payload = l_line.substr(2);
+    const std::string m_payload = m_lines[0].substr(8);
+    std::string l_bin = decode64(l_payload);
+    std::string m_bin = decode64(m_payload);
+    std::string c_bin = decode64(c_line.substr(c_line.find(',') + 1));
+
+    // codec
+    std::string out;
+    run(env, "decode64 (L-Msg)", [&]{ decode64(l_payload, out); keep(out); });
+    run(env, "encode64 (L-Msg)", [&]{ encode64(l_bin, out); keep(out); });
+    run(env, "decode64 copy (L-Msg)", [&]{ std::string s = decode64(l_payload); keep(s); });
+
+    // parsers on decoded data
+    run(env, "l_response (all records)", [&]{
+        l_msg_reader reader(l_bin);
+        l_submsg_data adata;
+        while (reader.next(adata) != l_msg_reader::result::end)
+            keep(adata);
+    });
+    std::vector<m_room> mr;
+    std::vector<m_device> md;
+    run(env, "m_response", [&]{ m_response(m_bin, mr, md); keep(md); });
+    const uint8_t *pc = reinterpret_cast<const uint8_t *>(c_bin.data());
+    run(env, "c_response", [&]{ dev_config dc; c_response(pc, c_bin.size(), dc); keep(dc); });
+    run(env, "get_schedule", [&]{
+        week_schedule ws = get_schedule(pc + proto::c_radiator_thermostat::schedule::offset);
+        keep(ws);
+    });
+    run(env, "schedule_to_json (to_json)", [&]{ std::string s = schedule_to_json("Room 1", ts.schedule); keep(s); });
+
+    // full line processing in an offline cube_io
+    null_target target;
+    cube_io cio(&target, "KEQ0000001", cube_io::offline_t{});
+    cio.inject(h_line);
+    for (const auto &m: m_lines)
+        cio.inject(m);
+    for (const m_device &d: devices)
+        cio.inject(build_c_msg(d, ts));
+    cio.inject(l_line);
+
+    run(env, "evaluate_data C-Msg", [&]{ cio.inject(c_line); });
+    run(env, "evaluate_data L-Msg", [&]{ cio.inject(l_line); });
+    run(env, "find_room", [&]{ room_handle h = cio.find_room("Room 12"); keep(h); });
+    run(env, "emit_changed_data", [&]{
+        cube_io_probe::mark_rooms_changed(cio);
+        cube_io_probe::emit_changed_data(cio);
+    });
+    run(env, "rooms() find", [&]{ room_sp r = cio.rooms()->find("Room 12"); keep(r); });
+    {
+        room_handle h = cio.find_room("Room 12");
+        history_query q;
+        q.last_n = 10;
+        run(env, "history last 10", [&]{ auto samples = cio.history(h, q); keep(samples); });
+    }
+
+    return 0;
+}
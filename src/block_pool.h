@@ -0,0 +1,110 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace max_eq3 {
+
+/**
+ * @brief The block_pool class
+ * recycles blocks of one size through a free list. The size is taken
+ * from the first allocation, other sizes go to the heap directly.
+ * Blocks may be returned from any thread.
+ */
+class block_pool
+{
+public:
+    explicit block_pool(std::size_t max_free = 256)
+        : _max_free(max_free)
+    {}
+    block_pool(const block_pool &) = delete;
+    block_pool &operator=(const block_pool &) = delete;
+    ~block_pool()
+    {
+        for (void *p: _free)
+            ::operator delete(p);
+    }
+
+    void *get(std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (!_block)
+                _block = size;
+            if ((size == _block) && !_free.empty())
+            {
+                void *p = _free.back();
+                _free.pop_back();
+                return p;
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void put(void *p, std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if ((size == _block) && (_free.size() < _max_free))
+            {
+                _free.push_back(p);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+private:
+    std::mutex          _mtx;
+    std::vector<void *> _free;
+    std::size_t         _block{0};
+    std::size_t         _max_free;
+};
+
+/**
+ * @brief The pool_allocator class
+ * allocator for std::allocate_shared, every control block keeps the pool
+ * alive, so objects may outlive the owner of the pool
+ */
+template <typename T>
+class pool_allocator
+{
+public:
+    using value_type = T;
+
+    explicit pool_allocator(std::shared_ptr<block_pool> pool)
+        : _pool(std::move(pool))
+    {}
+    template <typename U>
+    pool_allocator(const pool_allocator<U> &other)
+        : _pool(other._pool)
+    {}
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(_pool->get(n * sizeof(T)));
+    }
+    void deallocate(T *p, std::size_t n)
+    {
+        _pool->put(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const pool_allocator<U> &rhs) const { return _pool == rhs._pool; }
+    template <typename U>
+    bool operator!=(const pool_allocator<U> &rhs) const { return _pool != rhs._pool; }
+
+private:
+    template <typename U> friend class pool_allocator;
+
+    std::shared_ptr<block_pool> _pool;
+};
+
+}
+
+#endif // BLOCK_POOL_H
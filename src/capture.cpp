@@ -0,0 +1,202 @@
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capture.h"
+
+namespace max_eq3 {
+
+namespace {
+
+constexpr char capture_magic[8] = { 'M', 'A', 'X', 'C', 'A', 'P', '0', '1' };
+constexpr uint32_t capture_version = 1;
+
+struct capture_file_header
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    reserved;
+};
+static_assert(sizeof(capture_file_header) == 16, "capture header has to be packed");
+
+constexpr std::size_t padded(std::size_t len)
+{
+    return (len + 7) & ~std::size_t(7);
+}
+
+bool valid_header(const capture_file_header &hdr)
+{
+    return (std::memcmp(hdr.magic, capture_magic, sizeof(capture_magic)) == 0)
+            && (hdr.version == capture_version);
+}
+
+}
+
+capture_writer::~capture_writer()
+{
+    close();
+}
+
+bool capture_writer::open(const std::string &path)
+{
+    close();
+    _fp = std::fopen(path.c_str(), "a+b");
+    if (!_fp)
+        return false;
+
+    capture_file_header hdr{};
+    std::fseek(_fp, 0, SEEK_END);
+    long size = std::ftell(_fp);
+    if (size == 0)
+    {
+        std::memcpy(hdr.magic, capture_magic, sizeof(capture_magic));
+        hdr.version = capture_version;
+        std::fwrite(&hdr, sizeof(hdr), 1, _fp);
+    }
+    else
+    {
+        std::rewind(_fp);
+        if ((std::fread(&hdr, sizeof(hdr), 1, _fp) != 1) || !valid_header(hdr)
+                || (size % 8))
+        {
+            close();
+            return false;
+        }
+    }
+
+    _start = std::chrono::steady_clock::now();
+    int64_t wallclock = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    append(capture_dir::session, std::chrono::nanoseconds(0), &wallclock, sizeof(wallclock));
+    return true;
+}
+
+void capture_writer::close()
+{
+    if (_fp)
+    {
+        std::fclose(_fp);
+        _fp = nullptr;
+    }
+}
+
+void capture_writer::write(capture_dir dir, std::string_view line)
+{
+    if (_fp)
+        append(dir, std::chrono::steady_clock::now() - _start, line.data(), line.size());
+}
+
+void capture_writer::append(capture_dir dir, std::chrono::nanoseconds t, const void *data, std::size_t len)
+{
+    static const uint8_t padding[8] = {};
+
+    capture_record rec{};
+    rec.t_ns = uint64_t(t.count());
+    rec.len = uint32_t(len);
+    rec.dir = dir;
+    std::fwrite(&rec, sizeof(rec), 1, _fp);
+    std::fwrite(data, 1, len, _fp);
+    std::fwrite(padding, 1, padded(len) - len, _fp);
+}
+
+capture_reader::~capture_reader()
+{
+    close();
+}
+
+bool capture_reader::open(const std::string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if ((::fstat(fd, &st) == 0) && (std::size_t(st.st_size) >= sizeof(capture_file_header)))
+        p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    _data = static_cast<const uint8_t *>(p);
+    _size = st.st_size;
+    if (!valid_header(*reinterpret_cast<const capture_file_header *>(_data)))
+    {
+        close();
+        return false;
+    }
+    ::madvise(p, _size, MADV_SEQUENTIAL);
+    rewind();
+    return true;
+}
+
+void capture_reader::close()
+{
+    if (_data)
+        ::munmap(const_cast<uint8_t *>(_data), _size);
+    _data = nullptr;
+    _size = _pos = 0;
+    _truncated = false;
+}
+
+void capture_reader::rewind()
+{
+    _pos = sizeof(capture_file_header);
+    _truncated = false;
+}
+
+bool capture_reader::next(capture_entry &entry)
+{
+    if (!_data || (_pos == _size))
+        return false;
+
+    if (_size - _pos < sizeof(capture_record))
+    {
+        _truncated = true;
+        return false;
+    }
+    const capture_record *rec = reinterpret_cast<const capture_record *>(_data + _pos);
+    if (_size - _pos - sizeof(capture_record) < rec->len)
+    {
+        _truncated = true;
+        return false;
+    }
+    entry.t = std::chrono::nanoseconds(rec->t_ns);
+    entry.dir = rec->dir;
+    entry.line = std::string_view(reinterpret_cast<const char *>(rec + 1), rec->len);
+    _pos = std::min(_size, _pos + sizeof(capture_record) + padded(rec->len));
+    return true;
+}
+
+std::size_t replay(capture_reader &reader, double speed,
+                   const std::function<void(const capture_entry &)> &handler)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::size_t count = 0;
+    clock::time_point base = clock::now();
+    capture_entry entry;
+    while (reader.next(entry))
+    {
+        if (entry.dir == capture_dir::session)
+            base = clock::now();
+        else if (speed > 0.0)
+        {
+            auto due = base + std::chrono::duration_cast<clock::duration>(
+                        std::chrono::duration<double, std::nano>(entry.t.count() / speed));
+            std::this_thread::sleep_until(due);
+        }
+        handler(entry);
+        ++count;
+    }
+    return count;
+}
+
+}
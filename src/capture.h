@@ -0,0 +1,118 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace max_eq3 {
+
+/**
+ * Binary capture of a cube session.
+ *
+ * layout (native byte order, all records 8 byte aligned):
+ *      file header     "MAXCAP01", uint32 version, uint32 reserved
+ *      records         capture_record, payload, padding up to 8 bytes
+ *
+ * Each session starts with a capture_dir::session record holding the
+ * system clock time (ns since epoch) as payload, the timestamps of the
+ * following records are steady clock ns relative to that record.
+ * Files are only appended, a torn last record is ignored on reading.
+ */
+
+enum struct capture_dir : uint8_t {
+    session = 0,
+    rx = 1,         // line received from the cube
+    tx = 2,         // line sent to the cube
+};
+
+struct capture_record
+{
+    uint64_t    t_ns;       // since session start
+    uint32_t    len;        // payload length
+    capture_dir dir;
+    uint8_t     reserved[3];
+};
+static_assert(sizeof(capture_record) == 16, "capture record has to be packed");
+
+struct capture_entry
+{
+    std::chrono::nanoseconds    t;
+    capture_dir                 dir;
+    std::string_view            line;
+};
+
+/**
+ * @brief The capture_writer class
+ * appends lines to a capture file, not thread safe. The records are
+ * buffered by stdio and flushed by close(), a torn last record of a
+ * crash is skipped by the reader
+ */
+class capture_writer
+{
+public:
+    capture_writer() = default;
+    capture_writer(const capture_writer &) = delete;
+    capture_writer &operator=(const capture_writer &) = delete;
+    ~capture_writer();
+
+    // opens or creates the file and starts a new session
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const { return _fp != nullptr; }
+
+    void write(capture_dir dir, std::string_view line);
+
+private:
+    void append(capture_dir dir, std::chrono::nanoseconds t, const void *data, std::size_t len);
+
+    std::FILE                              *_fp{nullptr};
+    std::chrono::steady_clock::time_point   _start;
+};
+
+/**
+ * @brief The capture_reader class
+ * maps a capture file read only, the lines returned by next() point
+ * into the mapping and stay valid until close()
+ */
+class capture_reader
+{
+public:
+    capture_reader() = default;
+    capture_reader(const capture_reader &) = delete;
+    capture_reader &operator=(const capture_reader &) = delete;
+    ~capture_reader();
+
+    bool open(const std::string &path);
+    void close();
+
+    // false at the end of the file or at a torn record
+    bool next(capture_entry &entry);
+    void rewind();
+
+    // the file ends with an incomplete record
+    bool truncated() const { return _truncated; }
+
+private:
+    const uint8_t  *_data{nullptr};
+    std::size_t     _size{0};
+    std::size_t     _pos{0};
+    bool            _truncated{false};
+};
+
+/**
+ * @brief replay
+ * feeds the entries of a capture to the handler in recorded time distances
+ * @param speed time scale, 2.0 replays twice as fast, 0 without any delay
+ * @return number of entries replayed
+ */
+std::size_t replay(capture_reader &reader, double speed,
+                   const std::function<void(const capture_entry &)> &handler);
+
+}
+
+#endif // CAPTURE_H
@@ -0,0 +1,432 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace max_eq3 {
+
+enum struct command_priority : uint8_t {
+    high,
+    normal,
+    low,
+};
+
+constexpr std::size_t command_priority_count = 3;
+
+struct command_config
+{
+    // highest duty cycle (percent of the radio budget) a command of the priority is sent at
+    std::array<unsigned, command_priority_count>
+                                duty_limit{{100, 90, 75}};
+    // recovery of one percent, the budget (1% airtime) is renewed per hour
+    std::chrono::milliseconds   recovery{36000};
+    std::chrono::milliseconds   reply_timeout{5000};    // sent again without S-Msg
+    std::chrono::milliseconds   slot_wait{1000};        // retry when the cube has no free slot
+    std::size_t                 max_queued{256};
+
+    // temp and mode changes of a room are merged into one command, sent when
+    // no change followed within settle, at the latest max_settle after the
+    // first one. 0: sent at once
+    std::chrono::milliseconds   settle{250};
+    std::chrono::milliseconds   max_settle{2000};
+
+    // the L-Msg showing the results is asked for once per burst, refresh_settle
+    // after the last accepted command, at the latest refresh_max after the first
+    std::chrono::milliseconds   refresh_settle{100};
+    std::chrono::milliseconds   refresh_max{2000};
+
+    // L-Msgs an accepted command has to show up in, unconfirmed after
+    unsigned                    confirm_polls{3};
+};
+
+struct command_queue_state
+{
+    std::size_t                 depth{0};               // queued and in flight
+    std::chrono::milliseconds   estimated_delay{0};     // until a new command is answered
+    unsigned                    duty_cycle{0};          // estimate, percent of the budget used
+    unsigned                    free_slots{0};
+};
+
+enum struct command_status : uint8_t {
+    accepted,       // S-Msg, the cube took it
+    refused,        // S-Msg, no budget or slot, it is sent again
+    dropped,        // never sent: unknown room, invalid value or the queue overflowed
+    confirmed,      // an L-Msg shows the new values
+    unconfirmed,    // accepted, the L-Msgs didn't show them within confirm_polls
+    superseded,     // accepted, a later command to the room was accepted before an L-Msg showed it
+};
+
+inline const char *to_string(command_status s)
+{
+    switch (s)
+    {
+    case command_status::accepted:      return "accepted";
+    case command_status::refused:       return "refused";
+    case command_status::dropped:       return "dropped";
+    case command_status::confirmed:     return "confirmed";
+    case command_status::unconfirmed:   return "unconfirmed";
+    case command_status::superseded:    return "superseded";
+    }
+    return "unknown";
+}
+
+struct command_result
+{
+    command_status  status{command_status::dropped};
+    unsigned        duty_cycle{0};      // of the S-Msg, percent of the budget used
+    unsigned        free_slots{0};
+};
+
+// called on the io thread for every state of a command, must not block
+using command_callback = std::function<void(const command_result &)>;
+
+/**
+ * @brief The command_ticket struct
+ * returned for every command. sent resolves with the S-Msg accepting it
+ * (or dropped), confirmed once an L-Msg shows the values or superseded by
+ * a later accepted command to the room. Commands the L-Msg doesn't show
+ * (schedules) are confirmed by their S-Msg. Changes merged into one command
+ * share its results.
+ */
+struct command_ticket
+{
+    std::shared_future<command_result>  sent;
+    std::shared_future<command_result>  confirmed;
+};
+
+/**
+ * @brief The command_completion class
+ * the promises behind a command_ticket and the callback, each promise is
+ * resolved once
+ */
+class command_completion
+{
+public:
+    explicit command_completion(command_callback cb = command_callback())
+        : _cb(std::move(cb))
+        , _ticket{_sent.get_future().share(), _confirmed.get_future().share()}
+    {}
+
+    const command_ticket &ticket() const { return _ticket; }
+
+    void notify(const command_result &r)
+    {
+        if (_cb)
+            _cb(r);
+        switch (r.status)
+        {
+        case command_status::refused:
+            break;
+        case command_status::accepted:
+            resolve_sent(r);
+            break;
+        case command_status::dropped:
+            resolve_sent(r);
+            resolve_confirmed(r);
+            break;
+        case command_status::confirmed:
+        case command_status::unconfirmed:
+        case command_status::superseded:
+            resolve_confirmed(r);
+            break;
+        }
+    }
+
+private:
+    void resolve_sent(const command_result &r)
+    {
+        if (!_sent_done)
+            _sent.set_value(r);
+        _sent_done = true;
+    }
+    void resolve_confirmed(const command_result &r)
+    {
+        if (!_confirmed_done)
+            _confirmed.set_value(r);
+        _confirmed_done = true;
+    }
+
+    command_callback                _cb;
+    std::promise<command_result>    _sent;
+    std::promise<command_result>    _confirmed;
+    command_ticket                  _ticket;
+    bool                            _sent_done{false};
+    bool                            _confirmed_done{false};
+};
+
+using completion_sp = std::shared_ptr<command_completion>;
+using completions = std::vector<completion_sp>;
+
+inline void notify_all(const completions &done, const command_result &r)
+{
+    for (const auto &c: done)
+        c->notify(r);
+}
+
+/**
+ * @brief The command_queue class
+ * admission of the S-Msgs (s:) to the cube. The cube refuses commands once
+ * the duty cycle budget is used up or its memory slots are full, it reports
+ * both in the H-Msg and in the S-Msg answering every command. Commands wait
+ * by priority, one is in flight until its S-Msg arrived, a refused one is
+ * queued again in front. Between the reports the duty cycle is estimated,
+ * every command costs one percent, the budget recovers linearly. A command
+ * with a key (the room id) replaces a queued one with the same key, the
+ * completions of both are kept.
+ */
+class command_queue
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct command
+    {
+        std::string         line;       // "s:...\r\n"
+        command_priority    prio{command_priority::normal};
+        clock::time_point   queued;
+        unsigned            key{0};     // 0: never replaced
+        completions         done;
+        std::function<bool()>
+                            shown;      // true once an L-Msg shows the effect, empty: not shown
+    };
+
+    void configure(const command_config &cfg) { _cfg = cfg; }
+    const command_config &config() const { return _cfg; }
+
+    // false if the queue was full, the newest command of the lowest priority is dropped then
+    bool push(command c, clock::time_point now)
+    {
+        c.queued = now;
+        if (c.key && replace(c))
+            return true;
+        bool dropped = false;
+        if (depth() >= _cfg.max_queued)
+        {
+            for (std::size_t p = command_priority_count; p-- > 0; )
+            {
+                if (_queues[p].size())
+                {
+                    notify_all(_queues[p].back().done, result(command_status::dropped));
+                    _queues[p].pop_back();
+                    dropped = true;
+                    break;
+                }
+            }
+        }
+        std::size_t p = std::size_t(c.prio);
+        _queues[p].push_back(std::move(c));
+        return !dropped;
+    }
+
+    /**
+     * @brief admit
+     * the next command if the cube can take it now, it is in flight then.
+     * retry is set to the time the queue wants to be asked again, it stays
+     * untouched if there is nothing to wait for
+     */
+    std::optional<command> admit(clock::time_point now, clock::time_point &retry)
+    {
+        if (_in_flight)
+        {
+            retry = _sent + _cfg.reply_timeout;
+            return std::nullopt;
+        }
+        std::size_t p = 0;
+        while ((p < command_priority_count) && _queues[p].empty())
+            ++p;
+        if (p == command_priority_count)
+            return std::nullopt;
+
+        double duty = duty_at(now);
+        double limit = _cfg.duty_limit[p];
+        if (duty + 1.0 > limit)
+        {
+            retry = now + recovery_time(duty + 1.0 - limit);
+            return std::nullopt;
+        }
+        if (_slots_known && !_free_slots && (now < _slot_retry))
+        {
+            retry = _slot_retry;
+            return std::nullopt;
+        }
+
+        _in_flight = std::move(_queues[p].front());
+        _queues[p].pop_front();
+        _sent = now;
+        set_duty(duty + 1.0, now);          // until the S-Msg tells
+        return _in_flight;
+    }
+
+    // H-Msg
+    void status(unsigned duty_cycle, unsigned free_slots, clock::time_point now)
+    {
+        set_duty(duty_cycle, now);
+        set_slots(free_slots, now);
+    }
+
+    // S-Msg, returns false if the command in flight was refused (and queued again).
+    // An accepted one is handed to accepted (if given) to wait for its L-Msg
+    bool reply(unsigned duty_cycle, bool failed, unsigned free_slots, clock::time_point now,
+               std::optional<command> *accepted = nullptr)
+    {
+        set_duty(duty_cycle, now);
+        set_slots(free_slots, now);
+        if (!_in_flight)
+            return !failed;
+        auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(now - _sent);
+        _rtt = (_rtt * 7 + rtt) / 8;
+        command_result r{failed ? command_status::refused : command_status::accepted, duty_cycle, free_slots};
+        notify_all(_in_flight->done, r);
+        if (failed)
+        {
+            // with free slots it was the budget, exhausted for now whatever the cube reported
+            if (free_slots)
+                set_duty(std::max<double>(duty_cycle, _cfg.duty_limit[0]), now);
+            requeue();
+        }
+        else if (accepted)
+            *accepted = std::move(_in_flight);
+        _in_flight.reset();
+        return !failed;
+    }
+
+    // the command in flight got no S-Msg in time
+    bool expired(clock::time_point now) const
+    {
+        return _in_flight && (now - _sent >= _cfg.reply_timeout);
+    }
+
+    // connection lost or reply missing, the command in flight is sent again
+    void lost()
+    {
+        if (_in_flight)
+            requeue();
+        _in_flight.reset();
+    }
+
+    bool busy() const { return bool(_in_flight); }
+
+    std::size_t depth() const
+    {
+        std::size_t n = _in_flight ? 1 : 0;
+        for (const auto &q: _queues)
+            n += q.size();
+        return n;
+    }
+
+    // estimate for a new command of the given priority
+    command_queue_state state(command_priority prio, clock::time_point now) const
+    {
+        command_queue_state st;
+        st.depth = depth();
+        st.duty_cycle = unsigned(std::lround(duty_at(now)));
+        st.free_slots = _free_slots;
+
+        // the commands ahead and the new one need budget and a round trip each,
+        // the round trips overlap with the recovery
+        std::size_t ahead = _in_flight ? 1 : 0;
+        for (std::size_t p = 0; p <= std::size_t(prio); ++p)
+            ahead += _queues[p].size();
+        double need = duty_at(now) + double(ahead + 1) - _cfg.duty_limit[std::size_t(prio)];
+        clock::duration delay = std::max<clock::duration>(recovery_time(std::max(need, 0.0)) + _rtt,
+                                                          _rtt * (ahead + 1));
+        st.estimated_delay = std::chrono::duration_cast<std::chrono::milliseconds>(delay);
+        return st;
+    }
+
+private:
+    double duty_at(clock::time_point now) const
+    {
+        double recovered = std::chrono::duration<double>(now - _duty_time)
+                / std::chrono::duration<double>(_cfg.recovery);
+        return std::max(0.0, _duty - recovered);
+    }
+
+    clock::duration recovery_time(double percent) const
+    {
+        return std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double, std::milli>(percent * _cfg.recovery.count()));
+    }
+
+    void set_duty(double duty, clock::time_point now)
+    {
+        _duty = duty;
+        _duty_time = now;
+    }
+
+    void set_slots(unsigned free_slots, clock::time_point now)
+    {
+        _free_slots = free_slots;
+        _slots_known = true;
+        if (!free_slots)
+            _slot_retry = now + _cfg.slot_wait;
+    }
+
+    command_result result(command_status status) const
+    {
+        return command_result{status, unsigned(std::lround(_duty)), _free_slots};
+    }
+
+    // a queued command of the key gets the new line, it keeps its place
+    // unless the priority rises
+    bool replace(command &c)
+    {
+        for (auto &q: _queues)
+        {
+            for (auto it = q.begin(); it != q.end(); ++it)
+            {
+                if (it->key != c.key)
+                    continue;
+                c.done.insert(c.done.begin(), it->done.begin(), it->done.end());
+                if (c.prio < it->prio)
+                {
+                    c.queued = it->queued;
+                    q.erase(it);
+                    _queues[std::size_t(c.prio)].push_back(std::move(c));
+                }
+                else
+                {
+                    it->line = std::move(c.line);
+                    it->done = std::move(c.done);
+                    it->shown = std::move(c.shown);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void requeue()
+    {
+        _queues[std::size_t(_in_flight->prio)].push_front(std::move(*_in_flight));
+    }
+
+    command_config                  _cfg;
+    std::array<std::deque<command>, command_priority_count>
+                                    _queues;
+    std::optional<command>          _in_flight;
+    clock::time_point               _sent;
+    std::chrono::microseconds       _rtt{10000};    // S-Msg round trip, averaged
+
+    double                          _duty{0.0};     // percent at _duty_time
+    clock::time_point               _duty_time;
+    unsigned                        _free_slots{0};
+    bool                            _slots_known{false};
+    clock::time_point               _slot_retry;
+};
+
+}
+
+#endif // COMMAND_QUEUE_H
@@ -18,4 +18,22 @@ cube_t::cube_t(boost::asio::io_service &ios, std::string &&mcast_rsp, boost::asi
     fwbc = ((rdata[24] & 0xFF) << 8) + (rdata[25] & 0xFF);
 }
 
+cube_t::cube_t(boost::asio::io_service &ios, const cube_t &known)
+    : rfaddr(known.rfaddr)
+    , fwbc(known.fwbc)
+    , serial(known.serial)
+    , addr(known.addr)
+    , sock(ios)
+    , refreshtimer(ios)
+{
+}
+
+cube_t::cube_t(boost::asio::io_service &ios, const std::string &serialno, rfaddr_t addr)
+    : rfaddr(addr)
+    , serial(serialno)
+    , sock(ios)
+    , refreshtimer(ios)
+{
+}
+
 }
@@ -4,10 +4,12 @@
 
 #include <memory>
 #include <stdint.h>
+#include <utility>
 
 #include <boost/asio.hpp>
 
 #include "cube_types.h"
+#include "line_framer.h"
 
 namespace max_eq3 {
 
@@ -28,13 +30,25 @@ typedef struct cube_t
     boost::asio::ip::address        addr;
     boost::asio::ip::tcp::socket    sock;
     boost::asio::steady_timer       refreshtimer;
-    boost::asio::streambuf          rxdata;
+    std::chrono::seconds            refresh_interval{30};   // interval the refreshtimer is armed with
+    std::chrono::steady_clock::time_point
+                                    last_rx;                // time of the last read completion
+    line_framer<16384>              rxdata;
 
     // methods
     cube_t(boost::asio::io_service &ios,
            std::string &&mcast_rsp,
            boost::asio::ip::udp::endpoint ep);
 
+    // new connection to a cube found before (cached address)
+    cube_t(boost::asio::io_service &ios,
+           const cube_t &known);
+
+    // cube without network connection (offline processing)
+    cube_t(boost::asio::io_service &ios,
+           const std::string &serialno,
+           rfaddr_t addr);
+
 } cube_t;
 
 using cube_sp = std::shared_ptr<cube_t>;
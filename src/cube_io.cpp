@@ -1,56 +1,57 @@
 
 #include <algorithm>
+#include <charconv>
+#include <ctime>
 #include <chrono>
+#include <future>
 #include <iostream>
+#include <utility>
 
-#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 
 #include "cubio_io_p.h"
 #include "cube_log_internal.h"
 #include "utils.h"
 #include "io_operator.h"
+#include "l_msg_reader.h"
+#include "msg_parser.h"
+#include "cube_proto.h"
+#include "base64.h"
+#include "cube_manager.h"
+#include "discovery.h"
 
-#define MULTICAST		"224.0.0.1"
-#define MAX_UDP_PORT		23272
 #define MAX_TCP_PORT		62910
 
 namespace  {
 
-std::string cdt = "eQ3Max*\0*********I";
-std::string cdts("eQ3Max*\0", 8);
-std::string cdte = "I";
-std::string cdtu = "**********";
-
-uint8_t cube_detect_request[19] = {
-    0x65, 0x51, 0x33, 0x4d,
-    0x61, 0x78, 0x2a, 0x00,
-    0x2a, 0x2a, 0x2a, 0x2a,
-    0x2a, 0x2a, 0x2a, 0x2a,
-    0x2a, 0x2a, 0x49
-};
-
-bool l_response(std::string &&decoded, max_eq3::l_submsg_data &adata);
-
-bool m_response(std::string &&rawdata,
-                std::list<max_eq3::m_room> &roomlist,
-                std::list<max_eq3::m_device> &devicelist);
-
-max_eq3::week_schedule get_schedule(const uint8_t *pD);
-
-const max_eq3::room_conf * get_room_config(const std::string &room, const max_eq3::device_data_store::roomconfmap &cmap)
+const max_eq3::week_schedule *specific_schedule(const max_eq3::dev_config_v &specific)
 {
-    const max_eq3::room_conf * roomconfig = nullptr;
+    if (auto rt = std::get_if<max_eq3::radiatorThermostat_config>(&specific))
+        return &rt->schedule;
+    if (auto wt = std::get_if<max_eq3::wallThermostat_config>(&specific))
+        return &wt->schedule;
+    return nullptr;
+}
 
-    for (const auto &v: cmap)
+// equal schedules share one instance, unused ones are dropped on the way
+max_eq3::schedule_sp intern_schedule(std::vector<max_eq3::schedule_sp> &table, const max_eq3::week_schedule &ws)
+{
+    table.erase(std::remove_if(table.begin(), table.end(),
+                               [](const max_eq3::schedule_sp &s) { return s.use_count() == 1; }),
+                table.end());
+    for (const auto &s: table)
     {
-        if (room == v.second.name)
-            roomconfig = &v.second;
+        if (*s == ws)
+            return s;
     }
-    return roomconfig;
+    table.push_back(std::make_shared<const max_eq3::week_schedule>(ws));
+    return table.back();
 }
 
-
 }
 
 namespace max_eq3 {
@@ -73,6 +74,33 @@ struct l_submsg_data
 };
 #endif
 
+/**
+ * @brief The cube_io::session_task struct
+ * the connection to the cube as coroutines on the strand of the cube:
+ * discover, connect, handshake (up to the first L-Msg, see evaluate_data),
+ * steady and reconnect follow each other in run(). A phase waiting for the
+ * cube is given up after its timeout of session_config.
+ */
+struct cube_io::session_task
+{
+    // typed on the strand, an any_io_executor allocates a copy of it for every operation
+    template <typename T>
+    using task = ba::awaitable<T, cube_strand>;
+    static constexpr ba::use_awaitable_t<cube_strand> use_awaitable{};
+
+    static task<void> run(cube_io *cio);
+    static task<cube_sp> discover(cube_io *cio);
+    static task<void> serve(cube_io *cio, cube_sp cube);
+    static task<void> poll(cube_io *cio, cube_sp csp);
+    static task<cube_sp> reconnect(cube_io *cio);
+    // empty at the deadline if no cube has been found
+    static task<cube_sp> wait_found(cube_io *cio, std::chrono::steady_clock::time_point deadline);
+    // answers to the own discovery, standalone only
+    static task<void> listen(cube_io *cio);
+    // counted, close_session waits for all of them
+    static void spawn(cube_io *cio, task<void> t);
+};
+
 cube_event_target::~cube_event_target()
 {}
 
@@ -86,139 +114,705 @@ cube_io::cube_io(cube_event_target *iet, const std::string &serialno)
 {
     _p->serial = serialno;
     _p->iet = iet;
-    _p->io_thread = std::thread(std::bind(&cube_io::process_io, this));
+    _p->own_thread = true;
+    // the thread waits until io_id is set, its handlers compare against it
+    std::promise<void> ready;
+    _p->io_thread = std::thread([this, started = ready.get_future()](){
+        started.wait();
+        process_io();
+    });
+    _p->io_id = _p->io_thread.get_id();
+    ready.set_value();
+}
+
+cube_io::cube_io(cube_event_target *iet, const std::string &serialno, cube_manager &manager)
+    : _p(new Private(&manager.pool().io()))
+{
+    _p->serial = serialno;
+    _p->iet = iet;
+    _p->manager = &manager;
+    _p->io_id = manager.pool().single_thread_id();
+    // waits for the manager's discovery
+    session_task::spawn(this, session_task::run(this));
+}
+
+cube_io::cube_io(cube_event_target *iet, const std::string &serialno, offline_t)
+    : _p(new Private)
+{
+    _p->serial = serialno;
+    _p->iet = iet;
+    _p->cube = std::make_shared<cube_t>(_p->io, serialno, 0);
 }
 
 cube_io::~cube_io()
 {
-    _p->io.post([this](){
-        ba::async_write(_p->cube->sock, ba::buffer("q:\r\n"), [](const boost::system::error_code &e, std::size_t bytes_transferred){});
+    // the manager stopped the session of its cubes already
+    if (!_p->manager && _p->own_thread)
+    {
+        std::future<void> ended = stop_session();
+        while ((ended.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) && !_p->io.stopped())
+            ;
+        _p->io.stop();
+        _p->io_thread.join();
+    }
+    // no io runs anymore, the last values of the debounced state are written now
+    if (_p->state_dirty)
+        save_state();
+}
+
+void cube_io::inject(std::string_view line)
+{
+    std::lock_guard<std::recursive_mutex> lock(_p->offline_lock);
+    evaluate_data(_p->cube, line);
+}
+
+bool cube_io::capture_to(const std::string &path)
+{
+    auto writer = std::make_shared<capture_writer>();
+    if (!writer->open(path))
+    {
+        LogE("can't open capture file " << path)
+        return false;
+    }
+    if (!_p->offline())
+        ba::post(_p->strand, [this, writer](){ _p->capture = writer; });
+    else
+    {
+        std::lock_guard<std::recursive_mutex> lock(_p->offline_lock);
+        _p->capture = writer;
+    }
+    return true;
+}
+
+std::size_t cube_io::replay(const std::string &path, double speed)
+{
+    capture_reader reader;
+    if (!reader.open(path))
+    {
+        LogE("can't open capture file " << path)
+        return 0;
+    }
+    std::size_t lines = 0;
+    max_eq3::replay(reader, speed, [this, &lines](const capture_entry &e){
+        if (e.dir == capture_dir::rx)
+        {
+            // per line, the api calls of other threads get in between
+            std::lock_guard<std::recursive_mutex> lock(_p->offline_lock);
+            evaluate_data(_p->cube, e.line);
+            ++lines;
+        }
+        else if (e.dir == capture_dir::tx)
+            LogV("replay skips sent " << dump(e.line))
     });
-    _p->io.stop();
-    _p->io_thread.join();
+    if (reader.truncated())
+        LogE("capture file " << path << " ends with a torn record")
+    return lines;
+}
+
+std::size_t cube_io::warm_start(const std::string &path)
+{
+    // a thread of the shared pool mustn't wait for the strand, the strand
+    // restores before it gets the cube's own M-Msg
+    if (!_p->offline() && !_p->strand.running_in_this_thread() && _p->io.get_executor().running_in_this_thread())
+    {
+        ba::post(_p->strand, [this, path](){ restore_state(path); });
+        return 0;
+    }
+    return on_io_thread([this, &path]() { return restore_state(path); });
+}
+
+void cube_io::save_state()
+{
+    // written aside and renamed, a crash leaves the previous state
+    std::string tmp = _p->state_path + ".tmp";
+    std::remove(tmp.c_str());
+    capture_writer writer;
+    if (!writer.open(tmp))
+    {
+        LogE("can't write state file " << tmp)
+        return;
+    }
+    if (!_p->state_m_line.empty())
+        writer.write(capture_dir::rx, _p->state_m_line);
+    for (const auto &c: _p->state_c_lines)
+    {
+        if (!c.empty())
+            writer.write(capture_dir::rx, c);
+    }
+    if (!_p->state_l_line.empty())
+        writer.write(capture_dir::rx, _p->state_l_line);
+    writer.close();
+    if (std::rename(tmp.c_str(), _p->state_path.c_str()) != 0)
+        LogE("can't replace state file " << _p->state_path)
+    _p->state_dirty = false;
+}
+
+std::size_t cube_io::restore_state(const std::string &path)
+{
+    _p->state_path = path;
+    std::size_t lines = 0;
+    capture_reader reader;
+    // the file isn't rewritten with the lines it is read from
+    _p->state_restoring = true;
+    if (reader.open(path))
+    {
+        capture_entry e;
+        while (reader.next(e))
+        {
+            if (e.dir == capture_dir::rx)
+            {
+                evaluate_data(_p->cube, e.line);
+                ++lines;
+            }
+        }
+        LogI("warm start with " << lines << " lines from " << path)
+    }
+    _p->state_restoring = false;
+    _p->state_dirty = false;
+    return lines;
 }
 
-void cube_io::change_temp(const std::string &room, double temp)
+void cube_io::capture(capture_dir dir, std::string_view line)
+{
+    if (_p->capture)
+    {
+        if ((line.size() >= 2) && (line.substr(line.size() - 2) == "\r\n"))
+            line.remove_suffix(2);
+        _p->capture->write(dir, line);
+    }
+}
+
+command_ticket cube_io::change_temp(const std::string &room, double temp, command_priority prio, command_callback done)
 {
     LogI(__FUNCTION__ << " for " << room << " to " << temp);
-    _p->io.post(boost::bind(&cube_io::do_send_temp, this, room, temp));
+    auto c = std::make_shared<command_completion>(std::move(done));
+    ba::post(_p->strand, [this, room, temp, prio, c](){ do_send_temp(resolve(room), temp, prio, c); });
+    return c->ticket();
 }
 
-void cube_io::change_mode(const std::string &room, opmode mode)
+command_ticket cube_io::change_mode(const std::string &room, opmode mode, command_priority prio, command_callback done)
 {
     LogI(__FUNCTION__ << " for " << room << " to " << mode_as_string(mode));
-    _p->io.post(boost::bind(&cube_io::do_send_mode, this, room, mode));
+    auto c = std::make_shared<command_completion>(std::move(done));
+    ba::post(_p->strand, [this, room, mode, prio, c](){ do_send_mode(resolve(room), mode, prio, c); });
+    return c->ticket();
 }
 
-void cube_io::process_io()
+command_ticket cube_io::change_schedule(const std::string &room, days day, const day_schedule &ds,
+                                        command_priority prio, command_callback done)
+{
+    LogI(__FUNCTION__ << " for " << room << " day " << int(day));
+    auto c = std::make_shared<command_completion>(std::move(done));
+    ba::post(_p->strand, [this, room, day, ds, prio, c](){ do_send_schedule(resolve(room), day, ds, prio, c); });
+    return c->ticket();
+}
+
+template <typename F>
+auto cube_io::on_io_thread(F f) -> decltype(f())
 {
-    bs::error_code error;
-    boost::asio::ip::address listen_address = ba::ip::address::from_string("0.0.0.0");
-    boost::asio::ip::udp::endpoint listen_endpoint(listen_address, MAX_UDP_PORT);
-    _p->socket.open(listen_endpoint.protocol());
-    _p->socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
-    _p->socket.bind(listen_endpoint);
-    if (!error)
+    using result_t = decltype(f());
+    // replay feeds an offline instance from another thread, the store is locked then
+    if (_p->offline())
+    {
+        std::lock_guard<std::recursive_mutex> lock(_p->offline_lock);
+        return f();
+    }
+    // a single io thread runs any handler in order, the strand isn't needed then
+    if (_p->strand.running_in_this_thread() || (std::this_thread::get_id() == _p->io_id))
+        return f();
+    if (_p->io.stopped())
+        return result_t();
+    // another thread of the pool may be needed to run the strand
+    if (_p->io.get_executor().running_in_this_thread())
     {
+        LogE("no waiting for the cube " << _p->serial << " on a thread of its pool")
+        return result_t();
+    }
 
-        ba::ip::udp::endpoint senderEndpoint(ba::ip::address_v4::from_string(MULTICAST), MAX_UDP_PORT);
+    // the store belongs to the strand
+    std::promise<result_t> result;
+    std::future<result_t> fut = result.get_future();
+    ba::post(_p->strand, [&result, &f](){ result.set_value(f()); });
+    // an io stopped meanwhile (no discovery port) doesn't run it anymore
+    while (fut.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
+    {
+        if (_p->io.stopped() && (fut.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+            return result_t();
+    }
+    return fut.get();
+}
 
-        LogV("send now")
+room_handle cube_io::find_room(std::string_view room)
+{
+    return rooms()->handle(room);
+}
 
-        std::string mcreq;
-        if (_p->serial.size())
-        {
-            mcreq = cdts + _p->serial + cdte;
-        }
-        else
-        {
-            mcreq = cdts + cdtu + cdte;
-        }
-        LogV("size of serial req " << mcreq.size() << " [" << dump(mcreq) << "]\n")
+std::vector<history_sample> cube_io::history(room_handle room, const history_query &q)
+{
+    return on_io_thread([this, room, &q]() {
+        std::vector<history_sample> samples;
+        if (const room_conf *rc = resolve(room))
+            _p->devconfigs.room_history[rc->id][std::size_t(q.series)].query(q, samples);
+        return samples;
+    });
+}
 
-        _p->socket.async_send_to(
-            ba::buffer(mcreq, mcreq.size()),
-            senderEndpoint,
-            [](const bs::error_code &ec, size_t)
-                { LogV("mcast send done") }
-        );
-        LogV("mcast send started ")
+std::vector<history_sample> cube_io::history(rfaddr_t device, const history_query &q)
+{
+    return on_io_thread([this, device, &q]() {
+        std::vector<history_sample> samples;
+        std::size_t slot = _p->devconfigs.find(device);
+        if (slot != device_data_store::npos)
+            _p->devconfigs.dev_history[slot][std::size_t(q.series)].query(q, samples);
+        return samples;
+    });
+}
+
+command_ticket cube_io::change_temp(room_handle room, double temp, command_priority prio, command_callback done)
+{
+    auto c = std::make_shared<command_completion>(std::move(done));
+    ba::post(_p->strand, [this, room, temp, prio, c](){ do_send_temp(resolve(room), temp, prio, c); });
+    return c->ticket();
+}
+
+command_ticket cube_io::change_mode(room_handle room, opmode mode, command_priority prio, command_callback done)
+{
+    auto c = std::make_shared<command_completion>(std::move(done));
+    ba::post(_p->strand, [this, room, mode, prio, c](){ do_send_mode(resolve(room), mode, prio, c); });
+    return c->ticket();
+}
+
+command_ticket cube_io::change_schedule(room_handle room, days day, const day_schedule &ds,
+                                        command_priority prio, command_callback done)
+{
+    auto c = std::make_shared<command_completion>(std::move(done));
+    ba::post(_p->strand, [this, room, day, ds, prio, c](){ do_send_schedule(resolve(room), day, ds, prio, c); });
+    return c->ticket();
+}
+
+void cube_io::configure_commands(const command_config &cfg)
+{
+    if (!_p->offline())
+        ba::post(_p->strand, [this, cfg](){ _p->commands.configure(cfg); });
+    else
+    {
+        std::lock_guard<std::recursive_mutex> lock(_p->offline_lock);
+        _p->commands.configure(cfg);
+    }
+}
+
+void cube_io::configure_refresh(const refresh_config &cfg)
+{
+    if (!_p->offline())
+        ba::post(_p->strand, [this, cfg](){
+            _p->refresh.configure(cfg);
+            if (_p->cube)
+            {
+                _p->cube->refresh_interval = poll_interval();
+                arm_refresh(_p->cube);
+            }
+        });
+    else
+    {
+        std::lock_guard<std::recursive_mutex> lock(_p->offline_lock);
+        _p->refresh.configure(cfg);
+    }
+}
+
+void cube_io::configure_session(const session_config &cfg)
+{
+    if (!_p->offline())
+        ba::post(_p->strand, [this, cfg](){ _p->session_cfg = cfg; });
+    else
+    {
+        std::lock_guard<std::recursive_mutex> lock(_p->offline_lock);
+        _p->session_cfg = cfg;
+    }
+}
+
+session_timing cube_io::session()
+{
+    return on_io_thread([this]() { return _p->timing; });
+}
+
+refresh_state cube_io::refresh()
+{
+    return on_io_thread([this]() { return _p->refresh_reported; });
+}
 
-        _p->socket.async_receive_from(ba::buffer(_p->recvline, sizeof(_p->recvline)),
-                                      _p->mcast_endpoint,
-                                      boost::bind(&cube_io::handle_mcast_response, this,
-                                      boost::asio::placeholders::error,
-                                      boost::asio::placeholders::bytes_transferred));
+command_queue_state cube_io::commands(command_priority prio)
+{
+    return on_io_thread([this, prio]() {
+        return _p->commands.state(prio, std::chrono::steady_clock::now());
+    });
+}
 
-        _p->io.run();
-        LogV("done")
+const room_conf *cube_io::resolve(std::string_view room)
+{
+    unsigned id = _p->devconfigs.room_id(room);
+    if (!id)
+    {
+        LogE("no room found for name " << room)
+        return nullptr;
     }
+    return &_p->devconfigs.roomconf[id];
 }
 
-void cube_io::timed_refresh(cube_sp csp, const boost::system::error_code &ec)
+const room_conf *cube_io::resolve(room_handle room)
 {
+    if (room.generation != _p->devconfigs.room_generation)
+    {
+        LogE("room handle " << room.id << " outdated by a new room configuration")
+        return nullptr;
+    }
+    if (!_p->devconfigs.has_room(room.id))
+    {
+        LogE("no room found for id " << room.id)
+        return nullptr;
+    }
+    return &_p->devconfigs.roomconf[room.id];
+}
+
+void cube_io::process_io()
+{
+    bs::error_code ec;
+    ba::ip::udp::endpoint listen_endpoint(ba::ip::address_v4::any(), discovery_port);
+    _p->socket.open(listen_endpoint.protocol(), ec);
     if (!ec)
+        _p->socket.set_option(ba::ip::udp::socket::reuse_address(true), ec);
+    if (!ec)
+        _p->socket.bind(listen_endpoint, ec);
+    if (ec)
+    {
+        LogE("can't bind the discovery port " << discovery_port << ": " << ec.message())
+        // no io runs for this cube, the waiting api calls return
+        _p->io.stop();
+        return;
+    }
+
+    session_task::spawn(this, session_task::listen(this));
+    session_task::spawn(this, session_task::run(this));
+
+    _p->io.run();
+    LogV("done")
+}
+
+cube_io::session_task::task<void> cube_io::session_task::run(cube_io *cio)
+{
+    // an empty cube ends the session, see close_session
+    cube_sp cube = co_await discover(cio);
+    while (cube)
+    {
+        co_await serve(cio, cube);
+        if (cio->_p->stopping)
+            break;
+        cube = co_await reconnect(cio);
+    }
+}
+
+void cube_io::session_task::spawn(cube_io *cio, task<void> t)
+{
+    Private &p = *cio->_p;
+    ++p.tasks;
+    ba::co_spawn(p.strand, std::move(t), ba::bind_executor(p.strand, [cio](std::exception_ptr){
+        Private &p = *cio->_p;
+        if (!--p.tasks && p.stopping)
+            p.stopped.set_value();
+    }));
+}
+
+cube_io::session_task::task<cube_sp> cube_io::session_task::discover(cube_io *cio)
+{
+    Private &p = *cio->_p;
+    cio->enter_phase(session_phase::discover);
+    // the manager repeats its discovery itself
+    if (p.manager)
+        co_return co_await wait_found(cio, std::chrono::steady_clock::time_point::max());
+    for (;;)
+    {
+        send_discovery(p.io, p.serial);
+        LogV("mcast send started ")
+        if (cube_sp cube = co_await wait_found(cio, std::chrono::steady_clock::now() + p.session_cfg.discover_timeout))
+            co_return cube;
+        if (p.stopping)
+            co_return cube_sp();
+        ++p.timing.timeouts;
+        LogI("no cube answered the discovery, sent again")
+    }
+}
+
+cube_io::session_task::task<void> cube_io::session_task::serve(cube_io *cio, cube_sp cube)
+{
+    Private &p = *cio->_p;
+    ba::ip::tcp::endpoint ep(cube->addr, MAX_TCP_PORT);
+    LogV("connect to " << ep)
+    p.known = cube;
+    p.found.reset();
+    p.linked = true;
+    // the phase timer closes the socket of a stuck connect or handshake
+    cio->enter_phase(session_phase::connect, cube);
+    bs::error_code ec;
+    co_await cube->sock.async_connect(ep, ba::redirect_error(use_awaitable, ec));
+    if (p.stopping)
+        co_return;
+    if (ec)
+    {
+        LogE("connect to cube " << cube->serial << " at " << cube->addr << " failed: " << ec.message())
+        co_return;
+    }
+    if (p.backoff.failures())
+        LogI("reconnected to cube " << cube->serial << " after " << p.backoff.failures() << " attempts")
+    else
+        LogV("connected")
+    p.backoff.reset();
+    p.cube = cube;
+    cio->enter_phase(session_phase::handshake, cube);
+    cube->last_rx = std::chrono::steady_clock::now();
+    cube->refresh_interval = cio->poll_interval();
+    cube->refreshtimer.expires_after(cube->refresh_interval);
+    spawn(cio, poll(cio, cube));
+
+    for (;;)
     {
+        std::size_t bytes_recvd = co_await cube->sock.async_read_some(cube->rxdata.prepare(),
+                                                                       ba::redirect_error(use_awaitable, ec));
+        if (ec)
+        {
+            LogE("error on receive for cube " << std::hex << cube->rfaddr << ": " << ec.message())
+            break;
+        }
+        cio->received(cube, bytes_recvd);
+    }
+    p.cube.reset();
+    cube->refreshtimer.cancel();        // ends poll
+}
+
+cube_io::session_task::task<void> cube_io::session_task::poll(cube_io *cio, cube_sp csp)
+{
+    Private &p = *cio->_p;
+    // arm_refresh moves the expiry, the wait is cancelled then and started again
+    for (;;)
+    {
+        bs::error_code ec;
+        co_await csp->refreshtimer.async_wait(ba::redirect_error(use_awaitable, ec));
+        if (csp != p.cube)
+            co_return;
+        if (ec)
+            continue;
+
+        // the timer is not moved on received data, look at the last activity instead
+        auto now = std::chrono::steady_clock::now();
+        bool periodic = now >= csp->last_rx + csp->refresh_interval;
+        bool planned = p.refresh_pending && (now >= cio->refresh_due());
+        if (!periodic && !planned)
+        {
+            csp->refreshtimer.expires_at(csp->last_rx + csp->refresh_interval);
+            cio->arm_refresh(csp);
+            continue;
+        }
+        cio->capture(capture_dir::tx, "l:");
         ba::async_write(csp->sock,
                         ba::buffer("l:\r\n"),
-                        [](const boost::system::error_code &e, std::size_t bytes_transferred)
+                        [](const boost::system::error_code &e, std::size_t)
                         {
                             if (e)
                                 LogE("write failed on refresh start")
-                            // else
-                            //    LogV("refresh started " << e << ": " << bytes_transferred)
                         }
         );
+        p.refresh_pending = false;
+        csp->last_rx = now;
+        csp->refresh_interval = cio->poll_interval();
+        csp->refreshtimer.expires_after(csp->refresh_interval);
     }
 }
 
-void cube_io::rxrh_done(cube_sp csp, const boost::system::error_code& e, std::size_t bytes_recvd)
+cube_io::session_task::task<cube_sp> cube_io::session_task::reconnect(cube_io *cio)
 {
-    LogV("rxrh_done\n")
-    if (e)
+    Private &p = *cio->_p;
+    cio->link_lost();
+
+    // the cached address first, discovery only after it failed, the cube may have got a new one
+    auto delay = p.backoff.next();
+    if (p.backoff.failures() > 1)
     {
-        LogE("error on receive for cube " << std::hex << csp->rfaddr)
+        if (p.manager)
+            p.manager->rediscover();
+        else
+            send_discovery(p.io, p.serial);
     }
-    else
+    LogI("cube " << p.known->serial << " lost, reconnect in " << delay.count() << " ms")
+    // a discovery response within the delay is taken instead
+    cube_sp cube = co_await wait_found(cio, std::chrono::steady_clock::now() + delay);
+    if (!cube && !p.stopping)
+        cube = std::make_shared<cube_t>(p.io, *p.known);
+    co_return cube;
+}
+
+cube_io::session_task::task<cube_sp> cube_io::session_task::wait_found(cube_io *cio, std::chrono::steady_clock::time_point deadline)
+{
+    Private &p = *cio->_p;
+    if (!p.found)
     {
-        std::istream is(&csp->rxdata);
-        std::string result_line;
-        std::getline(is, result_line);
-        result_line.pop_back();
-        csp->refreshtimer.cancel();
+        p.found_signal.expires_at(deadline);
+        bs::error_code ec;
+        co_await p.found_signal.async_wait(ba::redirect_error(use_awaitable, ec));
+    }
+    co_return std::exchange(p.found, cube_sp());
+}
 
-        // evaluation of data
-        evaluate_data(csp, std::move(result_line));
+cube_io::session_task::task<void> cube_io::session_task::listen(cube_io *cio)
+{
+    Private &p = *cio->_p;
+    for (;;)
+    {
+        bs::error_code ec;
+        std::size_t bytes_recvd = co_await p.socket.async_receive_from(ba::buffer(p.recvline, sizeof(p.recvline)),
+                                                                       p.mcast_endpoint,
+                                                                       ba::redirect_error(use_awaitable, ec));
+        LogV(__FUNCTION__ << "(" << ec << ',' << std::dec << bytes_recvd << ")")
+        if (ec == ba::error::operation_aborted)
+            co_return;
+        if (ec)
+            continue;
+        std::string_view data(reinterpret_cast<const char *>(p.recvline), bytes_recvd);
+        if (bytes_recvd == 19)
+            LogV("rcvd bcast himself")
+        else if ((bytes_recvd == 26) && (data.substr(0, 8) == "eQ3MaxAp"))    // response from hub
+            cio->found(std::make_shared<cube_t>(p.io, std::string(data), p.mcast_endpoint));
+    }
+}
 
+void cube_io::enter_phase(session_phase phase, cube_sp cube)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto spent = std::chrono::duration_cast<std::chrono::microseconds>(now - _p->phase_since);
+    session_timing &t = _p->timing;
+    switch (t.phase)
+    {
+    case session_phase::discover:   t.discover = spent; break;
+    case session_phase::connect:    t.connect = spent; break;
+    case session_phase::handshake:  t.handshake = spent; break;
+    default:                        break;
     }
-    start_rx_from_cube(csp);
+    // a failed attempt doesn't restart the outage
+    if ((phase == session_phase::reconnect) && (_p->lost_at == std::chrono::steady_clock::time_point()))
+        _p->lost_at = now;
+    if ((phase == session_phase::steady) && (_p->lost_at != std::chrono::steady_clock::time_point()))
+    {
+        t.outage = std::chrono::duration_cast<std::chrono::microseconds>(now - _p->lost_at);
+        ++t.reconnects;
+        _p->lost_at = std::chrono::steady_clock::time_point();
+    }
+    LogV("session " << to_string(t.phase) << " -> " << to_string(phase) << " after " << spent.count() << " us")
+    t.phase = phase;
+    _p->phase_since = now;
+    ++_p->phase_seq;
+    arm_phase_timer(cube);
 }
 
-void cube_io::restart_wait_timer(cube_sp &csp)
+void cube_io::arm_phase_timer(cube_sp cube)
 {
-    csp->refreshtimer.cancel();
-    csp->refreshtimer.expires_after(std::chrono::seconds(_p->short_refresh ? 5 : 30));
-    csp->refreshtimer.async_wait(
-                boost::bind(&cube_io::timed_refresh,
-                            this,
-                            csp,
-                            ba::placeholders::error)
-                );
-    _p->short_refresh = false;
+    std::chrono::milliseconds timeout{0};
+    switch (_p->timing.phase)
+    {
+    case session_phase::connect:    timeout = _p->session_cfg.connect_timeout; break;
+    case session_phase::handshake:  timeout = _p->session_cfg.handshake_timeout; break;
+    default:                        break;      // the discovery is repeated by session_task::discover
+    }
+    if (!timeout.count())
+    {
+        _p->phase_timer.cancel();
+        return;
+    }
+    _p->phase_timer.expires_after(timeout);
+    _p->phase_timer.async_wait(ba::bind_executor(_p->strand, [this, cube, seq = _p->phase_seq](const bs::error_code &ec){
+        if (ec || (seq != _p->phase_seq))
+            return;
+        ++_p->timing.timeouts;
+        LogE("cube " << cube->serial << " at " << cube->addr << ": " << to_string(_p->timing.phase) << " timed out")
+        // completes the connect or the read with operation_aborted, the session reconnects then
+        bs::error_code cec;
+        cube->sock.close(cec);
+    }));
 }
 
-void cube_io::start_rx_from_cube(cube_sp &csp)
+void cube_io::plan_refresh()
 {
-    // update_config(csp);
-    restart_wait_timer(csp);
-    LogV("start_rx_from_cube\n")
-    ba::async_read_until(csp->sock, csp->rxdata, "\r\n",
-                        boost::bind(&cube_io::rxrh_done, this, csp,
-                                    boost::asio::placeholders::error,
-                                    boost::asio::placeholders::bytes_transferred
-                                    )
-                         );
+    if (!_p->cube)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    if (!_p->refresh_pending)
+    {
+        _p->refresh_pending = true;
+        _p->refresh_first = now;
+    }
+    _p->refresh_last = now;
+    _p->refresh.commanded();
+    arm_refresh(_p->cube);
+}
 
+std::chrono::seconds cube_io::poll_interval()
+{
+    // the nearest transition of the schedules in use
+    std::optional<std::chrono::seconds> transition;
+    std::time_t t = std::time(nullptr);
+    std::tm now;
+    localtime_r(&t, &now);
+    for (const auto &s: _p->schedules)
+    {
+        if (s.use_count() == 1)
+            continue;               // dropped on the next interning
+        auto next = next_transition(*s, now);
+        if (next && (!transition || (*next < *transition)))
+            transition = next;
+    }
+
+    refresh_state st = _p->refresh.next(transition);
+    if ((st.interval != _p->refresh_reported.interval) || (st.reason != _p->refresh_reported.reason))
+        LogI("poll every " << st.interval.count() << " s (" << to_string(st.reason) << ")")
+    _p->refresh_reported = st;
+    return st.interval;
+}
+
+std::chrono::steady_clock::time_point cube_io::refresh_due() const
+{
+    // after the burst, the S-Msg of the command in flight asks again
+    const command_config &cfg = _p->commands.config();
+    auto latest = _p->refresh_first + cfg.refresh_max;
+    if (_p->commands.busy())
+        return latest;
+    return std::min(_p->refresh_last + cfg.refresh_settle, latest);
+}
+
+void cube_io::arm_refresh(cube_sp &csp)
+{
+    auto due = csp->last_rx + csp->refresh_interval;
+    if (_p->refresh_pending)
+        due = std::min(due, refresh_due());
+    // an earlier expiry cancels the wait of session_task::poll, it waits again then,
+    // a later one is taken by poll when the timer expires early
+    if (due < csp->refreshtimer.expiry())
+        csp->refreshtimer.expires_at(due);
+}
+
+void cube_io::received(cube_sp csp, std::size_t bytes_recvd)
+{
+    csp->rxdata.commit(bytes_recvd);
+    csp->last_rx = std::chrono::steady_clock::now();
+
+    // evaluation of all complete lines
+    std::string_view line;
+    while (csp->rxdata.next_line(line))
+    {
+        capture(capture_dir::rx, line);
+        evaluate_data(csp, line);
+    }
+
+    if (csp->rxdata.overflow())
+    {
+        LogE("line exceeds receive buffer, " << csp->rxdata.pending() << " bytes dropped")
+        csp->rxdata.clear();
+    }
 }
 
 void cube_io::update_config(cube_sp csp)
@@ -238,6 +832,7 @@ void cube_io::update_config(cube_sp csp)
     LogV("query config " << txcmd)
     if (txcmd.size())
     {
+        capture(capture_dir::tx, txcmd);
         ba::async_write(csp->sock,
             ba::buffer(txcmd, txcmd.size()),
             [](const boost::system::error_code &e, std::size_t bytes_transferred)
@@ -254,78 +849,72 @@ void cube_io::update_config(cube_sp csp)
     }
 }
 
-void cube_io::process_connect(cube_sp cube, const bs::error_code &ec)
+void cube_io::found(cube_sp cube)
 {
-    if (ec)
-    {
-        LogE("connect failed " << ec)
-        std::cout << "cube connect failed: " << ec << std::endl;
-        std::unique_ptr<ba::steady_timer> timer = std::make_unique<ba::steady_timer>(_p->io,
-                                                          std::chrono::steady_clock::now() + std::chrono::seconds(10));
-        timer->async_wait([&timer, this](boost::system::error_code ec){
-            std::cout << "reconnect timeout\n";
-            this->process_io();
-            timer.reset();
-        });
-    }
-    else
+    LogV( "got cube: \n\t" << cube->addr
+          << "\n\tsn: " << cube->serial
+          << "\n\tfw: " << cube->fwbc
+          << "\n\taddr: " << std::hex << cube->rfaddr << std::dec)
+    if (_p->linked)
+        return;
+    _p->found = cube;
+    _p->found_signal.cancel();
+}
+
+void cube_io::close_session()
+{
+    _p->stopping = true;
+    bs::error_code ec;
+    if (_p->cube)
     {
-        LogV("connected")
-        _p->cube = cube;
-        start_rx_from_cube(_p->cube);
+        capture(capture_dir::tx, "q:");
+        ba::write(_p->cube->sock, ba::buffer("q:\r\n", 4), ec);
     }
+    // the pending reads, connects and waits of the session complete with operation_aborted
+    if (_p->known)
+        _p->known->sock.close(ec);
+    _p->socket.close(ec);
+    _p->found_signal.cancel();
+    _p->phase_timer.cancel();
+    _p->settle_timer.cancel();
+    _p->command_timer.cancel();
+    _p->state_timer.cancel();
+    if (_p->state_dirty)
+        save_state();
+    if (!_p->tasks)
+        _p->stopped.set_value();
 }
 
-void cube_io::handle_mcast_response(const bs::error_code &error, size_t bytes_recvd)
+std::future<void> cube_io::stop_session()
 {
-    LogV(__FUNCTION__ << "(" << error << ',' << std::dec << bytes_recvd << ")")
-    if (!error)
+    std::future<void> ended = _p->stopped.get_future();
+    ba::post(_p->strand, [this](){ close_session(); });
+    return ended;
+}
+
+void cube_io::link_lost()
+{
+    _p->linked = false;
+    enter_phase(session_phase::reconnect);
+    _p->refresh_pending = false;        // the next connection starts with a full L-Msg
+    _p->commands.lost();
+    _p->command_timer.cancel();
+}
+
+std::shared_ptr<const room_index> make_room_index(const device_data_store &dds)
+{
+    auto index = std::make_shared<room_index>();
+    index->generation = dds.room_generation;
+    for (const room_conf &rc: dds.roomconf)
     {
-        LogV(__FUNCTION__ << " received " << std::string(
-                         reinterpret_cast<const char *>(_p->recvline), bytes_recvd))
-        if (bytes_recvd == 26)
-        {
-            std::string data((const char *)_p->recvline, bytes_recvd);
-            if (data.substr(0,8) == "eQ3MaxAp") // response from hub
-            {
-                cube_sp cube = std::make_shared<cube_t>(_p->io, std::move(data), _p->mcast_endpoint);
-                LogV( "got cube: \n\t" << cube->addr
-                      << "\n\tsn: " << cube->serial
-                      << "\n\tfw: " << cube->fwbc
-                      << "\n\taddr: " << std::hex << cube->rfaddr << std::dec)
-
-                bool connect = !_p->cube;
-                if (connect)
-                {
-                    ba::ip::tcp::endpoint ep(cube->addr, 62910);
-                    boost::system::error_code ec;
-                    LogV("connect to " << ep)
-
-                    cube->sock.async_connect(ep, boost::bind(&cube_io::process_connect, this, cube, ba::placeholders::error));
-                    /*
-                    cube->sock.connect(ep, ec);
-                    if (!ec)
-                        _p->cube = cube;
-                    else
-                        LogV("connecting failed to " << ep)
-                    */
-                }
-                // start_rx_from_cube(cube);
-            }
-        }
-        else if (bytes_recvd == 19)
-        {
-            LogV("rcvd bcast himself");
-        }
+        if (rc.id)
+            index->ids.emplace_back(rc.name, rc.id);
     }
-    // restart broadcast receive
-    _p->socket.async_receive_from(ba::buffer(_p->recvline, sizeof(_p->recvline)), _p->mcast_endpoint,
-                                              boost::bind(&cube_io::handle_mcast_response, this,
-                                              boost::asio::placeholders::error,
-                                              boost::asio::placeholders::bytes_transferred));
+    std::sort(index->ids.begin(), index->ids.end());
+    return index;
 }
 
-void cube_io::evaluate_data(cube_sp csp, std::string &&data)
+void cube_io::evaluate_data(cube_sp csp, std::string_view data)
 {
     if (data.size())
     {
@@ -335,30 +924,37 @@ void cube_io::evaluate_data(cube_sp csp, std::string &&data)
             {
                LogV("S-msg: " << dump(data))
                std::vector<std::string> inp;
-               data.erase(0,2);
-               boost::split(inp, data, boost::is_any_of(","), boost::token_compress_on);
+               boost::split(inp, data.substr(2), boost::is_any_of(","), boost::token_compress_on);
                if (inp.size() != 3)
                    LogE("wrong S message recived ")
                else
                {
-                   try {
-                       unsigned dutycycle = boost::lexical_cast<unsigned>(inp[0]);
-                       bool rspvalid = boost::lexical_cast<unsigned>(inp[1]);
-                       unsigned freeslots = boost::lexical_cast<unsigned>(inp[2]);
-                       LogV("dutycycle: " << dutycycle << "% cmd: " << (rspvalid ? "failed" : "ok") << " freeslots: " << freeslots)
-                   } catch (boost::bad_lexical_cast &) {
-
-                   }
+                   // S:<duty cycle hex>,<failed>,<free slots hex>
+                   unsigned dutycycle = std::strtoul(inp[0].c_str(), nullptr, 16);
+                   bool failed = std::strtoul(inp[1].c_str(), nullptr, 10) != 0;
+                   unsigned freeslots = std::strtoul(inp[2].c_str(), nullptr, 16);
+                   LogV("dutycycle: " << dutycycle << "% cmd: " << (failed ? "failed" : "ok") << " freeslots: " << freeslots)
+                   std::optional<command_queue::command> accepted;
+                   if (!_p->commands.reply(dutycycle, failed, freeslots, std::chrono::steady_clock::now(), &accepted))
+                       LogI("command refused by the cube (duty cycle " << dutycycle << "%, "
+                            << freeslots << " free slots), queued again")
+                   else if (accepted)
+                       await_confirmation(std::move(*accepted),
+                                          command_result{command_status::accepted, dutycycle, freeslots});
+                   csp->duty_cycle = uint16_t(dutycycle);
+                   csp->freememslots = uint16_t(freeslots);
+                   pump_commands();
+                   // the new values are read once the burst is done, not per command
+                   if (!failed)
+                       plan_refresh();
                }
-               _p->short_refresh = true;
             }
             break;
         case 'H':
             {
                 LogV("H-msg: " << dump(data))
-                data.erase(0, 2);
                 std::vector<std::string> comma_separated;
-                boost::split(comma_separated, data, boost::is_any_of(","), boost::token_compress_off);
+                boost::split(comma_separated, data.substr(2), boost::is_any_of(","), boost::token_compress_off);
                 csp->serial = comma_separated[0]; // data.substr(0,10);
                 uint32_t newrfaddr = rfaddr_from_string(comma_separated[1]);
                 {
@@ -366,8 +962,12 @@ void cube_io::evaluate_data(cube_sp csp, std::string &&data)
                     // csp->duty_cycle = boost::lexical_cast<uint16_from_hex>(comma_separated[5]);
                     iss >> std::hex >> csp->duty_cycle;
                 }
+                if (comma_separated.size() > 6)
+                    csp->freememslots = uint16_t(std::strtoul(comma_separated[6].c_str(), nullptr, 16));
 
-                if (newrfaddr != csp->rfaddr)
+                if (!csp->rfaddr)
+                    csp->rfaddr = newrfaddr;
+                else if (newrfaddr != csp->rfaddr)
                     LogE("rfaddr mismatch " << std::hex << newrfaddr << " != "
                               << csp->rfaddr << std::dec
                               << " from " << dump(data))
@@ -378,37 +978,87 @@ void cube_io::evaluate_data(cube_sp csp, std::string &&data)
                       << " date: " << comma_separated[7]
                       << " time: "  << comma_separated[8]
                      )
+                _p->commands.status(csp->duty_cycle, csp->freememslots, std::chrono::steady_clock::now());
+                pump_commands();
             }
             break;
         case 'M':
             {
-                std::list<m_device> devices;
-                std::list<m_room> rooms;
-                m_response(std::move(data), rooms, devices);
+                // M:<index>,<count>,<data chunk>
+                std::string_view payload = data.substr(2);
+                unsigned idx = 0, cnt = 0;
+                if (!parse_m_header(payload, idx, cnt))
+                {
+                    LogE("invalid M-Msg header " << data.substr(0, 10))
+                    break;
+                }
+                if (!_p->m_assembler.add(idx, cnt, payload))
+                {
+                    LogV("M-Msg part " << idx << " of " << cnt << " received")
+                    break;
+                }
+                _p->m_assembler.joined(_p->m_encoded);
+                decode64(_p->m_encoded, _p->m_decoded);
+                _p->m_assembler.reset();
+                if (!_p->state_path.empty())
+                {
+                    // the C-Msgs following the M-Msg replace the kept ones
+                    _p->state_m_line = "M:00,01,";
+                    _p->state_m_line += _p->m_encoded;
+                    _p->state_c_lines.clear();
+                    _p->state_dirty = true;
+                }
+
+                std::vector<m_device> &devices = _p->m_devices;
+                std::vector<m_room> &rooms = _p->m_rooms;
+                if (!m_response(_p->m_decoded, rooms, devices))
+                    LogE("M-Msg incomplete, " << rooms.size() << " rooms " << devices.size() << " devices read")
                 LogV("devs " << devices.size()
                           << " rooms " << rooms.size())
-                for (const m_room &r: rooms)
+
+                // the M-Msg holds the complete configuration, forget rooms
+                // and assignments of an earlier one (or of a warm start)
+                for (room_conf &rc: _p->devconfigs.roomconf)
+                {
+                    rc.id = 0;
+                    rc.wallthermostat = 0;
+                    rc.thermostats.clear();
+                }
+                for (std::size_t slot = 0; slot < _p->devconfigs.dev_room.size(); ++slot)
+                    _p->devconfigs.set_room(slot, 0);
+
+                for (m_room &r: rooms)
                 {
                     LogV("room id: " << uint16_t(r.id)
                          << " grp_rfaddr: " << std::hex << r.group_rfaddr << std::dec
                          << " n:" << r.name)
 
-                    room_conf &rc = _p->devconfigs.roomconf[r.id];
-                    rc.cube_rfaddr = csp->rfaddr;
-                    rc.name = r.name;
+                    room_conf &rc = _p->devconfigs.add_room(r.id);
+                    rc.cube_rfaddr = csp ? csp->rfaddr : 0;
+                    rc.name = std::move(r.name);
                     rc.rfaddr = r.group_rfaddr;
-                    rc.id = r.id;
-
-                    room_data &rd = _p->devconfigs.rooms[r.id];
                 }
-                for (const m_device &d: devices)
+                _p->devconfigs.index_rooms();
+                _p->changeset.resize(_p->devconfigs.roomconf.size());
+                for (auto it = _p->emit_rooms.begin(); it != _p->emit_rooms.end(); )
+                {
+                    if (_p->devconfigs.has_room(it->first))
+                        ++it;
+                    else
+                        it = _p->emit_rooms.erase(it);
+                }
+                if (!_p->room_ids || (_p->room_ids->generation != _p->devconfigs.room_generation))
+                {
+                    _p->room_ids = make_room_index(_p->devconfigs);
+                    publish_rooms();
+                }
+                for (m_device &d: devices)
                 {
-                    _p->device_defs[d.rfaddr] = d;
                     LogV("dev: " << std::hex << d.rfaddr << std::dec
                          << " n:" << d.name << " t:" << uint16_t(d.type) << " sn:" << d.serial
                          << " rid:" << uint16_t(d.room_id))
 
-                    if (_p->devconfigs.roomconf.find(d.room_id) == _p->devconfigs.roomconf.end())
+                    if (_p->devconfigs.has_room(d.room_id))
                     {
                         room_conf &rc = _p->devconfigs.roomconf[d.room_id];
                         switch (d.type)
@@ -417,15 +1067,17 @@ void cube_io::evaluate_data(cube_sp csp, std::string &&data)
                                 rc.wallthermostat = d.rfaddr;
                                 break;
                             case devicetype::RadiatorThermostat:
+                            case devicetype::RadiatorThermostatPlus:
                                 rc.thermostats.insert(d.rfaddr);
                                 break;
                         }
                     }
-                    dev_config &dc = _p->devconfigs.devconf[d.rfaddr];
-                    dc.serial = d.serial;
+                    std::size_t slot = _p->devconfigs.insert(d.rfaddr);
+                    dev_config &dc = _p->devconfigs.devconf[slot];
+                    dc.serial = std::move(d.serial);
                     dc.devtype = d.type;
-                    dc.room_id = d.room_id;
-                    dc.name = d.name;
+                    dc.name = std::move(d.name);
+                    _p->devconfigs.set_room(slot, d.room_id);
                     std::cout << "dev name " << dc.name << std::endl;
                 }
             }
@@ -433,33 +1085,53 @@ void cube_io::evaluate_data(cube_sp csp, std::string &&data)
         case 'L':
             {
                 LogI("process L-Msg");
-                std::string decoded = decode64(data.substr(2, data.size() - 3));
+                if (!_p->state_path.empty() && (_p->state_l_line != data))
+                {
+                    _p->state_l_line.assign(data.data(), data.size());
+                    _p->state_dirty = true;
+                }
+                decode64(data.substr(2, data.size() - 3), _p->l_decoded);
 
                 std::map<std::string, std::string> info;
-                while (decoded.size())
+                l_msg_reader reader(_p->l_decoded);
+                l_submsg_data adata;
+                l_msg_reader::result res;
+                while ((res = reader.next(adata)) != l_msg_reader::result::end)
                 {
-                    unsigned submsglen = decoded[0];
-
-                    l_submsg_data adata;
-                    if (l_response(decoded.substr(0, submsglen + 1), adata))
+                    if (res == l_msg_reader::result::record)
                     {
-                        _p->device_data[adata.rfaddr] = adata;
-                        std::ostringstream devinfo;
-                        devinfo << std::setw(25) << _p->devconfigs.dev_name_from_rfaddr(adata.rfaddr)
-                                << ":  " << l_submsg_as_string(adata);
-                        info[_p->devconfigs.room_from_rfaddr(adata.rfaddr)] += std::string('\n' + devinfo.str()); // l_submsg_as_string(adata));
+                        if (detail::info_log_enabled())
+                        {
+                            std::ostringstream devinfo;
+                            devinfo << std::setw(25) << _p->devconfigs.dev_name_from_rfaddr(adata.rfaddr)
+                                    << ":  " << l_submsg_as_string(adata);
+                            info[_p->devconfigs.room_from_rfaddr(adata.rfaddr)] += std::string('\n' + devinfo.str()); // l_submsg_as_string(adata));
+                        }
                         deploydata(adata);
                     }
+                    else if (res == l_msg_reader::result::truncated)
+                        LogE("L-Msg truncated, dropped " << reader.dropped() << " bytes")
                     else
                         LogE("l_resp failed")
-
-                    decoded.erase(0, submsglen + 1);
                 }
                 LogI("ldevs size " << info.size())
                 for (const auto &n: info)
                     LogI("devices: " << n.first << n.second)
 
+                if ((_p->timing.phase == session_phase::handshake) && (csp == _p->cube))
+                    enter_phase(session_phase::steady);
                 emit_changed_data();
+                check_confirmations();
+
+                // equal dumps let the poll interval grow
+                std::size_t l_hash = std::hash<std::string_view>()(data);
+                _p->refresh.observed(l_hash != _p->l_hash);
+                _p->l_hash = l_hash;
+                if (csp && (csp == _p->cube))       // not on warm start or replay
+                {
+                    csp->refresh_interval = poll_interval();
+                    arm_refresh(csp);
+                }
             }
             break;
         case 'F':
@@ -472,86 +1144,33 @@ void cube_io::evaluate_data(cube_sp csp, std::string &&data)
             {
                 std::string::size_type spos = data.find(',');
                 if ((spos != std::string::npos)
-                        || (data[1] != ':'))
+                        && (data[1] == ':'))
                 {
-                    std::string addr = data.substr(2, spos - 2);
-                    std::string decoded = decode64(data.substr(spos + 1));
-
-                    dev_config devconf;
-
-                    const char *pData = decoded.c_str();
-
-                    uint8_t len = fromPtr<uint8_t>(pData++);   // len
-                    devconf.rfaddr = fromPtr<rfaddr_t>(pData, 3);
-
-                    if (_p->devconfigs.devconf.find(devconf.rfaddr) != _p->devconfigs.devconf.end())
+                    std::string &decoded = _p->c_decoded;
+                    decode64(data.substr(spos + 1), decoded);
+                    if (decoded.size() < proto::c_header::size)
                     {
-                        devconf = _p->devconfigs.devconf[devconf.rfaddr];
+                        LogE("C-Msg too short: " << decoded.size())
+                        break;
                     }
 
-                    pData += 3;
-                    devconf.devtype = devicetype(fromPtr<uint8_t>(pData++));
-                    devconf.room_id = fromPtr<uint8_t>(pData++);
-                    devconf.fwversion = fromPtr<uint8_t>(pData++);
-                    uint8_t tres = fromPtr<uint8_t>(pData++);
-                    devconf.serial = std::string(pData, pData + 10);
-                    pData += 10;
-
-                    LogV("C-msg len " << uint16_t(len)
-                              << " rfaddr " << std::hex << devconf.rfaddr << std::dec
-                              << " dev " << uint16_t(devconf.devtype)
-                              << " room " << uint16_t(devconf.room_id)
-                              << " fwv " << uint16_t(devconf.fwversion)
-                              << " serial " << devconf.serial)
-
-                    switch (devconf.devtype)
+                    const uint8_t *pData = reinterpret_cast<const uint8_t *>(decoded.data());
+                    std::size_t slot = _p->devconfigs.insert(proto::c_header::rfaddr::get(pData));
+                    dev_config &dc = _p->devconfigs.devconf[slot];
+                    c_response(pData, decoded.size(), dc);
+                    _p->devconfigs.set_room(slot, dc.room_id);
+                    if (!_p->state_path.empty())
                     {
-                        case devicetype::Cube:
-                            break;
-                        case devicetype::RadiatorThermostat:
-                        case devicetype::RadiatorThermostatPlus:
-                            {
-                                radiatorThermostat_config rthc;
-                                rthc.comfort = fromPtr<uint8_t>(pData++) / 2.0;
-                                rthc.eco = fromPtr<uint8_t>(pData++) / 2.0;
-                                rthc.max = fromPtr<uint8_t>(pData++) / 2.0;;
-                                rthc.min = fromPtr<uint8_t>(pData++) / 2.0;
-                                rthc.tofs = fromPtr<uint8_t>(pData++) / 2.0 + 3.5;
-                                pData += 6;
-                                // points to week programs
-                                rthc.schedule = get_schedule(reinterpret_cast<const uint8_t*>(pData));
-                                LogV("radiatorThermostat "
-                                          << " comfort " << rthc.comfort
-                                          << " eco " << rthc.eco
-                                          << " min " << rthc.min
-                                          << " max " << rthc.max
-                                          << " tofs " << rthc.tofs
-                                          << " sched\n" << rthc.schedule)
-                                devconf.specific = rthc;
-
-                            }
-                            break;
-                        case devicetype::WallThermostat:
-                            {
-                                wallThermostat_config wthc;
-                                wthc.comfort = fromPtr<uint8_t>(pData++) / 2.0;
-                                wthc.eco = fromPtr<uint8_t>(pData++) / 2.0;
-                                wthc.max = fromPtr<uint8_t>(pData++) / 2.0;
-                                wthc.min = fromPtr<uint8_t>(pData++) / 2.0;
-                                pData += (0x1d - 0x15);
-                                wthc.schedule = get_schedule(reinterpret_cast<const uint8_t*>(pData));
-                                LogV("wallThermostat "
-                                          << " comfort " << wthc.comfort
-                                          << " eco " << wthc.eco
-                                          << " min " << wthc.min
-                                          << " max " << wthc.max
-                                          << " sched\n" << wthc.schedule
-                                     )
-                                devconf.specific = wthc;
-                            }
-                            break;
+                        if (slot >= _p->state_c_lines.size())
+                            _p->state_c_lines.resize(slot + 1);
+                        _p->state_c_lines[slot].assign(data.data(), data.size());
+                        _p->state_dirty = true;
                     }
-                    _p->devconfigs.devconf[devconf.rfaddr] = devconf;
+
+                    // rooms keep sharing the schedule until it really changes
+                    const week_schedule *ws = specific_schedule(dc.specific);
+                    if (ws && (!dc.schedule || (*dc.schedule != *ws)))
+                        dc.schedule = intern_schedule(_p->schedules, *ws);
                 }
                 else
                     LogE("invalid C-Message")
@@ -565,46 +1184,35 @@ void cube_io::evaluate_data(cube_sp csp, std::string &&data)
 
 struct cube_io::rfaddr_related
 {
-    dev_config *p_dev_config;
-    room_conf  *p_room_conf;
-    room_data  *p_room_data;
-    rfaddr_related()
-        : p_dev_config(nullptr)
-        , p_room_conf(nullptr)
-        , p_room_data(nullptr)
-    {}
+    std::size_t slot{device_data_store::npos};
+    room_conf  *p_room_conf{nullptr};
+    room_data  *p_room_data{nullptr};
 };
 
+// one index lookup, the room is linked by the id stored in the device slot
 cube_io::rfaddr_related cube_io::search(rfaddr_t addr)
 {
-    using devicemap = device_data_store::devicemap;
-    using roomconfmap = device_data_store::roomconfmap;
-    using roomdatamap = device_data_store::roomdatamap;
-
-    devicemap::iterator
-            it = _p->devconfigs.devconf.find(addr);
-
-    if (it != _p->devconfigs.devconf.end())
+    device_data_store &dds = _p->devconfigs;
+    rfaddr_related rrd;
+    rrd.slot = dds.find(addr);
+    if (rrd.slot != device_data_store::npos)
     {
-        rfaddr_related rrd;
-        rrd.p_dev_config = &(it->second);
-
-        dev_config &dc = _p->devconfigs.devconf[addr];
-        roomconfmap::iterator rcm_it = _p->devconfigs.roomconf.find(dc.room_id);
-        if (rcm_it != _p->devconfigs.roomconf.end())
-            rrd.p_room_conf = &(rcm_it->second);
-        roomdatamap::iterator rdm_it = _p->devconfigs.rooms.find(dc.room_id);
-        if (rdm_it != _p->devconfigs.rooms.end())
-            rrd.p_room_data = &(rdm_it->second);
-        return rrd;
+        unsigned room_id = dds.dev_room[rrd.slot];
+        if (dds.has_room(room_id))
+        {
+            rrd.p_room_conf = &dds.roomconf[room_id];
+            rrd.p_room_data = &dds.rooms[room_id];
+        }
     }
-
-    return rfaddr_related();
+    return rrd;
 }
 
-room_sp gen_rsp(const room_conf &rc, const room_data &rd, const changeflag_set &cfs, unsigned last_version)
+room_sp gen_rsp(const pool_allocator<room> &alloc, const std::string &cube,
+                const room_conf &rc, const room_data &rd, changeflag_set cfs, unsigned last_version,
+                const timestamped_valve_pos &valve_pos, const schedule_sp &schedule)
 {
-    room_sp rsp = std::make_shared<room>();
+    std::shared_ptr<room> rsp = std::allocate_shared<room>(alloc);
+    rsp->cube = cube;
     rsp->name = rc.name;
     rsp->changed = cfs;
     rsp->set_temp = rd.set;
@@ -612,18 +1220,20 @@ room_sp gen_rsp(const room_conf &rc, const room_data &rd, const changeflag_set &
     // rsp->act_changed_time = rd.acttime;
     rsp->version = last_version+1;
     rsp->mode = rd.mode;
+    rsp->valve_pos = valve_pos;
+    rsp->valve_min = rd.valve_min;
+    rsp->valve_max = rd.valve_max;
+    rsp->schedule = schedule;
     return rsp;
 }
 
 void cube_io::deploydata(const l_submsg_data &smd)
 {
     rfaddr_related rfa = search(smd.rfaddr);
-    if (rfa.p_dev_config && rfa.p_room_conf)
+    if (rfa.slot != device_data_store::npos)
+        _p->devconfigs.dev_data[rfa.slot] = smd;
+    if (rfa.p_room_conf)
     {
-        if (!rfa.p_room_data)
-        {
-            rfa.p_room_data = &(_p->devconfigs.rooms[rfa.p_dev_config->room_id]);
-        }
         room_data &rd = *rfa.p_room_data;
         room_conf &rf = *rfa.p_room_conf;
 
@@ -652,8 +1262,9 @@ void cube_io::deploydata(const l_submsg_data &smd)
         default: ;
         }
 
-        if (rcfs.size())    // we have changes
-            _p->changeset[rf.id].insert(rcfs.begin(), rcfs.end());
+        if (!rcfs.empty())  // we have changes
+            _p->changeset[rf.id].insert(rcfs);
+        record_history(rfa.slot, &rf, smd, rcfs);
     }
     else
     {
@@ -661,6 +1272,33 @@ void cube_io::deploydata(const l_submsg_data &smd)
     }
 }
 
+void cube_io::record_history(std::size_t slot, const room_conf *rc, const l_submsg_data &smd, changeflag_set rcfs)
+{
+    auto now = std::chrono::system_clock::now();
+    if (slot != device_data_store::npos)
+    {
+        history_set &dh = _p->devconfigs.dev_history[slot];
+        if (smd.act_temp != 0.0)
+            dh[std::size_t(history_series::act_temp)].add(now, smd.act_temp);
+        dh[std::size_t(history_series::set_temp)].add(now, smd.set_temp);
+        dh[std::size_t(history_series::mode)].add(now, smd.flags & 0x3);
+        if (smd.submsg_src != devicetype::WallThermostat)
+            dh[std::size_t(history_series::valve_pos)].add(now, smd.valve_pos);
+    }
+    if (rc)
+    {
+        // the room valve position is recorded with its average in emit_changed_data
+        const room_data &rd = _p->devconfigs.rooms[rc->id];
+        history_set &rh = _p->devconfigs.room_history[rc->id];
+        if (rcfs.count(changeflags::act_temp))
+            rh[std::size_t(history_series::act_temp)].add(rd.act.second, rd.act.first);
+        if (rcfs.count(changeflags::set_temp))
+            rh[std::size_t(history_series::set_temp)].add(rd.set.second, rd.set.first);
+        if (rcfs.count(changeflags::mode))
+            rh[std::size_t(history_series::mode)].add(now, int(rd.mode));
+    }
+}
+
 void cube_io::emit_changed_data()
 {
     if (_p->iet)
@@ -678,143 +1316,225 @@ void cube_io::emit_changed_data()
                 _p->iet->device_info(newdev);
             }
         }
-        for (const auto val: _p->changeset)
+        bool emitted = false;
+        for (unsigned roomid = 0; roomid < _p->changeset.size(); ++roomid)
         {
-            unsigned roomid = val.first;
-
-            device_data_store::roomdatamap::const_iterator
-                    rdmcit = _p->devconfigs.rooms.find(roomid);
-
-            device_data_store::roomconfmap::const_iterator
-                    rcfcit = _p->devconfigs.roomconf.find(roomid);
+            changeflag_set &changed = _p->changeset[roomid];
+            if (changed.empty())
+                continue;
 
-            if ((rdmcit != _p->devconfigs.rooms.end())
-                    && (rcfcit != _p->devconfigs.roomconf.end()))
+            if (_p->devconfigs.has_room(roomid))
             {
+                const room_data &rdata = _p->devconfigs.rooms[roomid];
+                const room_conf &rconf = _p->devconfigs.roomconf[roomid];
 
-                rfaddr_t for_schedule = 0;
-
-                // calc valve pos for room
-                timestamped_valve_pos valvepossum;
-                for (const auto x: rdmcit->second.valve_pos)
-                {
-                    timestamped_valve_pos cur = x.second;
-                    valvepossum.first += cur.first;
-                    if (valvepossum.second < cur.second)
-                        valvepossum.second = cur.second;
-                    if (for_schedule == 0)
-                        for_schedule = x.first;
-                }
-                valvepossum.first /= rdmcit->second.valve_pos.size();
-
-                unsigned vers = 0;
-                if (_p->emit_rooms.find(roomid) != _p->emit_rooms.end())
-                    vers = _p->emit_rooms[roomid]->version;
-
-                room_sp newsp = gen_rsp(rcfcit->second, rdmcit->second, val.second, vers);
-
-                newsp->valve_pos = valvepossum;
-
-                // from room id -> schedule
-                rfaddr_t devrfaddr = rcfcit->second.wallthermostat;
+                timestamped_valve_pos valvepossum = rdata.valve_avg();
 
-                if (!devrfaddr)
-                    devrfaddr = *rcfcit->second.thermostats.begin();
+                room_sp &emitted_room = _p->emit_rooms[roomid];
+                unsigned vers = emitted_room ? emitted_room->version : 0;
 
-                if (for_schedule)
+                // the schedule of the first radiator thermostat
+                schedule_sp schedule;
+                if (!rdata.valve_pos.empty())
                 {
-                    auto cit = _p->devconfigs.devconf.find(for_schedule);
-                    if (cit != _p->devconfigs.devconf.end())
+                    std::size_t slot = _p->devconfigs.find(rdata.valve_pos.begin()->first);
+                    if (slot != device_data_store::npos)
                     {
-                        dev_config dc = _p->devconfigs.devconf.find(for_schedule)->second;
+                        const dev_config &dc = _p->devconfigs.devconf[slot];
                         if (std::holds_alternative<radiatorThermostat_config>(dc.specific))
-                        {
-                            const radiatorThermostat_config *pConf = std::get_if<radiatorThermostat_config>(&dc.specific);
-                            if (pConf)
-                            {
-                                newsp->schedule = pConf->schedule;
-                            }
-                            else
-                                std::cout << "schedule missing for room: " << rcfcit->second.name << std::endl;
-                        }
+                            schedule = dc.schedule;
                     }
                 }
 
-                _p->emit_rooms[roomid] = newsp;
+                room_sp newsp = gen_rsp(pool_allocator<room>(_p->room_pool),
+                                        _p->cube ? _p->cube->serial : _p->serial,
+                                        rconf, rdata, changed, vers, valvepossum, schedule);
+
+                if (changed.count(changeflags::valve_pos))
+                    _p->devconfigs.room_history[roomid][std::size_t(history_series::valve_pos)]
+                            .add(valvepossum.second, valvepossum.first);
+
+                emitted_room = newsp;
+                emitted = true;
 
                 _p->iet->room_changed(newsp);
             }
-
+            changed.clear();
         }
-        _p->changeset.clear();
+        if (emitted)
+            publish_rooms();
     }
+    if (_p->state_dirty)
+        plan_state_save();
 }
 
-template<typename T>
-void append(std::ostream &os, T t, std::size_t sz)
+void cube_io::plan_state_save()
 {
-    const char *pstart = reinterpret_cast<const char *>(&t);
-    pstart = pstart + sizeof(T);
-    int diff = sizeof(T) - sz;
-    if (diff >= 0)
-    {
-        pstart = pstart - diff;
-        for (unsigned u = 0; u < sz; ++u)
-        {
-            pstart--;
-            os.write(pstart, 1);
-        }
-    }
-    else
-        LogE("conversion problem within " << __PRETTY_FUNCTION__ << std::endl);
+    if (_p->state_restoring || _p->state_armed || _p->offline())
+        return;
+    _p->state_armed = true;
+    _p->state_timer.expires_after(_p->state_interval);
+    _p->state_timer.async_wait(ba::bind_executor(_p->strand, [this](const bs::error_code &ec){
+        if (ec)
+            return;                 // cancelled by close_session, cube_io may be gone
+        _p->state_armed = false;
+        if (_p->state_dirty)
+            save_state();
+    }));
+}
+
+void cube_io::publish_rooms()
+{
+    auto table = std::make_unique<room_table>();
+    table->version = _p->room_state.current().version + 1;
+    table->rooms.reserve(_p->emit_rooms.size());
+    for (const auto &r: _p->emit_rooms)
+        table->rooms.push_back(r.second);
+    std::sort(table->rooms.begin(), table->rooms.end(),
+              [](const room_sp &a, const room_sp &b) { return a->name < b->name; });
+    table->index = _p->room_ids;
+    _p->room_state.publish(std::move(table));
+}
 
+room_table_view cube_io::rooms() const
+{
+    return _p->room_state.read();
+}
+
+room_sp room_table::find(std::string_view name) const
+{
+    auto it = std::lower_bound(rooms.begin(), rooms.end(), name,
+                               [](const room_sp &r, std::string_view n) { return r->name < n; });
+    if ((it != rooms.end()) && ((*it)->name == name))
+        return *it;
+    return room_sp();
 }
 
-const room_conf *roomconf_by_name(const device_data_store &dds, const std::string &n)
+room_handle room_table::handle(std::string_view name) const
 {
-    for (const auto &v: dds.roomconf)
+    room_handle h;
+    if (!index)
+        return h;
+    auto it = std::lower_bound(index->ids.begin(), index->ids.end(), name,
+                               [](const std::pair<std::string, unsigned> &r, std::string_view n) { return r.first < n; });
+    if ((it != index->ids.end()) && (it->first == name))
     {
-        if (n == v.second.name)
-            return &v.second;
+        h.id = it->second;
+        h.generation = index->generation;
     }
-    return nullptr;
+    return h;
 }
 
 const room_data *roomdata_by_id(const device_data_store &dds, unsigned id)
 {
-    device_data_store::roomdatamap::const_iterator cit = dds.rooms.find(id);
-    if (cit == dds.rooms.end())
+    if (!dds.has_room(id))
         return nullptr;
-    return &cit->second;
+    return &dds.rooms[id];
 }
 
 
-void cube_io::do_send_mode(std::string room, opmode mode)
+void cube_io::do_send_mode(const room_conf *roomconfig, opmode mode, command_priority prio, completion_sp done)
 {
-    LogV(__FUNCTION__ << " for room " << room << " to " << int(mode) << std::endl);
-
-    const room_conf * roomconfig = roomconf_by_name(_p->devconfigs, room);
     if (!roomconfig)
     {
-        LogE("no room found for name " << room << std::endl)
+        done->notify(command_result());
         return;
     }
-    const room_data * roomdata = roomdata_by_id(_p->devconfigs, roomconfig->id);
+    LogV(__FUNCTION__ << " for room " << roomconfig->name << " to " << int(mode) << std::endl);
+
+    stage_change(roomconfig->id, std::nullopt, mode, prio, std::move(done));
+}
+
+void cube_io::stage_change(unsigned roomid, std::optional<double> temp, std::optional<opmode> mode, command_priority prio,
+                           completion_sp done)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto it = _p->pending_changes.find(roomid);
+    if (it == _p->pending_changes.end())
+    {
+        it = _p->pending_changes.emplace(roomid, Private::pending_change()).first;
+        it->second.prio = prio;
+        it->second.first = now;
+    }
+    // latest wins, the most urgent priority of the merged changes
+    Private::pending_change &pc = it->second;
+    if (temp)
+        pc.temp = temp;
+    if (mode)
+        pc.mode = mode;
+    pc.prio = std::min(pc.prio, prio);
+    pc.done.push_back(std::move(done));
+
+    const command_config &cfg = _p->commands.config();
+    pc.due = std::min(now + cfg.settle, pc.first + cfg.max_settle);
+    if (cfg.settle.count() <= 0)
+    {
+        flush_changes();
+        return;
+    }
+
+    auto due = pc.due;
+    for (const auto &p: _p->pending_changes)
+        due = std::min(due, p.second.due);
+    _p->settle_timer.expires_at(due);
+    _p->settle_timer.async_wait(ba::bind_executor(_p->strand, [this](const bs::error_code &ec){
+        if (!ec)
+            flush_changes();
+    }));
+}
+
+void cube_io::flush_changes()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+    for (auto it = _p->pending_changes.begin(); it != _p->pending_changes.end(); )
+    {
+        if (it->second.due > now)
+        {
+            next = std::min(next, it->second.due);
+            ++it;
+            continue;
+        }
+        send_change(it->first, it->second.temp, it->second.mode, it->second.prio, std::move(it->second.done));
+        it = _p->pending_changes.erase(it);
+    }
+    if (next == std::chrono::steady_clock::time_point::max())
+        return;
+    _p->settle_timer.expires_at(next);
+    _p->settle_timer.async_wait(ba::bind_executor(_p->strand, [this](const bs::error_code &ec){
+        if (!ec)
+            flush_changes();
+    }));
+}
+
+void cube_io::send_change(unsigned roomid, std::optional<double> temp, std::optional<opmode> mode, command_priority prio,
+                          completions done)
+{
+    // the configuration may have changed while the change settled
+    const room_data *roomdata = roomdata_by_id(_p->devconfigs, roomid);
     if (!roomdata)
     {
-        LogE("no room found for id " << roomconfig->id << std::endl)
+        LogE("no room found for id " << roomid << std::endl)
+        notify_all(done, command_result());
         return;
     }
+    const room_conf &roomconfig = _p->devconfigs.roomconf[roomid];
 
-    uint8_t tmp = uint8_t(roomdata->set.first * 2);
+    // what is not changed is sent as it is
+    uint8_t tmp = uint8_t(temp.value_or(roomdata->set.first) * 2);
 
     if ((tmp & 0xC0) != 0)
     {
-        LogE("wrong mode : " << std::hex << tmp << std::endl)
+        LogE("temp to high : " << temp.value_or(roomdata->set.first) << std::endl)
+        notify_all(done, command_result());
         return;
     }
 
-    switch (mode)
+    // what the L-Msg has to show
+    double shown_temp = tmp / 2.0;
+    opmode shown_mode = mode.value_or(roomdata->mode);
+
+    switch (shown_mode)
     {
     case opmode::AUTO:
         break;
@@ -829,69 +1549,118 @@ void cube_io::do_send_mode(std::string room, opmode mode)
         break;
     }
 
-    emit_S_temp_mode(roomconfig->rfaddr, roomconfig->id, tmp);
+    // a mode change alone goes to the room's group address as it always did,
+    // a temp change (merged with a mode change or not) to a thermostat of the
+    // room if it has no group
+    rfaddr_t sendto = roomconfig.rfaddr;
+    if ((sendto == 0) && temp)
+    {
+        if (roomconfig.wallthermostat)
+            sendto = roomconfig.wallthermostat;
+        if (roomconfig.thermostats.size())
+        {
+            sendto = *roomconfig.thermostats.begin();
+        }
+    }
 
+    // in AUTO the L-Msg shows the temperature of the schedule, not the one sent
+    bool check_temp = (shown_mode != opmode::AUTO);
+    emit_S_temp_mode(sendto, uint8_t(roomid), tmp, prio, std::move(done),
+                     [this, roomid, shown_temp, shown_mode, check_temp]() {
+        const room_data *rd = roomdata_by_id(_p->devconfigs, roomid);
+        return rd && (rd->mode == shown_mode) && (!check_temp || (rd->set.first == shown_temp));
+    });
 }
 
-void cube_io::emit_S_temp_mode(rfaddr_t sendto, uint8_t roomid, uint8_t tmp_mode)
+void cube_io::emit_S_temp_mode(rfaddr_t sendto, uint8_t roomid, uint8_t tmp_mode, command_priority prio,
+                               completions done, std::function<bool()> shown)
 {
-    std::ostringstream xs;
-
-    append(xs, uint8_t(0), 1);              // Unknown
-    append(xs, uint8_t(4), 1);              // adress room
-    append(xs, uint8_t(0x40), 1);           // set Temperatur
-    append(xs, unsigned(0), 3);             // from rfaddr
-
     // if roomconfig->rfaddr is zero all room are affected
     // on room without rfaddr is set we should adress the radiator directly
+    auto frame = proto::s_temp_mode::encode(sendto, roomid, tmp_mode);
+    send_s_frame(frame.data(), frame.size(), prio, roomid, std::move(done), std::move(shown));
+}
 
-    append(xs, uint32_t(sendto), 3);            // to rfaddr
-    append(xs, uint8_t(roomid), 1);     // roomid
-    append(xs, tmp_mode, 1);                         // temp
-
-    std::string encoded = encode64(xs.str());
+void cube_io::send_s_frame(const uint8_t *frame, std::size_t len, command_priority prio, unsigned key,
+                           completions done, std::function<bool()> shown)
+{
+    // "s:" base64 "\r\n"
+    std::string cmd(2 + base64::encoded_size(len) + 2, '\0');
+    char *pCmd = &cmd[0];
+    pCmd[0] = 's';
+    pCmd[1] = ':';
+    std::size_t enclen = base64::encode(frame, len, pCmd + 2);
+    pCmd[2 + enclen] = '\r';
+    pCmd[3 + enclen] = '\n';
+    LogV("should send " << dump(cmd) << std::endl)
+
+    command_queue::command c;
+    c.line = std::move(cmd);
+    c.prio = prio;
+    c.key = key;
+    c.done = std::move(done);
+    c.shown = std::move(shown);
+    if (!_p->commands.push(std::move(c), std::chrono::steady_clock::now()))
+        LogE("command queue full, dropped the newest command of the lowest priority")
+    pump_commands();
+}
 
-#if 0
-    LogV("unencoded " << dump(xs.str()) << std::endl)
-    LogV("encoded " << encoded << std::endl)
-    LogV("redecoded " << dump(decode64(encoded)) << std::endl)
-#endif
-    std::string cmd2send = "s:" + encoded + "\r\n";
-    LogV("should send " << dump(cmd2send) << std::endl)
+void cube_io::pump_commands()
+{
+    // queued while not connected (or offline), sent after the H-Msg of the next connection
+    if (!_p->cube || !_p->cube->sock.is_open())
+        return;
 
-    if (!_p->cube) // (_p->cubes.find(cubeto) == _p->cubes.end())
+    auto now = std::chrono::steady_clock::now();
+    if (_p->commands.expired(now))
     {
-        LogE("unable to find associated cube\n")
-        return;
+        LogE("no S-Msg for the last command, sent again")
+        _p->commands.lost();
     }
 
+    auto retry = std::chrono::steady_clock::time_point::max();
+    while (auto cmd = _p->commands.admit(now, retry))
+        write_command(cmd->line);
+    if (retry == std::chrono::steady_clock::time_point::max())
+        return;
+    _p->command_timer.expires_at(retry);
+    _p->command_timer.async_wait(ba::bind_executor(_p->strand, [this](const bs::error_code &ec){
+        if (!ec)
+            pump_commands();
+    }));
+}
+
+void cube_io::write_command(const std::string &line)
+{
+    // the line has to live until the write completed
+    auto cmd2send = std::make_shared<std::string>(line);
     auto csp = _p->cube; // _p->cubes[cubeto];
+    capture(capture_dir::tx, *cmd2send);
 
     ba::async_write(csp->sock,
-                    ba::buffer(cmd2send),
-                    boost::bind(&cube_io::do_send_l_msg, this, _1, _2)
+                    ba::buffer(*cmd2send),
+                    ba::bind_executor(_p->strand, [cmd2send](const boost::system::error_code &e, std::size_t bytes_transferred)
+                    {
+                        if (e)
+                            LogE("command write failed " << e.message())
+                        else
+                            LogV("command written " << bytes_transferred)
+                    })
     );
 }
 
 namespace {
 }
 
-void cube_io::do_send_schedule(std::string room, days day, const day_schedule ds)
+void cube_io::do_send_schedule(const room_conf *roomconfig, days day, const day_schedule &ds, command_priority prio,
+                               completion_sp done)
 {
-    LogV(__FUNCTION__ << " for room " << room << " to " << ds << std::endl)
-
-    const room_conf * roomconfig = get_room_config(room, _p->devconfigs.roomconf);
-    if (roomconfig == nullptr)
-    {
-        LogE("no room found for name " << room << std::endl)
-        return;
-    }
-    if (_p->devconfigs.rooms.find(roomconfig->id) == _p->devconfigs.rooms.end())
+    if (!roomconfig)
     {
-        LogE("no roomdata found for name " << room << std::endl)
+        done->notify(command_result());
         return;
     }
-    room_data &roomdata = _p->devconfigs.rooms[roomconfig->id];
+    LogV(__FUNCTION__ << " for room " << roomconfig->name << " to " << ds << std::endl)
 
     rfaddr_t sendto = roomconfig->rfaddr;
     if (sendto == 0)
@@ -904,255 +1673,80 @@ void cube_io::do_send_schedule(std::string room, days day, const day_schedule ds
         }
     }
 
-    std::ostringstream xs;
-
-    append(xs, uint8_t(0), 1);              // Unknown
-    append(xs, uint8_t(4), 1);              // adress room
-    append(xs, uint8_t(0x10), 1);           // set Temperatur
-    append(xs, unsigned(0), 3);             // from rfaddr
-
-    append(xs, uint32_t(sendto), 3);            // to rfaddr
-    append(xs, uint8_t(roomconfig->id), 1);     // roomid
-    append(xs, uint8_t(day), 1);                // day
-
-    for (const auto n: ds)
-    {
-        uint16_t time = std::round(std::min(n.temp * 2, 128.0));
-        uint16_t date = n.minutes_since_midnight / 5;
-        uint16_t combined = (time << 9) + date;
-        append(xs, uint16_t(combined), 2);
-    }
+    auto frame = proto::s_day_program::encode(sendto, uint8_t(roomconfig->id), day, ds);
+    send_s_frame(frame.data(), frame.size(), prio, 0, completions{std::move(done)});
 
     // mark stored schedule data dirty
 
 }
 
-void cube_io::do_send_l_msg(const boost::system::error_code &e, std::size_t bytes_transferred)
+void cube_io::do_send_temp(const room_conf *roomconfig, double temp, command_priority prio, completion_sp done)
 {
-    if (e)
-        LogE("set temp failed " << e << std::endl)
-    else
-        LogV("set temp done " << bytes_transferred << std::endl)
-
-    // force a reread
-    LogV("send l")
-    ba::async_write(_p->cube->sock, ba::buffer("l:\r\n"), [](const boost::system::error_code &e, std::size_t bytes_transferred){});
-}
-
-void cube_io::do_send_temp(std::string room, double temp)
-{
-    const room_conf * roomconfig = nullptr;
-
-    for (const auto &v: _p->devconfigs.roomconf)
-    {
-        if (room == v.second.name)
-            roomconfig = &v.second;
-    }
-    if (roomconfig == nullptr)
-    {
-        LogE("no room found for name " << room << std::endl)
-        return;
-    }
-
-    if (_p->devconfigs.rooms.find(roomconfig->id) == _p->devconfigs.rooms.end())
+    if (!roomconfig)
     {
-        LogE("no roomdata found for name " << room << std::endl)
+        done->notify(command_result());
         return;
     }
-    room_data &roomdata = _p->devconfigs.rooms[roomconfig->id];
 
-    LogV(__FUNCTION__ << " for room " << room << ':' << roomconfig->id << " to " << temp)
+    LogV(__FUNCTION__ << " for room " << roomconfig->name << ':' << roomconfig->id << " to " << temp)
 
-    uint8_t tmp = uint8_t(temp * 2);
-
-    if ((tmp & 0xC0) != 0)
+    if ((uint8_t(temp * 2) & 0xC0) != 0)
     {
         LogE("temp to high : " << temp << std::endl)
+        done->notify(command_result());
         return;
     }
 
-    switch (roomdata.mode)
-    {
-    case opmode::AUTO:
-        break;
-    case opmode::MANUAL:
-        tmp |= 0x40;
-        break;
-    case opmode::VACATION:
-        tmp |= 0x80;
-        break;
-    case opmode::BOOST:
-        tmp |= 0xC0;
-        break;
-    }
-
-    rfaddr_t sendto = roomconfig->rfaddr;
-    if (sendto == 0)
-    {
-        if (roomconfig->wallthermostat)
-            sendto = roomconfig->wallthermostat;
-        if (roomconfig->thermostats.size())
-        {
-            sendto = *roomconfig->thermostats.begin();
-        }
-    }
-
-    std::ostringstream xs;
-
-    append(xs, uint8_t(0), 1);              // Unknown
-    append(xs, uint8_t(4), 1);              // adress room
-    append(xs, uint8_t(0x40), 1);           // set Temperatur
-    append(xs, unsigned(0), 3);             // from rfaddr
-
-    // if roomconfig->rfaddr is zero all room are affected
-    // on room without rfaddr is set we should adress the radiator directly
-
-    append(xs, uint32_t(sendto), 3);            // to rfaddr
-    append(xs, uint8_t(roomconfig->id), 1);     // roomid
-    append(xs, tmp, 1);                         // temp
-
-    std::string encoded = encode64(xs.str());
-
-#if 0
-    LogV("unencoded" << dump(xs.str()) << std::endl)
-    LogV("encoded" << encoded << std::endl)
-    LogV("redecoded" << dump(decode64(encoded)) << std::endl)
-#endif
-    std::string cmd2send = "s:" + encoded + "\r\n";
-    LogV("should send " << dump(cmd2send) << std::endl)
-
-    if (!_p->cube) // (_p->cubes.find(roomconfig->cube_rfaddr) == _p->cubes.end())
-    {
-        LogE("unable to find associated cube\n")
-        return;
-    }
-
-    auto csp = _p->cube; // _p->cubes[roomconfig->cube_rfaddr];
-    ba::async_write(csp->sock,
-                    ba::buffer(cmd2send),
-                    boost::bind(&cube_io::do_send_l_msg, this, _1, _2)     // force a reload
-    );
+    stage_change(roomconfig->id, temp, std::nullopt, prio, std::move(done));
 }
 
-} // ns max_eq3
-
-namespace  {
-
-using namespace max_eq3;
-
-bool isvalid(uint16_t flags)
+void cube_io::await_confirmation(command_queue::command &&cmd, const command_result &sent)
 {
-    return (flags & 0x1000) == 0x1000;
-}
-
-bool l_response(std::string &&decoded, max_eq3::l_submsg_data &adata)
-{    
-    unsigned len = *(reinterpret_cast<uint8_t *>(&decoded[0]));
-    adata.rfaddr = fromPtr<uint32_t>(&decoded[1], 3);
-    uint8_t unknown = fromPtr<uint8_t>(&decoded[4]);
-    adata.flags = fromPtr<uint16_t>(&decoded[5]);
-    // LogI("flags:" << flags_as_string(adata.flags));
-
-    if (len > 6)
+    // the values of an earlier command to the room won't show up anymore
+    if (cmd.key && cmd.shown)
     {
-        if (isvalid(adata.flags))
+        auto &pending = _p->confirming;
+        for (auto it = pending.begin(); it != pending.end(); )
         {
-            if (len >= 11)
+            if (it->key != cmd.key)
             {
-                adata.valve_pos = fromPtr<uint8_t>(&decoded[7+0]);
-                adata.set_temp = (fromPtr<uint8_t>(&decoded[7+1]) & 0x7f) / 2.0;
-                adata.minutes_since_midnight = fromPtr<uint8_t>(&decoded[7+4])*30;
-                uint16_t act_temp = 0;
-                if (len == 11) // thermostat or thermostat+
-                {
-                    adata.submsg_src = devicetype::RadiatorThermostat;
-                    act_temp = (fromPtr<uint16_t>(&decoded[7+2]) & 0x1ff);
-                }
-                else if (len == 12) // wallthermostat
-                {
-                    adata.submsg_src = devicetype::WallThermostat;
-                    act_temp = (uint16_t(decoded[7+1] & 0x80) << 1) + fromPtr<uint8_t>(&decoded[7+5]);
-                    adata.dateuntil = fromPtr<uint16_t>(&decoded[7+2]);
-                }
-                else
-                {
-                    LogE("L-Msg: unprocessed data of length " << len)
-                }
-                adata.act_temp = act_temp / 10.0;
-                return true;
+                ++it;
+                continue;
             }
-        }
-        else
-        {
-            LogE("Invalid Data reported for device " << std::hex << adata.rfaddr << std::dec)
+            command_result r = it->sent;
+            r.status = command_status::superseded;
+            notify_all(it->done, r);
+            it = pending.erase(it);
         }
     }
-    else {
-        LogE("L-Msg: unprocessed data of length " << len)
+    if (cmd.done.empty())
+        return;
+    if (!cmd.shown)
+    {
+        notify_all(cmd.done, command_result{command_status::confirmed, sent.duty_cycle, sent.free_slots});
+        return;
     }
-    return false;
+    _p->confirming.push_back(Private::confirmation{std::move(cmd.done), std::move(cmd.shown), sent, 0, cmd.key});
 }
 
-week_schedule get_schedule(const uint8_t *pD)
+void cube_io::check_confirmations()
 {
-    week_schedule ws;
-    for (unsigned u = 0; u < DAYS_A_WEEK; ++u)
+    auto &pending = _p->confirming;
+    for (auto it = pending.begin(); it != pending.end(); )
     {
-        for (unsigned x = 0; x < SCHED_POINTS; ++x)
+        command_result r = it->sent;
+        if (it->shown())
+            r.status = command_status::confirmed;
+        else if (++it->polls >= _p->commands.config().confirm_polls)
+            r.status = command_status::unconfirmed;
+        else
         {
-            const uint8_t &lsb = pD[0];
-            const uint8_t &msb = pD[1];
-
-            ws[u][x].temp = (lsb >> 1) / 2.0;
-            unsigned until = (lsb & 1 ? 0x100 : 0);
-            until += msb;
-            ws[u][x].minutes_since_midnight = until * 5;
-            // LogV("sd " << u << ':' << x << " " << ws[u][x].temp << "°C " << ws[u][x].minutes_since_midnight)
-            pD += 2;
-
+            ++it;
+            continue;
         }
+        notify_all(it->done, r);
+        it = pending.erase(it);
     }
-    return ws;
-}
-
-bool m_response(std::string &&rawdata,
-                std::list<max_eq3::m_room> &roomlist,
-                std::list<max_eq3::m_device> &devicelist)
-{
-    rawdata.erase(0,2);
-    std::vector<std::string> sarray;
-    boost::split(sarray, rawdata, boost::is_any_of(","), boost::token_compress_on);
-    std::string decoded = decode64(sarray[2]);
-    // room data
-    const char *pData = &decoded[2];
-    unsigned roomcnt = uint8_t(*pData++); // decoded[0];
-    for (unsigned u = 0; u < roomcnt; ++u)
-    {
-        max_eq3::m_room rd;
-        rd.id = fromPtr<uint8_t>(pData++); // &decoded[0]);
-        rd.name = std::string(&pData[1], size_t(pData[0]));
-        pData += (rd.name.size() + 1);
-        rd.group_rfaddr = fromPtr<uint32_t>(&pData[0], 3);
-        pData += 3;
-        roomlist.push_back(rd);
-    }
-    // device data
-    unsigned devcnt = *pData++;
-    for (unsigned u = 0; u < devcnt; ++u)
-    {
-        max_eq3::m_device dd;
-        dd.type = devicetype(*pData++);
-        dd.rfaddr = fromPtr<uint32_t>(&pData[0], 3);
-        pData += 3;
-        dd.serial = std::string(&pData[0], 10);
-        pData += 10;
-        dd.name = std::string(&pData[1], pData[0]);
-        pData += (1 + dd.name.size());
-        dd.room_id = fromPtr<uint8_t>(pData++);
-        devicelist.push_back(dd);
-    }
-    return true;
 }
 
-
-} // ns -
+} // ns max_eq3
@@ -10,12 +10,21 @@
 #include <variant>
 #include <set>
 #include <array>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <future>
+#include <utility>
 
 #include <boost/asio.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include "cube.h"
+#include "rcu_cell.h"
+#include "history.h"
+#include "command_queue.h"
+#include "refresh_policy.h"
 
 namespace boost {
     namespace system {
@@ -28,8 +37,12 @@ namespace max_eq3 {
 //internal forwards
 
 struct l_submsg_data;
+struct room_conf;
+
+enum struct capture_dir : uint8_t;
 
 class logging_target;
+class cube_manager;
 
 // definitions
 
@@ -94,48 +107,256 @@ public:
     virtual void disconnected() = 0;
 };
 
+/**
+ * @brief The room_handle struct
+ * a room resolved by cube_io::find_room(), it gets invalid when the cube
+ * sends a new room configuration (M-Msg)
+ */
+struct room_handle
+{
+    unsigned    id{0};
+    unsigned    generation{0};
+
+    explicit operator bool() const { return id != 0; }
+};
+
+/**
+ * @brief The room_index struct
+ * ids of the configured rooms, also of those without values yet, built
+ * once per room configuration
+ */
+struct room_index
+{
+    unsigned                                        generation{0};  // see room_handle
+    std::vector<std::pair<std::string, unsigned>>   ids;            // sorted by name
+};
+
+/**
+ * @brief The room_table struct
+ * consistent state of all rooms, a new table is published by the io
+ * thread whenever rooms changed
+ */
+struct room_table
+{
+    unsigned                            version{0};     // incremented with every table
+    std::vector<room_sp>                rooms;          // sorted by name
+    std::shared_ptr<const room_index>   index;          // shared by the tables of a room configuration
+
+    room_sp find(std::string_view name) const;
+    room_handle handle(std::string_view name) const;
+};
+
+// steps of the connection to a cube, see cube_io::session()
+enum struct session_phase : uint8_t {
+    idle,           // offline
+    discover,       // no cube answered the discovery (own or the manager's) yet
+    connect,        // tcp connect to the cube
+    handshake,      // connected, H-, M- and C-Msgs until the first L-Msg
+    steady,         // polls and commands
+    reconnect,      // lost, waiting for the backoff
+};
+
+inline const char *to_string(session_phase p)
+{
+    switch (p)
+    {
+    case session_phase::idle:       return "idle";
+    case session_phase::discover:   return "discover";
+    case session_phase::connect:    return "connect";
+    case session_phase::handshake:  return "handshake";
+    case session_phase::steady:     return "steady";
+    case session_phase::reconnect:  return "reconnect";
+    }
+    return "unknown";
+}
+
+// every phase but steady and reconnect is given up after its timeout
+struct session_config
+{
+    std::chrono::milliseconds   discover_timeout{2000};     // discovery sent again (without manager)
+    std::chrono::milliseconds   connect_timeout{3000};      // a cube that is off doesn't refuse
+    std::chrono::milliseconds   handshake_timeout{5000};
+};
+
+struct session_timing
+{
+    session_phase               phase{session_phase::idle};
+    std::chrono::microseconds   discover{0};    // the last time the phase took
+    std::chrono::microseconds   connect{0};
+    std::chrono::microseconds   handshake{0};
+    std::chrono::microseconds   outage{0};      // last loss of the link until steady again
+    unsigned                    reconnects{0};
+    unsigned                    timeouts{0};
+};
+
+// a reader's view of the current room table, see rcu_cell
+using room_table_view = rcu_cell<room_table>::guard;
+
 class cube_io
 {
 public:
     cube_io(cube_event_target *iet, const std::string &serialno);
+
+    // tag for an instance without io thread and network, fed by inject()
+    struct offline_t {};
+    cube_io(cube_event_target *iet, const std::string &serialno, offline_t);
     ~cube_io();
 
-    // room api
-    void change_temp(const std::string &room, double temp);
-    void change_mode(const std::string &room, opmode mode);
-    void change_schedule(std::string room, const day_schedule &ds);
+    // processes one line received from the cube (offline instances only)
+    void inject(std::string_view line);
+
+    // records all lines received from and sent to the cube into a capture file
+    bool capture_to(const std::string &path);
+
+    /**
+     * @brief replay
+     * feeds the received lines of a capture file (offline instances only), the
+     * other calls may be made from other threads meanwhile
+     * @param speed time scale, 1.0 recorded speed, 0 as fast as possible
+     * @return number of lines processed
+     */
+    std::size_t replay(const std::string &path, double speed = 1.0);
+
+    /**
+     * @brief warm_start
+     * restores the configuration and the last values from a state file and
+     * keeps the file updated (at most every 10 s and on destruction), the cube's own
+     * M/C-Msgs replace the restored ones. Called from a thread of a shared pool
+     * the state is restored on the strand after the call.
+     * @return number of lines restored, 0 if there was no valid state yet or
+     * the restore was posted
+     */
+    std::size_t warm_start(const std::string &path);
+
+    // current room state, lock free from any thread, the view must not outlive cube_io
+    room_table_view rooms() const;
+
+    // room api, the commands wait for the duty cycle budget of the cube by priority.
+    // The ticket resolves on the S-Msg and on the L-Msg showing the change, done
+    // is called on the io thread for every state, see command_ticket
+    command_ticket change_temp(const std::string &room, double temp,
+                               command_priority prio = command_priority::normal,
+                               command_callback done = command_callback());
+    command_ticket change_mode(const std::string &room, opmode mode,
+                               command_priority prio = command_priority::normal,
+                               command_callback done = command_callback());
+    command_ticket change_schedule(const std::string &room, days day, const day_schedule &ds,
+                                   command_priority prio = command_priority::low,
+                                   command_callback done = command_callback());
+
+    // resolves the room name once for repeated commands, false if the room is unknown,
+    // lock free from any thread like rooms()
+    room_handle find_room(std::string_view room);
+    command_ticket change_temp(room_handle room, double temp,
+                               command_priority prio = command_priority::normal,
+                               command_callback done = command_callback());
+    command_ticket change_mode(room_handle room, opmode mode,
+                               command_priority prio = command_priority::normal,
+                               command_callback done = command_callback());
+    command_ticket change_schedule(room_handle room, days day, const day_schedule &ds,
+                                   command_priority prio = command_priority::low,
+                                   command_callback done = command_callback());
+
+    // admission of the commands, see command_queue
+    void configure_commands(const command_config &cfg);
+    // queue depth and the delay expected for a new command of the priority
+    command_queue_state commands(command_priority prio = command_priority::normal);
+
+    // timeouts of the connection phases
+    void configure_session(const session_config &cfg);
+    // the current phase and the time the last ones took
+    session_timing session();
+
+    // interval of the periodic poll, see refresh_policy
+    void configure_refresh(const refresh_config &cfg);
+    // the current interval and why
+    refresh_state refresh();
+
+    // recorded history of a room or a device, empty if unknown, see summarize()
+    std::vector<history_sample> history(room_handle room, const history_query &q);
+    std::vector<history_sample> history(rfaddr_t device, const history_query &q);
 
     static void set_logger(logging_target *target);
 
 private:
+    // runs f on the io thread and waits for its result, directly if there is none,
+    // a pool thread outside the strand gets the default result instead of waiting
+    template <typename F>
+    auto on_io_thread(F f) -> decltype(f());
 
     // asio in process cmd handler
-    void do_send_temp(std::string room, double temp);
-    void do_send_mode(std::string room, opmode mode);
-    void do_send_l_msg(const boost::system::error_code &e, std::size_t bytes_transferred);
-    void do_send_schedule(std::string room, days day, const day_schedule ds);
-    void process_connect(cube_sp, const boost::system::error_code &err);
+    const room_conf *resolve(std::string_view room);
+    const room_conf *resolve(room_handle room);
+    void do_send_temp(const room_conf *roomconfig, double temp, command_priority prio, completion_sp done);
+    void do_send_mode(const room_conf *roomconfig, opmode mode, command_priority prio, completion_sp done);
+    void do_send_schedule(const room_conf *roomconfig, days day, const day_schedule &ds, command_priority prio,
+                          completion_sp done);
+    // a cube answered a discovery (the own or the manager's), taken while not linked
+    void found(cube_sp cube);
+    // the link is down, commands and the planned refresh are dropped
+    void link_lost();
+    // q: to the cube, the session coroutines end and the state is written, on the strand
+    void close_session();
+    // runs close_session on the strand, ready once the session coroutines ended
+    std::future<void> stop_session();
 
-    void emit_S_temp_mode(rfaddr_t sendto, uint8_t roomid, uint8_t tmp_mode);
+    // temp and mode changes settle per room, one merged S-Msg is sent, see command_config::settle
+    void stage_change(unsigned roomid, std::optional<double> temp, std::optional<opmode> mode, command_priority prio,
+                      completion_sp done);
+    void flush_changes();
+    void send_change(unsigned roomid, std::optional<double> temp, std::optional<opmode> mode, command_priority prio,
+                     completions done);
+
+    void emit_S_temp_mode(rfaddr_t sendto, uint8_t roomid, uint8_t tmp_mode, command_priority prio,
+                          completions done, std::function<bool()> shown);
+    // key: a queued command with the same key is replaced, 0 never
+    void send_s_frame(const uint8_t *frame, std::size_t len, command_priority prio, unsigned key,
+                      completions done, std::function<bool()> shown = std::function<bool()>());
+    // accepted commands wait for the L-Msg showing them
+    void await_confirmation(command_queue::command &&cmd, const command_result &sent);
+    void check_confirmations();
+    void pump_commands();
+    void write_command(const std::string &line);
 
     // asio internal processing
     void process_io();
-    void handle_mcast_response(const boost::system::error_code& error, size_t bytes_recvd);
+
+    // the connection to the cube, coroutines on the strand, see cube_io.cpp
+    struct session_task;
+
+    // the session moves on, the time spent in the last phase is recorded
+    void enter_phase(session_phase phase, cube_sp cube = cube_sp());
+    void arm_phase_timer(cube_sp cube);
 
     // cube related communication handlers
-    void start_rx_from_cube(cube_sp &csp);
-    void restart_wait_timer(cube_sp &csp);
-    void timed_refresh(cube_sp, const boost::system::error_code &);
-    void rxrh_done(cube_sp, const boost::system::error_code& e, std::size_t bytes_recvd);
+    void received(cube_sp csp, std::size_t bytes_recvd);
+    // one l: per burst of commands, shares the refreshtimer with the periodic poll
+    void plan_refresh();
+    std::chrono::steady_clock::time_point refresh_due() const;
+    void arm_refresh(cube_sp &csp);
+    std::chrono::seconds poll_interval();
 
-    void evaluate_data(cube_sp, std::string &&data);
+    void evaluate_data(cube_sp, std::string_view data);
+    void capture(capture_dir dir, std::string_view line);
+    // the state file is written once per state_interval while values change, and on destruction
+    void plan_state_save();
+    void save_state();
+    std::size_t restore_state(const std::string &path);
 
     struct rfaddr_related;
     rfaddr_related search(rfaddr_t addr);
     void deploydata(const l_submsg_data &smd);
+    void record_history(std::size_t slot, const room_conf *rc, const l_submsg_data &smd, changeflag_set rcfs);
     void emit_changed_data();
+    void publish_rooms();
     void update_config(cube_sp csp);
 private:
+    friend class cube_io_probe;     // benchmark access to the processing steps
+    friend class cube_manager;
+
+    // a cube served by the manager, connected when the manager discovers it
+    cube_io(cube_event_target *iet, const std::string &serialno, cube_manager &manager);
+
     struct Private;
     std::unique_ptr<Private> _p;
 };
@@ -0,0 +1,255 @@
+
+#include <algorithm>
+#include <future>
+#include <mutex>
+
+#include "cube_manager.h"
+#include "cubio_io_p.h"
+#include "cube_log_internal.h"
+#include "discovery.h"
+#include "utils.h"
+
+namespace max_eq3 {
+
+struct cube_manager::Private
+{
+    cube_event_target              *iet{nullptr};
+    cube_manager_config             cfg;
+
+    io_pool                        &pool;
+    cube_strand                     strand;         // discovery, the cubes have their own
+
+    ba::ip::udp::socket             socket;
+    ba::ip::udp::endpoint           sender;
+    uint8_t                         recvline[32];
+    ba::steady_timer                discovery_timer;
+    bool                            closing{false}; // destruction began, no discovery anymore
+
+    mutable std::mutex              mtx;            // cubes are added by discovery
+    std::vector<std::pair<std::string, std::unique_ptr<cube_io>>>
+                                    cubes;          // serial, cube
+
+    explicit Private(io_pool &p)
+        : pool(p)
+        , strand(p.io().get_executor())
+        , socket(p.io())
+        , discovery_timer(p.io())
+    {}
+};
+
+cube_manager::cube_manager(cube_event_target *iet, const cube_manager_config &cfg, io_pool &pool)
+    : _p(new Private(pool))
+{
+    _p->iet = iet;
+    _p->cfg = cfg;
+
+    // known cubes are served (and warm started) before they are found
+    for (const auto &serial: cfg.serials)
+        add_cube(serial);
+    ba::post(_p->strand, [this](){ start_discovery(); });
+}
+
+cube_manager::~cube_manager()
+{
+    // the pool belongs to the caller and keeps running: discovery ends first, the cubes say q:
+    // and end their sessions on their strands, the handlers left don't refer to them anymore
+    on_strand([this](){
+        _p->closing = true;
+        bs::error_code ec;
+        _p->socket.close(ec);
+        _p->discovery_timer.cancel();
+    });
+    std::vector<std::future<void>> ended;
+    {
+        std::lock_guard<std::mutex> lock(_p->mtx);
+        for (const auto &c: _p->cubes)
+            ended.push_back(c.second->stop_session());
+    }
+    for (auto &f: ended)
+        wait_running(f);
+    on_strand([](){});              // rediscover() of the cubes posted before
+    std::lock_guard<std::mutex> lock(_p->mtx);
+    _p->cubes.clear();
+}
+
+void cube_manager::wait_running(std::future<void> &f)
+{
+    // a stopped pool doesn't run it anymore
+    while ((f.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) && !_p->pool.io().stopped())
+        ;
+}
+
+template <typename F>
+void cube_manager::on_strand(F f)
+{
+    std::promise<void> done;
+    std::future<void> ready = done.get_future();
+    ba::post(_p->strand, [&f, &done](){ f(); done.set_value(); });
+    wait_running(ready);
+}
+
+io_pool &cube_manager::pool()
+{
+    return _p->pool;
+}
+
+std::vector<std::string> cube_manager::serials() const
+{
+    std::lock_guard<std::mutex> lock(_p->mtx);
+    std::vector<std::string> result;
+    for (const auto &c: _p->cubes)
+        result.push_back(c.first);
+    return result;
+}
+
+cube_io *cube_manager::cube(std::string_view serial) const
+{
+    std::lock_guard<std::mutex> lock(_p->mtx);
+    for (const auto &c: _p->cubes)
+    {
+        if (c.first == serial)
+            return c.second.get();
+    }
+    return nullptr;
+}
+
+managed_room cube_manager::find_room(std::string_view name) const
+{
+    std::size_t sep = name.find('/');
+    if (sep != std::string_view::npos)
+    {
+        managed_room mr = find_room(name.substr(0, sep), name.substr(sep + 1));
+        if (mr)
+            return mr;
+    }
+    // rooms may contain a '/' too
+    std::vector<cube_io *> all;
+    {
+        std::lock_guard<std::mutex> lock(_p->mtx);
+        for (const auto &c: _p->cubes)
+            all.push_back(c.second.get());
+    }
+    for (cube_io *cio: all)
+    {
+        room_handle h = cio->find_room(name);
+        if (h)
+            return managed_room{cio, h};
+    }
+    return managed_room();
+}
+
+managed_room cube_manager::find_room(std::string_view serial, std::string_view room) const
+{
+    cube_io *cio = cube(serial);
+    if (!cio)
+        return managed_room();
+    return managed_room{cio, cio->find_room(room)};
+}
+
+cube_io *cube_manager::add_cube(const std::string &serial)
+{
+    cube_io *cio = new cube_io(_p->iet, serial, *this);
+    {
+        std::lock_guard<std::mutex> lock(_p->mtx);
+        _p->cubes.emplace_back(serial, std::unique_ptr<cube_io>(cio));
+    }
+    LogI("serving cube " << serial)
+    cio->configure_commands(_p->cfg.commands);
+    cio->configure_refresh(_p->cfg.refresh);
+    cio->configure_session(_p->cfg.session);
+    if (_p->cfg.capture_prefix.size())
+        cio->capture_to(_p->cfg.capture_prefix + serial);
+    if (_p->cfg.state_prefix.size())
+        cio->warm_start(_p->cfg.state_prefix + serial);
+    return cio;
+}
+
+void cube_manager::start_discovery()
+{
+    bs::error_code ec;
+    ba::ip::udp::endpoint listen_endpoint(ba::ip::address_v4::any(), discovery_port);
+    _p->socket.open(listen_endpoint.protocol(), ec);
+    if (!ec)
+        _p->socket.set_option(ba::ip::udp::socket::reuse_address(true), ec);
+    if (!ec)
+        _p->socket.bind(listen_endpoint, ec);
+    if (ec)
+    {
+        LogE("can't bind the discovery port " << discovery_port << ": " << ec.message())
+        return;
+    }
+    start_discovery_rx();
+    send_discovery();
+    restart_discovery_timer();
+}
+
+void cube_manager::send_discovery()
+{
+    // a single cube is asked for directly, several by the wildcard
+    max_eq3::send_discovery(_p->pool.io(), _p->cfg.serials.size() == 1 ? _p->cfg.serials[0] : std::string());
+}
+
+void cube_manager::rediscover()
+{
+    ba::post(_p->strand, [this](){ send_discovery(); });
+}
+
+void cube_manager::start_discovery_rx()
+{
+    _p->socket.async_receive_from(ba::buffer(_p->recvline, sizeof(_p->recvline)), _p->sender,
+        ba::bind_executor(_p->strand, [this](const bs::error_code &ec, std::size_t bytes_recvd)
+        {
+            if ((ec == ba::error::operation_aborted) || _p->closing)
+                return;
+            if (!ec)
+                handle_discovery_response(bytes_recvd);
+            start_discovery_rx();
+        }));
+}
+
+void cube_manager::restart_discovery_timer()
+{
+    _p->discovery_timer.expires_after(_p->cfg.rediscover);
+    _p->discovery_timer.async_wait(ba::bind_executor(_p->strand, [this](const bs::error_code &ec)
+        {
+            if (ec || _p->closing)
+                return;
+            bool missing = _p->cfg.serials.empty()
+                    && (!_p->cfg.max_cubes || (_p->cubes.size() < _p->cfg.max_cubes));
+            for (const auto &c: _p->cubes)
+                missing = missing || !c.second->_p->linked;
+            if (missing)
+                send_discovery();
+            restart_discovery_timer();
+        }));
+}
+
+void cube_manager::handle_discovery_response(std::size_t bytes_recvd)
+{
+    // our own request (19 bytes) comes back too
+    if ((bytes_recvd != discovery_response_size)
+            || (std::string_view(reinterpret_cast<const char *>(_p->recvline), 8) != "eQ3MaxAp"))
+        return;
+
+    std::string data(reinterpret_cast<const char *>(_p->recvline), bytes_recvd);
+    cube_sp found = std::make_shared<cube_t>(_p->pool.io(), std::move(data), _p->sender);
+    const std::string &serial = found->serial;
+    LogV("found cube " << serial << " at " << found->addr)
+
+    const auto &wanted = _p->cfg.serials;
+    if (wanted.size() && (std::find(wanted.begin(), wanted.end(), serial) == wanted.end()))
+        return;
+
+    cube_io *cio = cube(serial);
+    if (!cio)
+    {
+        if (_p->cfg.max_cubes && (_p->cubes.size() >= _p->cfg.max_cubes))
+            return;
+        cio = add_cube(serial);
+    }
+    // the session belongs to the strand of the cube
+    if (!cio->_p->linked)
+        ba::post(cio->_p->strand, [cio, found](){ cio->found(found); });
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef CUBE_MANAGER_H
+#define CUBE_MANAGER_H
+#pragma once
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "cube_io.h"
+#include "io_pool.h"
+
+namespace max_eq3 {
+
+struct cube_manager_config
+{
+    std::vector<std::string>    serials;        // cubes to serve, empty: every cube found
+    unsigned                    max_cubes{0};   // limit for found cubes, 0: no limit
+    std::string                 state_prefix;   // warm start from <prefix><serial>, empty: none
+    std::string                 capture_prefix; // sessions recorded into <prefix><serial>, empty: none
+    std::chrono::seconds        rediscover{30}; // discovery repeated while cubes are missing
+    command_config              commands;       // admission of the commands to every cube
+    refresh_config              refresh;        // poll interval of every cube
+    session_config              session;        // timeouts of the connection phases
+};
+
+/**
+ * @brief The managed_room struct
+ * a room and the cube it belongs to, see cube_manager::find_room()
+ */
+struct managed_room
+{
+    cube_io        *cube{nullptr};
+    room_handle     room;
+
+    explicit operator bool() const { return cube && room; }
+};
+
+/**
+ * @brief The cube_manager class
+ * discovers, connects and serves several cubes on the threads of an
+ * io_pool. Every cube gets its own cube_io with its own store and its own
+ * strand, so cubes are processed in parallel with several threads. Rooms
+ * are named per cube by the cube serial ("<serial>/<room>"). Cubes are
+ * only added, a lost connection is made again on the next discovery.
+ */
+class cube_manager
+{
+public:
+    // the pool keeps running on destruction, the cubes end their sessions before they are destroyed
+    cube_manager(cube_event_target *iet, const cube_manager_config &cfg, io_pool &pool);
+    ~cube_manager();
+
+    // serials of the served cubes, in the order they were added
+    std::vector<std::string> serials() const;
+    cube_io *cube(std::string_view serial) const;
+
+    // "<serial>/<room>", a name without serial is searched in all cubes
+    managed_room find_room(std::string_view name) const;
+    managed_room find_room(std::string_view serial, std::string_view room) const;
+
+private:
+    friend class cube_io;
+
+    io_pool &pool();
+    // any thread, cubes ask for it when their cached address failed
+    void rediscover();
+
+    cube_io *add_cube(const std::string &serial);
+    void start_discovery();
+    void send_discovery();
+    void start_discovery_rx();
+    void restart_discovery_timer();
+    void handle_discovery_response(std::size_t bytes_recvd);
+
+    // destruction only, waits while the pool runs
+    template <typename F>
+    void on_strand(F f);
+    void wait_running(std::future<void> &f);
+
+    struct Private;
+    std::unique_ptr<Private> _p;
+};
+
+}
+
+#endif // CUBE_MANAGER_H
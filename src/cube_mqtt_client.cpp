@@ -12,8 +12,25 @@ namespace max_eq3 {
 const char *pRootTopic = "max2mqtt/";
 
 mqtt_client::mqtt_client(const std::string &host, const std::string &port)
-    : _is_connected(false)
+    : _own_ios(new boost::asio::io_service)
+    , _ios(*_own_ios)
+    , _strand(_ios)
+    , _is_connected(false)
     , _ready(false)
+{
+    connect(host, port);
+}
+
+mqtt_client::mqtt_client(boost::asio::io_service &ios, const std::string &host, const std::string &port)
+    : _ios(ios)
+    , _strand(ios)
+    , _is_connected(false)
+    , _ready(false)
+{
+    connect(host, port);
+}
+
+void mqtt_client::connect(const std::string &host, const std::string &port)
 {
     std::cout << "make client\n";
     _client = mqtt::make_sync_client(_ios, host, port);
@@ -50,13 +67,12 @@ bool mqtt_client::connack_handler(bool sp, std::uint8_t connack_return_code)
     //           << mqtt::connect_return_code_to_str(connack_return_code) << std::endl;
     if (connack_return_code == mqtt::connect_return_code::accepted)
     {
+        std::lock_guard<std::mutex> lock(_mtx);
         if (!_is_connected)
         {
             std::cout << "mqtt set connected\n";
-            if (_device)
-            {
-                send_device();
-            }
+            for (const auto &d: _devices)
+                send_device(d.second);
             for (auto x: _rooms)
             {
                 send_room(x.second); // .second.roomsp);
@@ -135,18 +151,20 @@ bool mqtt_client::publish_handler(std::uint8_t header,
     std::cout << "contents: " << contents << std::endl;
 
 
-    std::string toremote = std::string(pRootTopic) + _device->name;
-    if (topic_name.substr(0, toremote.size()) == toremote)
+    // max2mqtt/<cube serial>/<room>/set/<target>
+    std::vector<std::string> out;
+    boost::split(out, topic_name, boost::is_any_of("/"), boost::token_compress_on);
+    bool known_cube = false;
+    if (out.size() == 5)
     {
-
-        auto target = topic_name.substr(toremote.size()+1);
-        std::cout << "valid topic " << target << std::endl;
-        std::vector<std::string> out;
-        boost::split(out, topic_name, boost::is_any_of("/"), boost::token_compress_on);
-        if (out[3] == "set")
-        {
-            _setm(out[2], out[4], std::string(contents));
-        }
+        std::lock_guard<std::mutex> lock(_mtx);
+        known_cube = (_devices.find(out[1]) != _devices.end());
+    }
+    // the setter may wait for the cube, not under the lock
+    if (known_cube && (out[3] == "set"))
+    {
+        std::cout << "valid topic for cube " << out[1] << std::endl;
+        _setm(out[1], out[2], out[4], std::string(contents));
     }
 
 
@@ -162,7 +180,7 @@ void mqtt_client::send_room(roomdata &roomd) // room_sp room)
 {
     std::string rname = roomd.roomsp->name;
     // std::cout << "do emit room data for " << rname << std::endl;
-    std::string base_topic_room = pRootTopic + _device->name + "/" + rname + "/";
+    std::string base_topic_room = pRootTopic + roomd.roomsp->cube + "/" + rname + "/";
 
     if ((_tmit_ctrl.find(base_topic_room) == _tmit_ctrl.end()) || (_tmit_ctrl[base_topic_room] & 1) == 0)
     {
@@ -201,34 +219,40 @@ void mqtt_client::send_room(roomdata &roomd) // room_sp room)
     _client->publish(base_topic_room + "act-temp", std::to_string(roomd.roomsp->actual_temp.first), mqtt::qos::at_least_once, true);
     _client->publish(base_topic_room + "set-temp", std::to_string(roomd.roomsp->set_temp.first), mqtt::qos::at_least_once, true);
     _client->publish(base_topic_room + "valve-pos", std::to_string(roomd.roomsp->valve_pos.first), mqtt::qos::at_least_once, true);
+    _client->publish(base_topic_room + "valve-max", std::to_string(roomd.roomsp->valve_max), mqtt::qos::at_least_once, true);
+    _client->publish(base_topic_room + "valve-min", std::to_string(roomd.roomsp->valve_min), mqtt::qos::at_least_once, true);
     std::string mode = mode_as_string(roomd.roomsp->mode);
     _client->publish(base_topic_room + "mode", mode, mqtt::qos::at_least_once, true);
-    _client->publish(base_topic_room + "weekplan", to_json(rname, roomd.roomsp->schedule), mqtt::qos::at_least_once, true);
+    if (roomd.roomsp->schedule)
+        _client->publish(base_topic_room + "weekplan", to_json(rname, *roomd.roomsp->schedule), mqtt::qos::at_least_once, true);
 
     // std::cout << "weekschedule for " << roomd.roomsp->schedule
     //          << "\njson ###\n" << to_json(rname, roomd.roomsp->schedule)
     //          << std::endl;
 }
 
-void mqtt_client::send_device()
+void mqtt_client::send_device(const device_sp &dsp)
 {
 #if defined(HOMIE_CONVENTION)
-    std::string topic_root = pRootTopic + _device->name + "/";
+    std::string topic_root = pRootTopic + dsp->name + "/";
     _client->publish(topic_root + "$homie", "4.0", mqtt::qos::at_least_once);
     _client->publish(topic_root + "$name", "max cube", mqtt::qos::at_least_once);
     _client->publish(topic_root + "$state", _ready ? "ready" : "init", mqtt::qos::at_least_once);
     _client->publish(topic_root + "$extensions", ""), mqtt::qos::at_least_once;
 #endif
-    update_nodes();
+    update_nodes(dsp->name);
 }
 
-void mqtt_client::update_nodes()
+void mqtt_client::update_nodes(const std::string &cube)
 {
     std::string nodes;
     bool first = true;
-    for (auto x: _rooms)
+    for (const auto &x: _rooms)
     {
-        if (!x.first.size())
+        const room_sp &rsp = x.second.roomsp;
+        if (rsp->cube != cube)
+            continue;
+        if (!rsp->name.size())
             std::cerr << "wrong node name\n";
         else
         {
@@ -236,12 +260,12 @@ void mqtt_client::update_nodes()
                 first = false;
             else
                 nodes += ',';
-            nodes += x.first;
+            nodes += rsp->name;
         }
     }
     std::ostringstream topic_root;
 
-    topic_root << pRootTopic << _device->name << "/";
+    topic_root << pRootTopic << cube << "/";
 #if 0
     std::cout << __FUNCTION__ << " root tp " << topic_root.str()
               // << " to " << nodes
@@ -252,13 +276,12 @@ void mqtt_client::update_nodes()
 
 void mqtt_client::expose_cube(device_sp dsp)
 {
-    _ios.post([this, dsp]()
+    _strand.post([this, dsp]()
     {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _devices[dsp->name] = dsp;
         if (_is_connected)
-        {
-            _device = dsp;
-            send_device();
-        }
+            send_device(dsp);
     });
 }
 
@@ -266,31 +289,36 @@ void mqtt_client::expose_cube(device_sp dsp)
 void mqtt_client::complete()
 {
     std::cout << "device is complete" << std::endl;
+    std::lock_guard<std::mutex> lock(_mtx);
     _ready = true;
-    send_device();   // update_nodes();
+    for (const auto &d: _devices)
+        send_device(d.second);  // update_nodes();
     for (auto x: _rooms)
     {
         send_room(x.second);
     }
-    std::string topic_root = pRootTopic +_device->name + "/";
-    _client->publish(topic_root + "$version", "1.0", mqtt::qos::at_least_once);
-    _client->publish(topic_root + "$state", "ready", mqtt::qos::at_least_once);
+    for (const auto &d: _devices)
+    {
+        std::string topic_root = pRootTopic + d.first + "/";
+        _client->publish(topic_root + "$version", "1.0", mqtt::qos::at_least_once);
+        _client->publish(topic_root + "$state", "ready", mqtt::qos::at_least_once);
+    }
 }
 
 void mqtt_client::expose_room(room_sp rsp)
 {
     // std::cout << __FUNCTION__ << std::endl;
-    _ios.post([this, rsp]()
+    _strand.post([this, rsp]()
     {
         // std::cout << "inside " << __FUNCTION__ << std::endl;
-        auto room_it = _rooms.find(rsp->name);
+        std::lock_guard<std::mutex> lock(_mtx);
+        std::string key = rsp->cube + "/" + rsp->name;
+        auto room_it = _rooms.find(key);
         bool insertnode = (room_it == _rooms.end());
         if (insertnode)
-        {
-            _rooms.emplace(std::pair(rsp->name, roomdata(rsp)));
-            room_it = _rooms.find(rsp->name);
-        }
-        bool updnode = insertnode || (room_it->second.roomsp.get() != rsp.get());
+            room_it = _rooms.emplace(key, roomdata(rsp)).first;
+        bool updnode = insertnode;
+        room_it->second.roomsp = rsp;
 
         if (_is_connected)
         {
@@ -298,77 +326,15 @@ void mqtt_client::expose_room(room_sp rsp)
             if (updnode)
             {
                 // std::cout << "update node for room " << room_it->first << std::endl;
-                update_nodes();
+                update_nodes(rsp->cube);
             }
         }
     });
 }
 
-static const char *day_text[7] = {
-    "saturday", "sunday", "monday", "tuesday", "wednesday", "thursday", "friday"
-};
-
 std::string mqtt_client::to_json(const std::string &roomname, const week_schedule &ws)
 {
-    // using namespace boost::property_tree;
-#if defined(format)
-    {
-        "room" : "<roomname>",
-        "saturday" : [
-          {
-            "endtime" : "755",
-            "temp" : "16.0",
-          }
-        ],
-        "tuesday" : [
-          {
-            "endtime" : "755",
-            "temp" : "16.0",
-          },
-          {
-            "endtime" : "755",
-            "temp" : "16.0",
-          }
-        ],
-    }
-#endif
-    std::ostringstream output;
-
-    output << "{\n  \"room\" : \"" << roomname << "\" ,\n";
-
-    bool firstday = true;
-    for (unsigned day = static_cast<unsigned>(days::Saturday);
-                  day <= static_cast<unsigned>(days::Friday); day++)
-    {
-        if (!firstday)
-            output << ",\n";
-        else
-            firstday = false;
-        output << "  \"" << day_text[day] << "\" : [\n";
-        const day_schedule &ds(ws[day]);
-        bool seen_end = false;
-        bool first = true;
-        for (const auto &oneslot: ds)
-        {
-            if (!seen_end)
-            {
-                std::ostringstream sent;
-                if (!first)
-                    sent << ",\n";
-                else
-                    first = false;
-                sent << "    {\n      \"endtime\" : \"" << oneslot.minutes_since_midnight << "\",\n"
-                     << "      \"temp\" : \"" << oneslot.temp << "\"\n    }";
-                seen_end = (oneslot.minutes_since_midnight == 1440);
-                output << sent.str();
-            }
-        }
-        output << "\n  ]";
-    }
-    output << "\n}";
-    // std::cout << "to_json " << roomname << " \n" << output.str() << std::endl;
-    return output.str();
+    return schedule_to_json(roomname, ws);
 }
 
-
 }
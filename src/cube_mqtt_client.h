@@ -3,6 +3,7 @@
 #pragma once
 
 #include <functional>
+#include <mutex>
 
 #include "mqtt_client_cpp.hpp"
 #include "cube_types.h"
@@ -43,9 +44,12 @@ class mqtt_client
     using packet_id_t = client_type_t::packet_id_t;
 public:
 
-    using set_method = std::function<void (std::string_view room, std::string_view target, std::string_view data)>;
+    using set_method = std::function<void (std::string_view cube, std::string_view room, std::string_view target, std::string_view data)>;
 
+    // with an own io_service, see run()
     mqtt_client(const std::string &host, const std::string &port);
+    // on a shared io_service (io_pool), run by its threads
+    mqtt_client(boost::asio::io_service &ios, const std::string &host, const std::string &port);
     void expose_cube(device_sp dsp);
     void expose_room(room_sp rsp);
     void complete();
@@ -68,8 +72,9 @@ private:    // types
 
 private:
 
-    void send_device();
-    void update_nodes();
+    void connect(const std::string &host, const std::string &port);
+    void send_device(const device_sp &dsp);
+    void update_nodes(const std::string &cube);
     void send_room(roomdata &roomd);
     std::string to_json(const std::string &roomname, const week_schedule &ws);
 
@@ -87,12 +92,16 @@ private:
                          mqtt::buffer contents);
 
 private:
-    boost::asio::io_service _ios;
+    std::unique_ptr<boost::asio::io_service> _own_ios;
+    boost::asio::io_service &_ios;
+    boost::asio::io_service::strand _strand;    // orders the exposed rooms and cubes
+    std::mutex _mtx;                            // the state below, the client handlers
+                                                // run on the strand of the connection
     std::shared_ptr<client_type_t> _client;
 
-    std::map<std::string, roomdata> _rooms;
+    std::map<std::string, roomdata> _rooms;     // by "<cube serial>/<room name>"
 
-    device_sp _device;
+    std::map<std::string, device_sp> _devices;  // by cube serial
     bool _is_connected;
     bool _ready;
 
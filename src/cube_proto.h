@@ -0,0 +1,315 @@
+#ifndef CUBE_PROTO_H
+#define CUBE_PROTO_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <ratio>
+#include <string_view>
+
+#include "cube_types.h"
+
+namespace max_eq3 { namespace proto {
+
+/**
+ * Binary layout of the (base64 decoded) cube messages.
+ *
+ * Every frame is declared once as a set of fields, a field knows its
+ * offset and width within the frame and provides get() for the decoder
+ * and put() for the encoder. All multi byte values are big endian.
+ */
+
+// unsigned big endian integer
+template <std::size_t Offset, std::size_t Width, typename T = unsigned>
+struct field
+{
+    static_assert(Width > 0 && Width <= 4, "field width 1..4 bytes");
+
+    using value_type = T;
+    static constexpr std::size_t offset = Offset;
+    static constexpr std::size_t width = Width;
+    static constexpr std::size_t end = Offset + Width;
+
+    static constexpr T get(const uint8_t *p)
+    {
+        uint32_t v = 0;
+        for (std::size_t u = 0; u < Width; ++u)
+            v = (v << 8) | p[Offset + u];
+        return T(v);
+    }
+    static constexpr void put(uint8_t *p, T v)
+    {
+        uint32_t raw = uint32_t(v);
+        for (std::size_t u = Width; u-- > 0; raw >>= 8)
+            p[Offset + u] = uint8_t(raw);
+    }
+};
+
+// bit range of a field
+template <typename F, uint32_t Mask, unsigned Shift = 0>
+struct bits
+{
+    using value_type = unsigned;
+    static constexpr std::size_t offset = F::offset;
+    static constexpr std::size_t end = F::end;
+
+    static constexpr unsigned get(const uint8_t *p)
+    {
+        return (uint32_t(F::get(p)) & Mask) >> Shift;
+    }
+    static constexpr void put(uint8_t *p, unsigned v)
+    {
+        uint32_t raw = uint32_t(F::get(p)) & ~Mask;
+        F::put(p, typename F::value_type(raw | ((uint32_t(v) << Shift) & Mask)));
+    }
+};
+
+// fixed point value: value = raw * Scale + Bias
+template <typename F, typename Scale, typename Bias = std::ratio<0>>
+struct scaled
+{
+    using value_type = double;
+    static constexpr std::size_t offset = F::offset;
+    static constexpr std::size_t end = F::end;
+
+    static constexpr double get(const uint8_t *p)
+    {
+        return double(F::get(p)) * Scale::num / Scale::den + double(Bias::num) / Bias::den;
+    }
+    static void put(uint8_t *p, double v)
+    {
+        double raw = (v - double(Bias::num) / Bias::den) * Scale::den / Scale::num;
+        F::put(p, typename F::value_type(std::lround(raw)));
+    }
+};
+
+// raw bytes (serial numbers)
+template <std::size_t Offset, std::size_t Width>
+struct bytes
+{
+    static constexpr std::size_t offset = Offset;
+    static constexpr std::size_t end = Offset + Width;
+
+    static std::string_view get(const uint8_t *p)
+    {
+        return std::string_view(reinterpret_cast<const char *>(p + Offset), Width);
+    }
+};
+
+template <std::size_t Size>
+struct frame
+{
+    static constexpr std::size_t size = Size;
+    static constexpr std::size_t end = Size;            // as the header of a longer frame
+    using buffer = std::array<uint8_t, Size>;
+};
+
+// every field of a frame ends within its size, checked after the fields
+template <std::size_t Size, typename... Fields>
+constexpr bool fields_fit = ((Fields::end <= Size) && ...);
+
+using half_degree = std::ratio<1, 2>;
+using tenth_degree = std::ratio<1, 10>;
+
+/**
+ * week program point: 7 bit temperature in half degrees,
+ * 9 bit end time in units of 5 minutes
+ */
+template <std::size_t Offset>
+struct program_point
+{
+    using raw = field<Offset, 2>;
+    using temp = scaled<bits<raw, 0xfe00, 9>, half_degree>;
+    using until_raw = bits<raw, 0x01ff>;
+    using until = scaled<until_raw, std::ratio<5>>;
+    static constexpr std::size_t offset = Offset;
+    static constexpr std::size_t end = raw::end;
+
+    static schedule_point get(const uint8_t *p)
+    {
+        schedule_point sp;
+        sp.temp = temp::get(p);
+        sp.minutes_since_midnight = unsigned(until::get(p));
+        return sp;
+    }
+    static void put(uint8_t *p, const schedule_point &sp)
+    {
+        raw::put(p, 0);
+        temp::put(p, std::min(sp.temp, 63.5));
+        // truncated to the 5 minute unit, not rounded
+        until_raw::put(p, sp.minutes_since_midnight / 5);
+    }
+};
+
+constexpr std::size_t day_program_size = SCHED_POINTS * 2;
+constexpr std::size_t week_program_size = DAYS_A_WEEK * day_program_size;
+
+template <std::size_t Offset>
+struct week_program
+{
+    static constexpr std::size_t offset = Offset;
+    static constexpr std::size_t end = Offset + week_program_size;
+
+    static void get(const uint8_t *p, week_schedule &ws)
+    {
+        p += Offset;
+        for (unsigned u = 0; u < DAYS_A_WEEK; ++u)
+            for (unsigned x = 0; x < SCHED_POINTS; ++x, p += 2)
+                ws[u][x] = program_point<0>::get(p);
+    }
+};
+
+/*
+ * L-Msg sub message (one per device)
+ */
+struct l_record : frame<7>
+{
+    using len = field<0, 1>;                            // length excluding this byte
+    using rfaddr = field<1, 3, rfaddr_t>;
+    using unknown = field<4, 1>;
+    using flags = field<5, 2, uint16_t>;
+
+    static_assert(fields_fit<size, len, rfaddr, unknown, flags>, "l_record field exceeds frame size");
+};
+
+// thermostat data following the header (len 11 radiator, 12 wall thermostat)
+struct l_record_rt : frame<12>
+{
+    using valve_pos = field<7, 1, uint16_t>;
+    using set_temp = scaled<bits<field<8, 1>, 0x7f>, half_degree>;
+    using act_temp = scaled<bits<field<9, 2>, 0x1ff>, tenth_degree>;
+    using time_until = field<11, 1>;                    // half hours since midnight
+
+    static_assert(fields_fit<size, valve_pos, set_temp, act_temp, time_until>, "l_record_rt field exceeds frame size");
+};
+
+struct l_record_wt : frame<13>
+{
+    using valve_pos = l_record_rt::valve_pos;
+    using set_temp = l_record_rt::set_temp;
+    using date_until = field<9, 2, uint16_t>;
+    using time_until = l_record_rt::time_until;
+    // bit 8 of the actual temperature is stored in the set temp byte
+    using act_temp_hi = bits<field<8, 1>, 0x80, 7>;
+    using act_temp_lo = field<12, 1>;
+
+    static double act_temp(const uint8_t *p)
+    {
+        return ((act_temp_hi::get(p) << 8) + act_temp_lo::get(p)) / 10.0;
+    }
+
+    static_assert(fields_fit<size, valve_pos, set_temp, date_until, time_until, act_temp_hi, act_temp_lo>,
+                  "l_record_wt field exceeds frame size");
+};
+
+/*
+ * C-Msg device configuration
+ */
+struct c_header : frame<18>
+{
+    using len = field<0, 1>;
+    using rfaddr = field<1, 3, rfaddr_t>;
+    using devtype = field<4, 1>;
+    using room_id = field<5, 1, uint16_t>;
+    using fwversion = field<6, 1, uint16_t>;
+    using test_result = field<7, 1>;
+    using serial = bytes<8, 10>;
+
+    static_assert(fields_fit<size, len, rfaddr, devtype, room_id, fwversion, test_result, serial>,
+                  "c_header field exceeds frame size");
+};
+
+struct c_radiator_thermostat : frame<29 + week_program_size>
+{
+    using comfort = scaled<field<18, 1>, half_degree>;
+    using eco = scaled<field<19, 1>, half_degree>;
+    using max = scaled<field<20, 1>, half_degree>;
+    using min = scaled<field<21, 1>, half_degree>;
+    using tofs = scaled<field<22, 1>, half_degree, std::ratio<7, 2>>;    // offset + 3.5
+    using schedule = week_program<29>;
+
+    static_assert(fields_fit<size, comfort, eco, max, min, tofs, schedule>,
+                  "c_radiator_thermostat field exceeds frame size");
+};
+
+struct c_wall_thermostat : frame<30 + week_program_size>
+{
+    using comfort = scaled<field<18, 1>, half_degree>;
+    using eco = scaled<field<19, 1>, half_degree>;
+    using max = scaled<field<20, 1>, half_degree>;
+    using min = scaled<field<21, 1>, half_degree>;
+    using schedule = week_program<30>;
+
+    static_assert(fields_fit<size, comfort, eco, max, min, schedule>,
+                  "c_wall_thermostat field exceeds frame size");
+};
+
+/*
+ * S-Msg commands
+ */
+enum s_command : uint8_t {
+    s_set_program = 0x10,
+    s_set_temp = 0x40,
+};
+
+struct s_header : frame<10>
+{
+    using unknown = field<0, 1>;
+    using flags = field<1, 1>;                          // 4: address a room
+    using command = field<2, 1>;
+    using from = field<3, 3, rfaddr_t>;
+    using to = field<6, 3, rfaddr_t>;                   // 0: all rooms
+    using room_id = field<9, 1>;
+
+    static void put(uint8_t *p, s_command cmd, rfaddr_t sendto, uint8_t roomid)
+    {
+        unknown::put(p, 0);
+        flags::put(p, 4);
+        command::put(p, cmd);
+        from::put(p, 0);
+        to::put(p, sendto);
+        room_id::put(p, roomid);
+    }
+
+    static_assert(fields_fit<size, unknown, flags, command, from, to, room_id>, "s_header field exceeds frame size");
+};
+
+struct s_temp_mode : frame<11>
+{
+    using temp_mode = field<10, 1, uint8_t>;            // temp * 2 | mode << 6
+
+    static buffer encode(rfaddr_t sendto, uint8_t roomid, uint8_t tmp_mode)
+    {
+        buffer b{};
+        s_header::put(b.data(), s_set_temp, sendto, roomid);
+        temp_mode::put(b.data(), tmp_mode);
+        return b;
+    }
+
+    static_assert(fields_fit<size, s_header, temp_mode>, "s_temp_mode field exceeds frame size");
+};
+
+struct s_day_program : frame<11 + day_program_size>
+{
+    using day = field<10, 1>;
+    static constexpr std::size_t points_offset = 11;    // SCHED_POINTS program points follow
+    using last_point = program_point<points_offset + day_program_size - 2>;
+
+    static buffer encode(rfaddr_t sendto, uint8_t roomid, days d, const day_schedule &ds)
+    {
+        buffer b{};
+        s_header::put(b.data(), s_set_program, sendto, roomid);
+        day::put(b.data(), unsigned(d));
+        for (unsigned u = 0; u < SCHED_POINTS; ++u)
+            program_point<0>::put(b.data() + points_offset + 2 * u, ds[u]);
+        return b;
+    }
+
+    static_assert(fields_fit<size, s_header, day, last_point>, "s_day_program field exceeds frame size");
+};
+
+}}
+
+#endif // CUBE_PROTO_H
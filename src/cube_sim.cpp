@@ -0,0 +1,505 @@
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "cube_sim.h"
+#include "cube_io.h"
+#include "cube_log_internal.h"
+#include "cube_proto.h"
+#include "base64.h"
+#include "line_framer.h"
+#include "msg_builder.h"
+#include "utils.h"
+
+namespace ba = boost::asio;
+namespace bs = boost::system;
+
+namespace max_eq3 {
+
+namespace {
+
+const char *sim_multicast = "224.0.0.1";
+
+constexpr std::size_t detect_request_size = 19;
+constexpr unsigned sim_freeslots = 50;
+
+// "eQ3Max*\0" <serial or 10 '*'> "I"
+bool is_detect_request(const uint8_t *p, std::size_t len, const std::string &serial)
+{
+    if ((len != detect_request_size) || (std::memcmp(p, "eQ3Max*\0", 8) != 0) || (p[18] != 'I'))
+        return false;
+    std::string_view req(reinterpret_cast<const char *>(p + 8), 10);
+    return (req == "**********") || (req == serial);
+}
+
+// "eQ3MaxAp" <serial> ">I" 0 <rfaddr> <fwversion>, see cube_t
+std::string detect_response(const sim_config &cfg)
+{
+    std::string rsp("eQ3MaxAp");
+    std::string serial = cfg.serial;
+    serial.resize(10, ' ');
+    rsp += serial;
+    rsp += ">I";
+    rsp += '\0';
+    rsp += char(cfg.rfaddr >> 16);
+    rsp += char(cfg.rfaddr >> 8);
+    rsp += char(cfg.rfaddr);
+    rsp += char(cfg.fwversion >> 8);
+    rsp += char(cfg.fwversion);
+    return rsp;
+}
+
+}
+
+struct cube_simulator::session
+{
+    ba::ip::tcp::socket         sock;
+    ba::steady_timer            l_timer;
+    line_framer<4096>           rxdata;
+    std::deque<std::string>     txq;            // front is being written
+    bool                        closing{false};
+
+    explicit session(ba::io_service &io)
+        : sock(io)
+        , l_timer(io)
+    {}
+};
+
+struct cube_simulator::Private
+{
+    sim_config                      cfg;
+    sim_stats                       stats;
+
+    ba::io_service                  io;
+    ba::ip::udp::socket             udp{io};
+    ba::ip::udp::socket             reply{io};      // bound to cfg.address
+    ba::ip::tcp::acceptor           acceptor{io};
+    std::thread                     io_thread;
+
+    uint8_t                         udp_rx[64];
+    ba::ip::udp::endpoint           udp_sender;
+
+    // the house, io thread only
+    std::vector<m_room>             rooms;
+    std::vector<m_device>           devices;
+    std::vector<l_submsg_data>      ldata;          // same order as devices
+    thermostat_settings             settings;
+    std::mt19937                    rng;
+
+    unsigned                        duty_cycle{0};  // percent of the radio budget used
+    std::chrono::steady_clock::time_point
+                                    duty_time;      // last recovery, see sim_config::duty_recovery
+    unsigned                        pending{0};     // accepted s: not yet "transmitted"
+
+    std::vector<std::weak_ptr<session>>
+                                    sessions;       // closed by stop()
+};
+
+cube_simulator::cube_simulator(const sim_config &cfg)
+    : _p(new Private)
+{
+    _p->cfg = cfg;
+    _p->rng.seed(cfg.seed);
+    generate_house();
+}
+
+cube_simulator::~cube_simulator()
+{
+    stop();
+}
+
+const sim_config &cube_simulator::config() const
+{
+    return _p->cfg;
+}
+
+const sim_stats &cube_simulator::stats() const
+{
+    return _p->stats;
+}
+
+bool cube_simulator::start()
+{
+    if (_p->io_thread.joinable())
+        return true;
+
+    bs::error_code ec;
+    ba::ip::udp::endpoint udp_ep(ba::ip::address_v4::any(), _p->cfg.udp_port);
+    _p->udp.open(udp_ep.protocol(), ec);
+    if (!ec)
+        _p->udp.set_option(ba::ip::udp::socket::reuse_address(true), ec);
+    if (!ec)
+        _p->udp.bind(udp_ep, ec);
+    if (ec)
+    {
+        LogE("simulator can't bind udp port " << _p->cfg.udp_port << ": " << ec.message())
+        return false;
+    }
+    // the all hosts group is joined by the kernel anyway
+    _p->udp.set_option(ba::ip::multicast::join_group(ba::ip::address::from_string(sim_multicast)), ec);
+    _p->udp.set_option(ba::ip::multicast::enable_loopback(true), ec);
+
+    ba::ip::address bind_address = ba::ip::address_v4::any();
+    if (_p->cfg.address.size())
+    {
+        bind_address = ba::ip::address::from_string(_p->cfg.address, ec);
+        if (!ec)
+            _p->reply.open(ba::ip::udp::v4(), ec);
+        if (!ec)
+            _p->reply.bind(ba::ip::udp::endpoint(bind_address, 0), ec);
+        if (!ec)
+            _p->reply.set_option(ba::ip::multicast::enable_loopback(true), ec);
+        if (ec)
+        {
+            LogE("simulator can't use address " << _p->cfg.address << ": " << ec.message())
+            _p->udp.close();
+            return false;
+        }
+    }
+
+    ba::ip::tcp::endpoint tcp_ep(bind_address, _p->cfg.tcp_port);
+    _p->acceptor.open(tcp_ep.protocol(), ec);
+    if (!ec)
+        _p->acceptor.set_option(ba::ip::tcp::acceptor::reuse_address(true), ec);
+    if (!ec)
+        _p->acceptor.bind(tcp_ep, ec);
+    if (!ec)
+        _p->acceptor.listen(ba::socket_base::max_connections, ec);
+    if (ec)
+    {
+        LogE("simulator can't listen on tcp port " << _p->cfg.tcp_port << ": " << ec.message())
+        _p->udp.close();
+        _p->reply.close(ec);
+        return false;
+    }
+
+    start_discovery_rx();
+    start_accept();
+    _p->io_thread = std::thread([this](){ _p->io.run(); });
+    return true;
+}
+
+void cube_simulator::stop()
+{
+    if (!_p->io_thread.joinable())
+        return;
+    _p->io.stop();
+    _p->io_thread.join();
+    bs::error_code ec;
+    // like a reboot, the clients see their connection closed
+    for (auto &w: _p->sessions)
+    {
+        if (session_sp ssp = w.lock())
+            ssp->sock.close(ec);
+    }
+    _p->sessions.clear();
+    _p->udp.close(ec);
+    _p->reply.close(ec);
+    _p->acceptor.close(ec);
+    _p->io.reset();
+}
+
+void cube_simulator::generate_house()
+{
+    sim_config &cfg = _p->cfg;
+    unsigned per_room = cfg.thermostats + (cfg.wallthermostat ? 1 : 0);
+    unsigned rooms = std::min(cfg.rooms, 255u);
+    if (per_room && (rooms * per_room > 255))
+    {
+        rooms = 255 / per_room;
+        LogE("simulator limited to " << rooms << " rooms, the M-Msg holds 255 devices")
+    }
+    cfg.rooms = rooms;
+
+    std::uniform_real_distribution<double> act(18.0, 23.0);
+    rfaddr_t addr = 0x100000;
+    for (unsigned id = 1; id <= rooms; ++id)
+    {
+        uint8_t rid = uint8_t(id);
+        _p->rooms.push_back(m_room{rid, "Room " + std::to_string(id), addr});
+        if (cfg.wallthermostat)
+            _p->devices.push_back(m_device{devicetype::WallThermostat, addr++,
+                                           "WT" + std::to_string(1000000 + id), "Wall " + std::to_string(id), rid});
+        for (unsigned u = 0; u < cfg.thermostats; ++u)
+            _p->devices.push_back(m_device{devicetype::RadiatorThermostat, addr++,
+                                           "RT" + std::to_string(2000000 + id * 16 + u),
+                                           "Radiator " + std::to_string(id) + '.' + std::to_string(u), rid});
+    }
+
+    for (const m_device &d: _p->devices)
+    {
+        l_submsg_data ld;
+        ld.submsg_src = d.type;
+        ld.rfaddr = d.rfaddr;
+        ld.flags = 0x1018;                  // valid, link ok, auto mode
+        ld.set_temp = _p->settings.comfort;
+        ld.act_temp = std::round(act(_p->rng) * 10) / 10;
+        ld.valve_pos = 0;
+        ld.dateuntil = 0;
+        ld.minutes_since_midnight = 0;
+        _p->ldata.push_back(ld);
+    }
+
+    week_schedule &ws = _p->settings.schedule;
+    for (auto &ds: ws)
+    {
+        for (unsigned x = 0; x < SCHED_POINTS; ++x)
+            ds[x] = schedule_point{x % 2 ? _p->settings.comfort : _p->settings.eco,
+                                   std::min(1440u, 360u + x * 120)};
+    }
+}
+
+void cube_simulator::start_discovery_rx()
+{
+    _p->udp.async_receive_from(ba::buffer(_p->udp_rx, sizeof(_p->udp_rx)), _p->udp_sender,
+        [this](const bs::error_code &ec, std::size_t bytes_recvd)
+        {
+            if (ec == ba::error::operation_aborted)
+                return;
+            if (!ec && is_detect_request(_p->udp_rx, bytes_recvd, _p->cfg.serial))
+            {
+                LogV("simulator discovered by " << _p->udp_sender)
+                // the cube answers to the group, our own response is dropped by its size
+                auto rsp = std::make_shared<std::string>(detect_response(_p->cfg));
+                ba::ip::udp::endpoint group(ba::ip::address::from_string(sim_multicast), _p->cfg.udp_port);
+                ba::ip::udp::socket &from = _p->reply.is_open() ? _p->reply : _p->udp;
+                from.async_send_to(ba::buffer(*rsp), group,
+                    [rsp](const bs::error_code &ec, std::size_t)
+                    {
+                        if (ec)
+                            LogE("simulator discovery response failed: " << ec.message())
+                    });
+            }
+            start_discovery_rx();
+        });
+}
+
+void cube_simulator::start_accept()
+{
+    session_sp ssp = std::make_shared<session>(_p->io);
+    _p->acceptor.async_accept(ssp->sock, [this, ssp](const bs::error_code &ec)
+        {
+            if (ec == ba::error::operation_aborted)
+                return;
+            if (!ec)
+            {
+                ++_p->stats.connects;
+                bs::error_code nec;
+                ssp->sock.set_option(ba::ip::tcp::no_delay(true), nec);
+                LogV("simulator connected to " << ssp->sock.remote_endpoint())
+                auto &sessions = _p->sessions;
+                sessions.erase(std::remove_if(sessions.begin(), sessions.end(),
+                                              [](const std::weak_ptr<session> &w){ return w.expired(); }),
+                               sessions.end());
+                sessions.push_back(ssp);
+                send_burst(ssp);
+                start_rx(ssp);
+                restart_l_timer(ssp);
+            }
+            start_accept();
+        });
+}
+
+void cube_simulator::start_rx(session_sp ssp)
+{
+    ssp->sock.async_read_some(ssp->rxdata.prepare(),
+        [this, ssp](const bs::error_code &ec, std::size_t bytes_recvd)
+        {
+            if (ec)
+            {
+                ssp->l_timer.cancel();
+                return;
+            }
+            ssp->rxdata.commit(bytes_recvd);
+            std::string_view line;
+            while (ssp->rxdata.next_line(line))
+                evaluate_cmd(ssp, line);
+            if (ssp->rxdata.overflow())
+                ssp->rxdata.clear();
+            if (!ssp->closing)
+                start_rx(ssp);
+        });
+}
+
+void cube_simulator::evaluate_cmd(session_sp ssp, std::string_view line)
+{
+    // cube_io writes string literals including their terminating zero
+    while (line.size() && (line[0] == '\0'))
+        line.remove_prefix(1);
+    if ((line.size() < 2) || (line[1] != ':'))
+        return;
+
+    switch (line[0])
+    {
+    case 'l':
+        ++_p->stats.l_cmds;
+        move_values();
+        send_l_msg(ssp);
+        break;
+    case 's':
+        {
+            ++_p->stats.s_cmds;
+            recover_duty();
+            std::string_view b64 = line.substr(2);
+            std::vector<uint8_t> frame(base64::decoded_size(b64.size()));
+            std::size_t len = base64::decode(b64.data(), b64.size(), frame.data());
+            bool failed = (len == base64::invalid) || (len < proto::s_header::size)
+                    || (_p->duty_cycle >= 100) || (_p->pending >= sim_freeslots);
+            if (!failed)
+            {
+                apply_s_cmd(frame.data(), len);
+                ++_p->duty_cycle;
+                ++_p->pending;
+            }
+            else
+                ++_p->stats.s_failed;
+            send(ssp, build_s_reply(_p->duty_cycle, failed, sim_freeslots - _p->pending));
+        }
+        break;
+    case 'f':
+        send(ssp, "F:ntp.homematic.com,ntp.homematic.com");
+        break;
+    case 'q':
+        ++_p->stats.quits;
+        ssp->closing = true;
+        ssp->l_timer.cancel();
+        {
+            bs::error_code ec;
+            ssp->sock.shutdown(ba::ip::tcp::socket::shutdown_both, ec);
+            ssp->sock.close(ec);
+        }
+        break;
+    default:
+        LogV("simulator ignores " << dump(line))
+    }
+}
+
+void cube_simulator::apply_s_cmd(const uint8_t *frame, std::size_t len)
+{
+    using namespace proto;
+
+    if ((s_header::command::get(frame) != s_set_temp) || (len < s_temp_mode::size))
+        return;     // programs are accepted but don't change the L data
+
+    unsigned tm = s_temp_mode::temp_mode::get(frame);
+    unsigned roomid = s_header::room_id::get(frame);
+    rfaddr_t to = s_header::to::get(frame);
+    for (std::size_t u = 0; u < _p->devices.size(); ++u)
+    {
+        const m_device &d = _p->devices[u];
+        if ((roomid && (d.room_id == roomid)) || (d.rfaddr == to) || (!roomid && !to))
+        {
+            l_submsg_data &ld = _p->ldata[u];
+            ld.set_temp = (tm & 0x3f) / 2.0;
+            ld.flags = uint16_t((ld.flags & ~3u) | (tm >> 6));
+        }
+    }
+}
+
+// a random walk of the actual temperatures, valves follow the difference to the set point
+void cube_simulator::move_values()
+{
+    std::uniform_int_distribution<int> step(-2, 2);
+    std::uniform_int_distribution<int> noise(-5, 5);
+    for (l_submsg_data &ld: _p->ldata)
+    {
+        if (_p->cfg.quiet)
+            break;
+        if (ld.submsg_src == devicetype::WallThermostat)
+            ld.act_temp = std::clamp(ld.act_temp + step(_p->rng) / 10.0, 5.0, 30.0);
+        else if (ld.submsg_src == devicetype::RadiatorThermostat)
+        {
+            double diff = ld.set_temp - ld.act_temp;
+            ld.valve_pos = uint16_t(std::clamp(int(diff * 40) + noise(_p->rng), 0, 100));
+            ld.act_temp = std::clamp(ld.act_temp + step(_p->rng) / 10.0, 5.0, 30.0);
+        }
+    }
+    // the radio budget recovers over time
+    if (_p->duty_cycle && !_p->cfg.duty_recovery.count())
+        --_p->duty_cycle;
+    _p->pending = 0;
+}
+
+void cube_simulator::recover_duty()
+{
+    auto interval = _p->cfg.duty_recovery;
+    if (!interval.count())
+        return;
+    auto now = std::chrono::steady_clock::now();
+    auto steps = (now - _p->duty_time) / interval;
+    if (!_p->duty_cycle || (steps >= _p->duty_cycle))
+    {
+        _p->duty_cycle = 0;
+        _p->duty_time = now;
+        return;
+    }
+    _p->duty_cycle -= unsigned(steps);
+    _p->duty_time += steps * interval;
+}
+
+void cube_simulator::send_burst(session_sp ssp)
+{
+    send(ssp, build_h_msg(_p->cfg.serial, _p->cfg.rfaddr, _p->cfg.fwversion,
+                          uint16_t(_p->duty_cycle), uint16_t(sim_freeslots - _p->pending)));
+    for (auto &m: build_m_msgs(_p->rooms, _p->devices))
+        send(ssp, std::move(m));
+    for (const m_device &d: _p->devices)
+        send(ssp, build_c_msg(d, _p->settings));
+    send_l_msg(ssp);
+}
+
+void cube_simulator::send_l_msg(session_sp ssp)
+{
+    send(ssp, build_l_msg(_p->ldata));
+}
+
+void cube_simulator::restart_l_timer(session_sp ssp)
+{
+    if (_p->cfg.l_interval.count() == 0)
+        return;
+    ssp->l_timer.expires_after(_p->cfg.l_interval);
+    ssp->l_timer.async_wait([this, ssp](const bs::error_code &ec)
+        {
+            if (ec || ssp->closing)
+                return;
+            move_values();
+            send_l_msg(ssp);
+            restart_l_timer(ssp);
+        });
+}
+
+void cube_simulator::send(session_sp ssp, std::string line)
+{
+    if (ssp->closing)
+        return;
+    line += "\r\n";
+    ssp->txq.push_back(std::move(line));
+    ++_p->stats.lines_sent;
+    if (ssp->txq.size() == 1)
+        send_next(ssp);
+}
+
+void cube_simulator::send_next(session_sp ssp)
+{
+    ba::async_write(ssp->sock, ba::buffer(ssp->txq.front()),
+        [this, ssp](const bs::error_code &ec, std::size_t)
+        {
+            if (ec)
+            {
+                ssp->txq.clear();
+                return;
+            }
+            ssp->txq.pop_front();
+            if (!ssp->txq.empty())
+                send_next(ssp);
+        });
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef CUBE_SIM_H
+#define CUBE_SIM_H
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "cube_types.h"
+
+namespace max_eq3 {
+
+/**
+ * Stand-in for a MAX! Cube on the local host.
+ *
+ * Answers the discovery request on the udp port, accepts connections on
+ * the tcp port and sends the H/M/C/L burst of a generated house to every
+ * client. l:, s:, f: and q: are served like the cube does, all other
+ * commands are ignored.
+ *
+ * The M-Msg carries the room and device counts in single bytes, so a
+ * house is limited to 255 devices.
+ */
+
+struct sim_config
+{
+    std::string     serial{"KEQ0000001"};
+    rfaddr_t        rfaddr{0x0abcde};
+    uint16_t        fwversion{0x0113};
+
+    unsigned        rooms{12};
+    unsigned        thermostats{2};         // radiator thermostats per room
+    bool            wallthermostat{true};   // one per room
+
+    // L-Msg sent without a request, 0: only on l:
+    std::chrono::milliseconds
+                    l_interval{0};
+    unsigned        seed{1};                // random temperatures and valve moves
+    bool            quiet{false};           // values only change by s:, a house at night
+
+    // every accepted s: uses one percent of the duty cycle budget, one percent
+    // is recovered per interval, 0: per l: command
+    std::chrono::milliseconds
+                    duty_recovery{0};
+
+    uint16_t        udp_port{23272};
+    uint16_t        tcp_port{62910};
+
+    // empty: any address, discovery answered from the shared udp socket.
+    // Several simulators on one host use their own (127.0.0.x) address,
+    // the tcp port is bound to it and discovery is answered from it.
+    std::string     address;
+};
+
+struct sim_stats
+{
+    std::atomic<std::size_t>    connects{0};
+    std::atomic<std::size_t>    lines_sent{0};
+    std::atomic<std::size_t>    l_cmds{0};
+    std::atomic<std::size_t>    s_cmds{0};
+    std::atomic<std::size_t>    s_failed{0};    // refused on exhausted duty cycle
+    std::atomic<std::size_t>    quits{0};       // q: of a client leaving
+};
+
+class cube_simulator
+{
+public:
+    explicit cube_simulator(const sim_config &cfg);
+    ~cube_simulator();
+
+    // opens the sockets and starts the io thread
+    bool start();
+    // closes the client connections too, like a reboot
+    void stop();
+
+    // the room count is reduced to what fits into the M-Msg
+    const sim_config &config() const;
+    const sim_stats &stats() const;
+
+private:
+    struct session;
+    using session_sp = std::shared_ptr<session>;
+
+    void generate_house();
+    void start_discovery_rx();
+    void start_accept();
+    void start_rx(session_sp ssp);
+    void evaluate_cmd(session_sp ssp, std::string_view line);
+    void send(session_sp ssp, std::string line);
+    void send_next(session_sp ssp);
+    void send_burst(session_sp ssp);
+    void send_l_msg(session_sp ssp);
+    void apply_s_cmd(const uint8_t *frame, std::size_t len);
+    void move_values();
+    void recover_duty();
+    void restart_l_timer(session_sp ssp);
+
+    struct Private;
+    std::unique_ptr<Private> _p;
+};
+
+}
+
+#endif // CUBE_SIM_H
@@ -2,9 +2,11 @@
 #define CUBE_TYPES_H
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <initializer_list>
 #include <memory>
-#include <set>
+#include <string>
 #include <chrono>
 
 namespace max_eq3 {
@@ -27,11 +29,86 @@ enum struct opmode {
     BOOST,
 };
 
-using changeflag_set = std::set<changeflags>;
+/**
+ * @brief The changeflag_set class
+ * set of changeflags held in a bit mask, iterates in enum order
+ */
+class changeflag_set
+{
+public:
+    using mask_type = uint8_t;
+
+    class const_iterator
+    {
+    public:
+        constexpr explicit const_iterator(mask_type rest) : _rest(rest) {}
+        constexpr changeflags operator*() const
+        {
+            unsigned u = 0;
+            while (!(_rest & (1u << u)))
+                ++u;
+            return changeflags(u);
+        }
+        constexpr const_iterator &operator++()
+        {
+            _rest &= mask_type(_rest - 1);      // drop the lowest flag
+            return *this;
+        }
+        constexpr bool operator==(const const_iterator &rhs) const { return _rest == rhs._rest; }
+        constexpr bool operator!=(const const_iterator &rhs) const { return _rest != rhs._rest; }
+    private:
+        mask_type _rest;
+    };
+
+    constexpr changeflag_set() = default;
+    constexpr changeflag_set(std::initializer_list<changeflags> flags)
+    {
+        for (changeflags f: flags)
+            insert(f);
+    }
+
+    constexpr void insert(changeflags f) { _mask |= bit(f); }
+    constexpr void insert(changeflag_set other) { _mask |= other._mask; }
+    constexpr void erase(changeflags f) { _mask &= mask_type(~bit(f)); }
+    constexpr void clear() { _mask = 0; }
+
+    constexpr bool count(changeflags f) const { return _mask & bit(f); }
+    constexpr bool empty() const { return !_mask; }
+    constexpr std::size_t size() const
+    {
+        std::size_t n = 0;
+        for (mask_type m = _mask; m; m &= mask_type(m - 1))
+            ++n;
+        return n;
+    }
+    constexpr mask_type mask() const { return _mask; }
+
+    constexpr const_iterator begin() const { return const_iterator(_mask); }
+    constexpr const_iterator end() const { return const_iterator(0); }
+
+    constexpr bool operator==(const changeflag_set &rhs) const { return _mask == rhs._mask; }
+    constexpr bool operator!=(const changeflag_set &rhs) const { return _mask != rhs._mask; }
+
+private:
+    static constexpr mask_type bit(changeflags f) { return mask_type(1u << unsigned(f)); }
+
+    mask_type _mask{0};
+};
+
+static_assert(changeflag_set{changeflags::mode, changeflags::set_temp}.size() == 2, "changeflag_set broken");
+static_assert(*changeflag_set{changeflags::valve_pos, changeflags::act_temp}.begin() == changeflags::act_temp,
+              "changeflag_set has to iterate in enum order");
+
 struct schedule_point
 {
     double temp;
     unsigned minutes_since_midnight;
+
+    bool operator==(const schedule_point &rhs) const
+    {
+        return (temp == rhs.temp) && (minutes_since_midnight == rhs.minutes_since_midnight);
+    }
+    bool operator!=(const schedule_point &rhs) const { return !(*this == rhs); }
 };
 
 enum struct days {
@@ -50,19 +127,25 @@ enum struct days {
 using day_schedule = std::array<schedule_point, SCHED_POINTS>;
 using week_schedule = std::array<day_schedule, DAYS_A_WEEK>;
 
+// schedules are shared between devices and room snapshots, replaced on change only
+using schedule_sp = std::shared_ptr<const week_schedule>;
+
 using timestamped_valve_pos = std::pair<uint16_t, std::chrono::system_clock::time_point>;
 using timestamped_temp = std::pair<double, std::chrono::system_clock::time_point>;
 
 typedef struct room
 {
+    std::string         cube;                   // serial of the cube, rooms are named per cube
     std::string         name;
     timestamped_temp    set_temp;
     timestamped_temp    actual_temp;
     opmode              mode{opmode::AUTO};
     timestamped_valve_pos
-                        valve_pos;
+                        valve_pos;              // average of the thermostats
+    uint16_t            valve_min{0};
+    uint16_t            valve_max{0};           // the figure the boiler demand follows
 
-    week_schedule       schedule;
+    schedule_sp         schedule;               // empty until a C-Msg was received
 
     unsigned            version;                // increments with every creation
     changeflag_set      changed;
@@ -71,7 +154,8 @@ typedef struct room
     {}
 } room;
 
-using room_sp = std::shared_ptr<room>;
+// snapshots are immutable once emitted
+using room_sp = std::shared_ptr<const room>;
 
 typedef struct device
 {
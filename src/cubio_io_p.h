@@ -2,9 +2,15 @@
 #define CUBIO_IO_P_H
 #pragma once
 
+#include <atomic>
+#include <future>
 #include <map>
+#include <mutex>
+#include <vector>
+#include <string_view>
 #include <thread>
 #include <memory>
+#include <utility>
 
 #include <boost/asio.hpp>
 
@@ -13,37 +19,62 @@ namespace bs = boost::system;
 
 #include "cube_io.h"
 #include "dev_store.h"
+#include "msg_parser.h"
+#include "capture.h"
+#include "block_pool.h"
+#include "discovery.h"
 
 namespace max_eq3 {
 
 using cube_sp = std::shared_ptr<cube_t>;
 
-using cube_map_t = std::map<rfaddr_t, cube_sp>;
-
-struct m_room
-{
-    uint8_t id;             // 1 .. x
-
-    std::string name;       // name of room
+// serializes the handlers and the session of one cube
+using cube_strand = ba::strand<ba::io_context::executor_type>;
 
-    /**
-     * @brief group_rfaddr
-     * this ist the rfaddr of the device first assigned to this room
-     */
-    rfaddr_t group_rfaddr;
-};
+using cube_map_t = std::map<rfaddr_t, cube_sp>;
 
 /**
- * @brief The m_device struct
- * filled from response 'm'
+ * @brief The m_msg_assembler struct
+ * collects the chunks of a multipart M-Msg ("M:<index>,<count>,<data>"),
+ * the base64 data has to be joined before it is decoded
  */
-struct m_device
+struct m_msg_assembler
 {
-    devicetype  type;
-    rfaddr_t    rfaddr;
-    std::string serial;
-    std::string name;
-    uint8_t     room_id;
+    std::vector<std::string> chunks;
+    std::vector<bool> received;         // by index, a chunk may be empty
+    unsigned missing{0};
+
+    // returns true if the last missing chunk has been added
+    bool add(unsigned idx, unsigned cnt, std::string_view data)
+    {
+        if ((idx == 0) || (cnt != chunks.size()))
+        {
+            chunks.resize(cnt);
+            reset();
+        }
+        if (idx >= chunks.size())
+            return false;
+        if (!received[idx])
+        {
+            received[idx] = true;
+            --missing;
+        }
+        chunks[idx].assign(data.data(), data.size());
+        return missing == 0;
+    }
+    void joined(std::string &out) const
+    {
+        out.clear();
+        for (const auto &c: chunks)
+            out += c;
+    }
+    void reset()
+    {
+        for (auto &c: chunks)
+            c.clear();
+        received.assign(chunks.size(), false);
+        missing = chunks.size();
+    }
 };
 
 enum cnf_tags : uint16_t {
@@ -53,8 +84,13 @@ enum cnf_tags : uint16_t {
 struct cube_io::Private
 {
     std::string                     serial;
-    std::thread                     comthread;
-    boost::asio::io_service         io;
+    std::unique_ptr<ba::io_service> own_io;         // standalone and offline instances
+    boost::asio::io_service        &io;
+    cube_strand                     strand{io.get_executor()};
+    std::thread::id                 io_id;          // the only thread running io, none when
+                                                    // offline or run by several
+    cube_manager                   *manager{nullptr};
+                                                    // discovery and io pool of the manager
     boost::asio::ip::udp::socket    socket{io};
 
     uint8_t                         recvline[32];   // initial udp acceptance buffer for broadcast response
@@ -64,29 +100,118 @@ struct cube_io::Private
     boost::asio::steady_timer       mcast_timeout;
 
     std::thread                     io_thread;
+    bool                            own_thread{false};
+                                                    // set before io_thread starts
+    std::recursive_mutex            offline_lock;   // the store of an offline instance, fed by
+                                                    // replay on its own thread, see on_io_thread
 
     cube_event_target              *iet{nullptr};
 
-    std::map<rfaddr_t, m_device>    device_defs;    // filled by M-Msg
-    std::map<rfaddr_t, l_submsg_data>
-                                    device_data;    // filled by L-Msg
+    std::string                     l_decoded;      // reused decode buffer for L-Msg
+    std::string                     c_decoded;      // reused decode buffer for C-Msg
+    m_msg_assembler                 m_assembler;    // M-Msg chunks
+    std::string                     m_encoded;      // joined M-Msg chunks
+    std::string                     m_decoded;
+    std::vector<m_room>             m_rooms;        // filled by M-Msg, sized by its header
+    std::vector<m_device>           m_devices;
 
     device_data_store               devconfigs;
 
     device_sp                       deviceinfo;
     std::map<unsigned, room_sp>     emit_rooms;
-    std::map<unsigned, changeflag_set>
-                                    changeset;
-
-    bool                            short_refresh{false};
+    std::shared_ptr<block_pool>     room_pool{std::make_shared<block_pool>()};
+                                                    // room snapshots
+    std::vector<schedule_sp>        schedules;      // interned, see dev_config::schedule
+    rcu_cell<room_table>            room_state;     // published by emit_changed_data
+    std::shared_ptr<const room_index>
+                                    room_ids;       // of the current room configuration
+    std::vector<changeflag_set>     changeset;      // indexed by room id
+
+    // l: asked for by accepted commands, see cube_io::plan_refresh
+    bool                            refresh_pending{false};
+    std::chrono::steady_clock::time_point
+                                    refresh_first;  // first S-Msg of the burst
+    std::chrono::steady_clock::time_point
+                                    refresh_last;
+    refresh_policy                  refresh;        // interval of the periodic poll
+    refresh_state                   refresh_reported;
+    std::size_t                     l_hash{0};      // of the last L-Msg, unchanged ones don't count
 
     cube_sp                         cube;
+    std::atomic<bool>               linked{false};  // connected or connecting, read by the manager
+    cube_sp                         known;          // last cube found, reconnected without discovery
+    cube_sp                         found;          // answer to a discovery, taken by the session
+    bool                            stopping{false};    // close_session ran, the session ends
+    unsigned                        tasks{0};       // running session coroutines
+    std::promise<void>              stopped;        // the last of them ended after close_session
+    ba::steady_timer                found_signal{io};
+                                                    // cancelled by cube_io::found
+    session_config                  session_cfg;
+    session_timing                  timing;         // timing.phase is the current one
+    std::chrono::steady_clock::time_point
+                                    phase_since;
+    std::chrono::steady_clock::time_point
+                                    lost_at;        // of the link, for timing.outage
+    unsigned                        phase_seq{0};   // a timer of an earlier phase is stale
+    ba::steady_timer                phase_timer{io};
+    reconnect_backoff               backoff;
+
+    command_queue                   commands;       // outbound S-Msgs
+    ba::steady_timer                command_timer{io};
+
+    // temp and mode changes settling by room id, latest wins, see stage_change
+    struct pending_change
+    {
+        std::optional<double>       temp;
+        std::optional<opmode>       mode;
+        command_priority            prio{command_priority::low};
+        completions                 done;           // of all merged changes
+        std::chrono::steady_clock::time_point
+                                    first;
+        std::chrono::steady_clock::time_point
+                                    due;
+    };
+    std::map<unsigned, pending_change>
+                                    pending_changes;
+    ba::steady_timer                settle_timer{io};
+
+    // accepted commands waiting for the L-Msg showing them
+    struct confirmation
+    {
+        completions                 done;
+        std::function<bool()>       shown;
+        command_result              sent;
+        unsigned                    polls{0};       // L-Msgs without them
+        unsigned                    key{0};         // room, see command_queue::command
+    };
+    std::vector<confirmation>       confirming;
+
+    std::shared_ptr<capture_writer> capture;        // session recording, io thread only
+
+    // warm start state, the lines defining the current configuration and values
+    std::string                     state_path;     // empty: no state kept
+    std::string                     state_m_line;   // joined M-Msg
+    std::vector<std::string>        state_c_lines;  // indexed by device slot
+    std::string                     state_l_line;
+    bool                            state_dirty{false};
+    bool                            state_restoring{false};
+                                                    // warm_start replays the file
+    ba::steady_timer                state_timer{io};    // written at most every state_interval
+    bool                            state_armed{false};
+    static constexpr std::chrono::seconds
+                                    state_interval{10};
 
     unsigned                        confread { 0 };
     std::set<cnf_tags>              rcvd_configs { rd_timeserver };
-    Private()
-        : mcast_timeout(io)
+    // io of the manager's pool, an own one without
+    explicit Private(ba::io_service *shared = nullptr)
+        : own_io(shared ? nullptr : new ba::io_service)
+        , io(shared ? *shared : *own_io)
+        , mcast_timeout(io)
     {}
+
+    // neither an own io thread nor the manager's
+    bool offline() const { return !manager && !own_thread; }
 };
 }
 #endif // CUBIO_IO_P_H
@@ -2,9 +2,14 @@
 #define DEV_STORE_H
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <map>
 #include <set>
+#include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
 #include "cube_io.h"
 
 namespace max_eq3 {
@@ -39,6 +44,7 @@ typedef struct dev_config
     uint16_t        room_id;
     uint16_t        fwversion;
     dev_config_v    specific;
+    schedule_sp     schedule;                   // interned copy of the specific schedule
 } dev_config;
 
 typedef struct room_conf
@@ -66,6 +72,20 @@ typedef struct room_data
 
     timestamped_valve_pos_by_rfaddr valve_pos;
 
+    // aggregates of valve_pos, kept up to date by change()
+    uint32_t        valve_sum{0};
+    uint16_t        valve_min{0};
+    uint16_t        valve_max{0};
+    std::chrono::system_clock::time_point
+                    valve_newest;
+
+    // average over the thermostats with the time of the newest position
+    timestamped_valve_pos valve_avg() const
+    {
+        uint16_t avg = valve_pos.empty() ? 0 : uint16_t(valve_sum / valve_pos.size());
+        return timestamped_valve_pos(avg, valve_newest);
+    }
+
     bool operator!=(const room_data &rhs) const
     {
         return ((act != rhs.act)
@@ -104,49 +124,298 @@ typedef struct room_data
 
     bool change(rfaddr_t key, uint16_t vpos, changeflag_set &cfs)
     {
+        auto it = valve_pos.find(key);
+        if ((it != valve_pos.end()) && (it->second.first == vpos))
+            return false;
+        auto now = std::chrono::system_clock::now();
+        if (it == valve_pos.end())
+        {
+            bool first = valve_pos.empty();
+            valve_pos.emplace(key, std::make_pair(vpos, now));
+            valve_sum += vpos;
+            valve_min = first ? vpos : std::min(valve_min, vpos);
+            valve_max = first ? vpos : std::max(valve_max, vpos);
+        }
+        else
+        {
+            uint16_t old = it->second.first;
+            it->second = std::make_pair(vpos, now);
+            valve_sum = valve_sum - old + vpos;
+            // only a thermostat leaving an extreme needs a scan (of a few)
+            if (((old == valve_max) && (vpos < old)) || ((old == valve_min) && (vpos > old)))
+                rescan_valve_extremes();
+            else
+            {
+                valve_min = std::min(valve_min, vpos);
+                valve_max = std::max(valve_max, vpos);
+            }
+        }
+        valve_newest = now;
+        cfs.insert(changeflags::valve_pos);
+        return true;
+    }
 
-        if ((valve_pos.find(key) == valve_pos.end()) ||
-                (valve_pos[key].first != vpos))
+    void rescan_valve_extremes()
+    {
+        valve_min = valve_pos.empty() ? 0 : valve_pos.begin()->second.first;
+        valve_max = valve_min;
+        for (const auto &v: valve_pos)
         {
-            valve_pos[key] = std::make_pair(vpos, std::chrono::system_clock::now());
-            cfs.insert(changeflags::valve_pos);
-            return true;
+            valve_min = std::min(valve_min, v.second.first);
+            valve_max = std::max(valve_max, v.second.first);
         }
-        return false;
     }
 } room_data;
 
+/**
+ * @brief The rfaddr_index class
+ * maps the 24 bit rfaddrs to slot numbers, open addressing with linear
+ * probing. Entries are never removed, devices only get added by M/C-Msgs.
+ */
+class rfaddr_index
+{
+public:
+    static constexpr std::size_t npos = std::size_t(-1);
+
+    std::size_t find(rfaddr_t addr) const
+    {
+        if (_entries.empty())
+            return npos;
+        for (std::size_t pos = home(addr); ; pos = (pos + 1) & _mask)
+        {
+            const entry &e = _entries[pos];
+            if (e.addr == addr)
+                return e.slot;
+            if (e.addr == empty)
+                return npos;
+        }
+    }
+
+    // addr must not be in the index yet
+    void insert(rfaddr_t addr, std::size_t slot)
+    {
+        if (2 * (_used + 1) > _entries.size())
+            grow();
+        std::size_t pos = home(addr);
+        while (_entries[pos].addr != empty)
+            pos = (pos + 1) & _mask;
+        _entries[pos] = entry{addr, uint32_t(slot)};
+        ++_used;
+    }
+
+    std::size_t size() const { return _used; }
+
+private:
+    static constexpr rfaddr_t empty = rfaddr_t(-1);     // no valid 24 bit address
+
+    struct entry
+    {
+        rfaddr_t    addr;
+        uint32_t    slot;
+    };
+
+    std::size_t home(rfaddr_t addr) const
+    {
+        return (addr * 0x9e3779b1u) >> _shift & _mask;
+    }
+
+    void grow()
+    {
+        std::vector<entry> old;
+        old.swap(_entries);
+        std::size_t cap = old.empty() ? 64 : 2 * old.size();
+        _entries.assign(cap, entry{empty, 0});
+        _mask = cap - 1;
+        _shift = 32;
+        while (cap > 1) { cap >>= 1; --_shift; }
+        _used = 0;
+        for (const entry &e: old)
+            if (e.addr != empty)
+                insert(e.addr, e.slot);
+    }
+
+    std::vector<entry>  _entries;
+    std::size_t         _mask{0};
+    unsigned            _shift{32};
+    std::size_t         _used{0};
+};
+
+/**
+ * @brief The room_name_index class
+ * maps room names to room ids, open addressing with linear probing.
+ * The names are not copied, an entry keeps the hash and the id of the
+ * room_conf holding the name. Rebuilt whenever the rooms change.
+ */
+class room_name_index
+{
+public:
+    void rebuild(const std::vector<room_conf> &rooms)
+    {
+        std::size_t cap = 16;
+        while (cap < 2 * rooms.size())
+            cap *= 2;
+        _entries.assign(cap, entry{0, 0});
+        _mask = cap - 1;
+        for (const room_conf &rc: rooms)
+        {
+            if (!rc.id)
+                continue;
+            std::size_t h = hash(rc.name);
+            std::size_t pos = h & _mask;
+            while (_entries[pos].id)
+                pos = (pos + 1) & _mask;
+            _entries[pos] = entry{h, rc.id};
+        }
+    }
+
+    // id of the room with the given name, 0 if there is none
+    unsigned find(std::string_view name, const std::vector<room_conf> &rooms) const
+    {
+        if (_entries.empty())
+            return 0;
+        std::size_t h = hash(name);
+        for (std::size_t pos = h & _mask; _entries[pos].id; pos = (pos + 1) & _mask)
+        {
+            const entry &e = _entries[pos];
+            if ((e.hash == h) && (rooms[e.id].name == name))
+                return e.id;
+        }
+        return 0;
+    }
+
+private:
+    static std::size_t hash(std::string_view name)
+    {
+        return std::hash<std::string_view>()(name);
+    }
+
+    struct entry
+    {
+        std::size_t hash;
+        unsigned    id;         // 0: empty
+    };
+
+    std::vector<entry>  _entries;
+    std::size_t         _mask{0};
+};
+
+/**
+ * @brief The device_data_store struct
+ * structure of arrays, the device vectors share the slot found through
+ * the rfaddr index, rooms are indexed by their id (1..N, 0 is unused).
+ */
 typedef struct device_data_store
 {
-    using devicemap = std::map<rfaddr_t, dev_config>;
-    using roomconfmap = std::map<unsigned, room_conf>;
-    using roomdatamap = std::map<unsigned, room_data>;
+    static constexpr std::size_t npos = rfaddr_index::npos;
+
+    // device slots
+    std::vector<rfaddr_t>       dev_rfaddr;
+    std::vector<uint16_t>       dev_room;           // room id, 0: not assigned
+    std::vector<l_submsg_data>  dev_data;           // last L-Msg record
+    std::vector<dev_config>     devconf;            // M- and C-Msg data
+    std::vector<history_set>    dev_history;
+
+    // room slots
+    std::vector<room_conf>      roomconf;
+    std::vector<room_data>      rooms;
+    std::vector<history_set>    room_history;
+
+    rfaddr_index                index;
+    room_name_index             room_names;
+    unsigned                    room_generation{0}; // incremented by index_rooms() on changes
+    std::vector<std::string>    indexed_names;      // by room id, as of the last index_rooms()
+
+    std::size_t find(rfaddr_t addr) const
+    {
+        return index.find(addr);
+    }
+
+    // slot of the device, a new one is appended for unknown addresses
+    std::size_t insert(rfaddr_t addr)
+    {
+        std::size_t slot = index.find(addr);
+        if (slot != npos)
+            return slot;
+        slot = dev_rfaddr.size();
+        dev_rfaddr.push_back(addr);
+        dev_room.push_back(0);
+        dev_data.emplace_back();
+        devconf.emplace_back();
+        devconf.back().rfaddr = addr;
+        dev_history.emplace_back();
+        index.insert(addr, slot);
+        return slot;
+    }
+
+    void set_room(std::size_t slot, uint16_t room_id)
+    {
+        dev_room[slot] = room_id;
+        devconf[slot].room_id = room_id;
+    }
 
-    devicemap devconf;
+    bool has_room(unsigned id) const
+    {
+        return id && (id < roomconf.size()) && (roomconf[id].id == id);
+    }
+
+    room_conf &add_room(unsigned id)
+    {
+        if (id >= roomconf.size())
+        {
+            roomconf.resize(id + 1);
+            rooms.resize(id + 1);
+            room_history.resize(id + 1);
+        }
+        roomconf[id].id = id;
+        return roomconf[id];
+    }
+
+    // has to be called after rooms were added or renamed, the room handles
+    // stay valid unless a room id or name changed (a reconnect sends the same)
+    void index_rooms()
+    {
+        room_names.rebuild(roomconf);
+        std::vector<std::string> names(roomconf.size());
+        for (const room_conf &rc: roomconf)
+        {
+            if (rc.id)
+                names[rc.id] = rc.name;
+        }
+        if (names != indexed_names)
+        {
+            indexed_names = std::move(names);
+            ++room_generation;
+        }
+    }
 
-    roomconfmap roomconf;
+    unsigned room_id(std::string_view name) const
+    {
+        return room_names.find(name, roomconf);
+    }
 
-    roomdatamap rooms;
+    // room of the device in the given slot, nullptr if it has none (yet)
+    room_conf *room_of(std::size_t slot)
+    {
+        unsigned id = dev_room[slot];
+        return has_room(id) ? &roomconf[id] : nullptr;
+    }
 
     std::string room_from_rfaddr(rfaddr_t addr)
     {
-        auto devitr = devconf.find(addr);
-        if (devitr != devconf.end())
+        std::size_t slot = find(addr);
+        if (slot != npos)
         {
-            auto rconfitr = roomconf.find(devitr->second.room_id);
-            if (rconfitr != roomconf.end())
-                return rconfitr->second.name;
+            if (const room_conf *rc = room_of(slot))
+                return rc->name;
         }
         return std::string();
     }
 
     std::string dev_name_from_rfaddr(rfaddr_t rfaddr)
     {
-        devicemap::const_iterator cit = devconf.find(rfaddr);
-        if (cit != devconf.end())
-        {
-            return cit->second.name;
-        }
+        std::size_t slot = find(rfaddr);
+        if (slot != npos)
+            return devconf[slot].name;
         return std::string();
     }
 }   device_data_store;
@@ -0,0 +1,88 @@
+
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "discovery.h"
+#include "cube_log_internal.h"
+
+namespace ba = boost::asio;
+namespace bs = boost::system;
+
+namespace max_eq3 {
+
+namespace {
+
+const char *discovery_multicast = "224.0.0.1";
+
+}
+
+std::string discovery_request(const std::string &serial)
+{
+    std::string req("eQ3Max*\0", 8);
+    req += serial.size() ? serial : std::string(10, '*');
+    req += 'I';
+    return req;
+}
+
+std::vector<ba::ip::address_v4> discovery_interfaces()
+{
+    std::vector<ba::ip::address_v4> result;
+    ifaddrs *ifa = nullptr;
+    if (getifaddrs(&ifa) != 0)
+        return result;
+    for (ifaddrs *i = ifa; i; i = i->ifa_next)
+    {
+        if (!i->ifa_addr || (i->ifa_addr->sa_family != AF_INET))
+            continue;
+        if (!(i->ifa_flags & IFF_UP) || !(i->ifa_flags & IFF_MULTICAST))
+            continue;
+        const sockaddr_in *sin = reinterpret_cast<const sockaddr_in *>(i->ifa_addr);
+        ba::ip::address_v4 addr(ntohl(sin->sin_addr.s_addr));
+        if (std::find(result.begin(), result.end(), addr) == result.end())
+            result.push_back(addr);
+    }
+    freeifaddrs(ifa);
+    return result;
+}
+
+void send_discovery(ba::io_service &io, const std::string &serial)
+{
+    auto req = std::make_shared<std::string>(discovery_request(serial));
+    ba::ip::udp::endpoint group(ba::ip::address::from_string(discovery_multicast), discovery_port);
+
+    std::vector<ba::ip::address_v4> interfaces = discovery_interfaces();
+    if (interfaces.empty())
+        interfaces.push_back(ba::ip::address_v4::any());       // default route
+
+    for (const auto &addr: interfaces)
+    {
+        auto sock = std::make_shared<ba::ip::udp::socket>(io);
+        bs::error_code ec;
+        sock->open(ba::ip::udp::v4(), ec);
+        if (!ec)
+            sock->bind(ba::ip::udp::endpoint(addr, 0), ec);
+        if (!ec && !addr.is_unspecified())
+            sock->set_option(ba::ip::multicast::outbound_interface(addr), ec);
+        if (!ec)
+            sock->set_option(ba::ip::multicast::enable_loopback(true), ec);
+        if (ec)
+        {
+            LogE("can't send discovery on " << addr << ": " << ec.message())
+            continue;
+        }
+        LogV("discovery on " << addr)
+        sock->async_send_to(ba::buffer(*req), group,
+            [req, sock, addr](const bs::error_code &ec, std::size_t)
+            {
+                if (ec)
+                    LogE("discovery request on " << addr << " failed: " << ec.message())
+            });
+    }
+}
+
+}
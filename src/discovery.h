@@ -0,0 +1,73 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace max_eq3 {
+
+constexpr uint16_t discovery_port = 23272;
+constexpr std::size_t discovery_response_size = 26;
+
+// "eQ3Max*\0" <serial or 10 '*'> "I"
+std::string discovery_request(const std::string &serial);
+
+// addresses of the IPv4 interfaces that are up and able to multicast
+std::vector<boost::asio::ip::address_v4> discovery_interfaces();
+
+/**
+ * @brief send_discovery
+ * sends the request to the multicast group on every interface at once, by
+ * the default route if none is found. The answers arrive at the discovery
+ * port, the sockets are closed when their send completed.
+ */
+void send_discovery(boost::asio::io_service &io, const std::string &serial);
+
+/**
+ * @brief The reconnect_backoff class
+ * delays of the reconnect attempts after a lost connection, the first one
+ * is immediate, then base doubled per failure up to max, +-20% jitter
+ * keeps several gateways from retrying in lock step
+ */
+class reconnect_backoff
+{
+public:
+    explicit reconnect_backoff(std::chrono::milliseconds base = std::chrono::milliseconds(250),
+                               std::chrono::milliseconds max = std::chrono::seconds(5))
+        : _base(base)
+        , _max(max)
+        , _rng(std::random_device()())
+    {}
+
+    std::chrono::milliseconds next()
+    {
+        if (_failures++ == 0)
+            return std::chrono::milliseconds(0);
+        auto d = _base;
+        for (unsigned u = 1; (u < _failures - 1) && (d < _max); ++u)
+            d *= 2;
+        d = std::min(d, _max);
+        std::uniform_real_distribution<double> jitter(0.8, 1.2);
+        return std::chrono::milliseconds(std::chrono::milliseconds::rep(d.count() * jitter(_rng)));
+    }
+
+    unsigned failures() const { return _failures; }
+    void reset() { _failures = 0; }
+
+private:
+    std::chrono::milliseconds   _base;
+    std::chrono::milliseconds   _max;
+    unsigned                    _failures{0};
+    std::minstd_rand            _rng;
+};
+
+}
+
+#endif // DISCOVERY_H
@@ -0,0 +1,185 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace max_eq3 {
+
+enum struct history_series : uint8_t {
+    act_temp,
+    set_temp,
+    valve_pos,
+    mode,
+};
+
+constexpr std::size_t history_series_count = 4;
+
+struct history_sample
+{
+    std::chrono::system_clock::time_point   time;
+    double                                  value;
+};
+
+/**
+ * @brief The history_query struct
+ * samples of one series in [from, to], only the newest last_n if last_n != 0
+ */
+struct history_query
+{
+    using time_point = std::chrono::system_clock::time_point;
+
+    history_series  series{history_series::act_temp};
+    time_point      from{time_point::min()};
+    time_point      to{time_point::max()};
+    std::size_t     last_n{0};
+};
+
+struct history_stats
+{
+    std::size_t samples{0};
+    double      min{0.0};
+    double      max{0.0};
+    double      avg{0.0};           // weighted by the time a value was held
+};
+
+/**
+ * @brief summarize
+ * min/max/avg of samples in time order, the last value counts as held
+ * until the given end
+ */
+inline history_stats summarize(const std::vector<history_sample> &samples,
+                               std::chrono::system_clock::time_point end)
+{
+    history_stats st;
+    st.samples = samples.size();
+    if (samples.empty())
+        return st;
+    st.min = st.max = samples.front().value;
+    double weighted = 0.0;
+    double total = 0.0;
+    for (std::size_t u = 0; u < samples.size(); ++u)
+    {
+        const history_sample &s = samples[u];
+        st.min = std::min(st.min, s.value);
+        st.max = std::max(st.max, s.value);
+        auto until = (u + 1 < samples.size()) ? samples[u + 1].time : std::max(end, s.time);
+        double held = std::chrono::duration<double>(until - s.time).count();
+        weighted += held * s.value;
+        total += held;
+    }
+    if (total > 0.0)
+        st.avg = weighted / total;
+    else
+        st.avg = samples.back().value;
+    return st;
+}
+
+/**
+ * @brief The history_ring class
+ * bounded history of one value, a sample is added when the value changes.
+ * The oldest sample is kept absolute, every newer one as delta to its
+ * predecessor (milliseconds and tenths), 8 bytes each. When the ring is
+ * full the oldest sample is folded into the base.
+ */
+class history_ring
+{
+public:
+    using clock = std::chrono::system_clock;
+
+    explicit history_ring(std::size_t capacity = 256)
+        : _capacity(std::max<std::size_t>(capacity, 2))
+    {}
+
+    // returns false if the value didn't change
+    bool add(clock::time_point t, double value)
+    {
+        int32_t v = int32_t(std::lround(value * 10));
+        if (!_count)
+        {
+            _base_time = _last_time = t;
+            _base_value = _last_value = v;
+            _count = 1;
+            return true;
+        }
+        if (v == _last_value)
+            return false;
+        if (_deltas.empty())
+            _deltas.resize(_capacity - 1);     // allocated with the first change
+
+        int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(t - _last_time).count();
+        ms = std::clamp<int64_t>(ms, 0, std::numeric_limits<uint32_t>::max());
+        int32_t dv = std::clamp<int32_t>(v - _last_value,
+                                         std::numeric_limits<int16_t>::min(),
+                                         std::numeric_limits<int16_t>::max());
+        if (_count == _capacity)
+        {
+            const delta &oldest = _deltas[_head];
+            _base_time += std::chrono::milliseconds(oldest.ms);
+            _base_value += oldest.dv;
+            _head = (_head + 1) % _deltas.size();
+            --_count;
+        }
+        _deltas[(_head + _count - 1) % _deltas.size()] = delta{uint32_t(ms), int16_t(dv)};
+        ++_count;
+        _last_time += std::chrono::milliseconds(ms);
+        _last_value += dv;
+        return true;
+    }
+
+    std::size_t size() const { return _count; }
+    bool empty() const { return !_count; }
+
+    // appends the samples of the query to out, oldest first
+    void query(const history_query &q, std::vector<history_sample> &out) const
+    {
+        std::size_t first = out.size();
+        clock::time_point t = _base_time;
+        int32_t v = _base_value;
+        for (std::size_t u = 0; u < _count; ++u)
+        {
+            if (u)
+            {
+                const delta &d = _deltas[(_head + u - 1) % _deltas.size()];
+                t += std::chrono::milliseconds(d.ms);
+                v += d.dv;
+            }
+            if (t > q.to)
+                break;
+            if (t >= q.from)
+                out.push_back(history_sample{t, v / 10.0});
+        }
+        if (q.last_n && (out.size() - first > q.last_n))
+            out.erase(out.begin() + first, out.end() - q.last_n);
+    }
+
+private:
+    struct delta
+    {
+        uint32_t    ms;
+        int16_t     dv;             // tenths
+    };
+
+    std::size_t         _capacity;
+    std::vector<delta>  _deltas;    // ring of _capacity - 1
+    std::size_t         _head{0};   // delta of the second oldest sample
+    std::size_t         _count{0};  // samples including the base
+
+    clock::time_point   _base_time;
+    int32_t             _base_value{0};
+    clock::time_point   _last_time;
+    int32_t             _last_value{0};
+};
+
+// all series of a room or a device
+using history_set = std::array<history_ring, history_series_count>;
+
+}
+
+#endif // HISTORY_H
@@ -0,0 +1,92 @@
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstring>
+
+#include "io_pool.h"
+#include "cube_log_internal.h"
+
+namespace ba = boost::asio;
+
+namespace max_eq3 {
+
+struct io_pool::Private
+{
+    ba::io_service                  io;
+    std::unique_ptr<ba::io_service::work>
+                                    work{new ba::io_service::work(io)};
+    std::vector<std::thread>        threads;
+};
+
+namespace {
+
+void tune_thread(std::thread &t, std::size_t index, const io_pool_config &cfg)
+{
+    if (cfg.cpus.size())
+    {
+        int cpu = cfg.cpus[index % cfg.cpus.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+        if (err)
+            LogE("can't pin io thread " << index << " to cpu " << cpu << ": " << std::strerror(err))
+    }
+    if (cfg.priority > 0)
+    {
+        sched_param sp{};
+        sp.sched_priority = cfg.priority;
+        int err = pthread_setschedparam(t.native_handle(), SCHED_FIFO, &sp);
+        if (err)
+            LogE("can't set priority " << cfg.priority << " of io thread " << index << ": " << std::strerror(err))
+    }
+}
+
+}
+
+io_pool::io_pool(const io_pool_config &cfg)
+    : _p(new Private)
+{
+    std::size_t n = cfg.threads ? cfg.threads : std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t u = 0; u < n; ++u)
+    {
+        _p->threads.emplace_back([this](){ _p->io.run(); });
+        tune_thread(_p->threads.back(), u, cfg);
+    }
+    LogV("io pool with " << n << " threads")
+}
+
+io_pool::~io_pool()
+{
+    stop();
+}
+
+ba::io_service &io_pool::io()
+{
+    return _p->io;
+}
+
+std::size_t io_pool::size() const
+{
+    return _p->threads.size();
+}
+
+std::thread::id io_pool::single_thread_id() const
+{
+    return (_p->threads.size() == 1) ? _p->threads.front().get_id() : std::thread::id();
+}
+
+// not from an io thread, it would join itself
+void io_pool::stop()
+{
+    _p->work.reset();
+    _p->io.stop();
+    for (auto &t: _p->threads)
+    {
+        if (t.joinable())
+            t.join();
+    }
+}
+
+}
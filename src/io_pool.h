@@ -0,0 +1,49 @@
+#ifndef IO_POOL_H
+#define IO_POOL_H
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace max_eq3 {
+
+struct io_pool_config
+{
+    unsigned            threads{1};     // 0: one per core
+    std::vector<int>    cpus;           // threads pinned round robin, empty: not pinned
+    int                 priority{0};    // SCHED_FIFO priority 1..99, 0: default scheduling
+};
+
+/**
+ * @brief The io_pool class
+ * an io_service run by a fixed number of threads. Users serialize their
+ * handlers by strands, a single thread runs everything in order (the
+ * default for small boxes). The threads start with the pool and are
+ * joined on stop() or destruction.
+ */
+class io_pool
+{
+public:
+    explicit io_pool(const io_pool_config &cfg = io_pool_config());
+    ~io_pool();
+
+    boost::asio::io_service &io();
+    std::size_t size() const;
+
+    // the only io thread, none if there are several
+    std::thread::id single_thread_id() const;
+
+    void stop();
+
+private:
+    struct Private;
+    std::unique_ptr<Private> _p;
+};
+
+}
+
+#endif // IO_POOL_H
@@ -0,0 +1,70 @@
+
+#include "l_msg_reader.h"
+#include "cube_proto.h"
+#include "cube_log_internal.h"
+#include "utils.h"
+
+namespace max_eq3 {
+
+namespace {
+
+bool isvalid(uint16_t flags)
+{
+    return (flags & 0x1000) == 0x1000;
+}
+
+}
+
+bool l_response(const uint8_t *rec, std::size_t reclen, l_submsg_data &adata)
+{
+    using namespace proto;
+
+    unsigned len = l_record::len::get(rec);
+    if ((reclen < l_record::size) || (len + 1 > reclen))
+    {
+        LogE("L-Msg: sub message of length " << len << " exceeds " << reclen)
+        return false;
+    }
+    adata.rfaddr = l_record::rfaddr::get(rec);
+    adata.flags = l_record::flags::get(rec);
+    // LogI("flags:" << flags_as_string(adata.flags));
+
+    if (len > 6)
+    {
+        if (isvalid(adata.flags))
+        {
+            if (len + 1 >= l_record_rt::size)
+            {
+                adata.valve_pos = l_record_rt::valve_pos::get(rec);
+                adata.set_temp = l_record_rt::set_temp::get(rec);
+                adata.minutes_since_midnight = l_record_rt::time_until::get(rec) * 30;
+                if (len + 1 == l_record_rt::size) // thermostat or thermostat+
+                {
+                    adata.submsg_src = devicetype::RadiatorThermostat;
+                    adata.act_temp = l_record_rt::act_temp::get(rec);
+                }
+                else if (len + 1 == l_record_wt::size) // wallthermostat
+                {
+                    adata.submsg_src = devicetype::WallThermostat;
+                    adata.act_temp = l_record_wt::act_temp(rec);
+                    adata.dateuntil = l_record_wt::date_until::get(rec);
+                }
+                else
+                {
+                    LogE("L-Msg: unprocessed data of length " << len)
+                    adata.act_temp = 0.0;
+                }
+                return true;
+            }
+        }
+        else
+        {
+            LogE("Invalid Data reported for device " << std::hex << adata.rfaddr << std::dec)
+        }
+    }
+    else {
+        LogE("L-Msg: unprocessed data of length " << len)
+    }
+    return false;
+}
+}
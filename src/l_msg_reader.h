@@ -0,0 +1,75 @@
+#ifndef L_MSG_READER_H
+#define L_MSG_READER_H
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "cube_io.h"
+
+namespace max_eq3 {
+
+/**
+ * @brief l_response
+ * parses one L sub message
+ * @param rec points to the length byte of the sub message
+ * @param reclen number of bytes available at rec (length byte included)
+ * @param adata receives the device data
+ * @return true if the sub message carried valid device data
+ */
+bool l_response(const uint8_t *rec, std::size_t reclen, l_submsg_data &adata);
+
+/**
+ * @brief The l_msg_reader class
+ * walks the sub messages of a decoded L-Msg in place.
+ *
+ * Every sub message starts with its length byte (length byte excluded),
+ * the reader checks each record against the remaining data before it is parsed.
+ * Nothing is copied or erased, the decoded buffer has to outlive the reader.
+ */
+class l_msg_reader
+{
+public:
+    enum struct result {
+        record,         // adata filled from the current sub message
+        invalid,        // sub message skipped (invalid or unknown data)
+        truncated,      // declared length exceeds the decoded data, reading stopped
+        end             // all sub messages processed
+    };
+
+    explicit l_msg_reader(std::string_view decoded)
+        : _p(reinterpret_cast<const uint8_t *>(decoded.data()))
+        , _end(_p + decoded.size())
+    {}
+
+    result next(l_submsg_data &adata)
+    {
+        if (_p == _end)
+            return result::end;
+
+        std::size_t reclen = std::size_t(*_p) + 1;
+        if (reclen > std::size_t(_end - _p))
+        {
+            _dropped = std::size_t(_end - _p);
+            _p = _end;
+            return result::truncated;
+        }
+        const uint8_t *rec = _p;
+        _p += reclen;
+
+        adata = l_submsg_data();
+        return l_response(rec, reclen, adata) ? result::record : result::invalid;
+    }
+
+    std::size_t remaining() const { return std::size_t(_end - _p); }
+    std::size_t dropped() const { return _dropped; }        // bytes skipped by a truncated record
+
+private:
+    const uint8_t *_p;
+    const uint8_t *_end;
+    std::size_t _dropped{0};
+};
+
+}
+
+#endif // L_MSG_READER_H
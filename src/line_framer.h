@@ -0,0 +1,116 @@
+#ifndef LINE_FRAMER_H
+#define LINE_FRAMER_H
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <string_view>
+
+#include <boost/asio/buffer.hpp>
+
+namespace max_eq3 {
+
+/**
+ * @brief The line_framer class
+ * fixed size ring buffer splitting the cube tcp stream into "\r\n" terminated lines.
+ *
+ * usage per read completion:
+ *      sock.async_read_some(framer.prepare(), ...)
+ *      framer.commit(bytes_transferred);
+ *      while (framer.next_line(line)) ...
+ *
+ * A returned line points into the ring (or into the linearisation buffer if it
+ * wraps around the end of the ring) and stays valid until the next prepare().
+ * Partial lines are kept for the next read.
+ */
+template <std::size_t Capacity>
+class line_framer
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+public:
+    using buffers_type = std::array<boost::asio::mutable_buffer, 2>;
+
+    // free space of the ring, up to two pieces if it wraps
+    buffers_type prepare()
+    {
+        std::size_t free = Capacity - (_tail - _head);
+        std::size_t pos = _tail & mask;
+        std::size_t first = std::min(free, Capacity - pos);
+        return buffers_type{
+            boost::asio::buffer(&_ring[pos], first),
+            boost::asio::buffer(&_ring[0], free - first)
+        };
+    }
+
+    void commit(std::size_t n)
+    {
+        _tail += n;
+    }
+
+    /**
+     * @brief next_line
+     * @param line receives the next complete line without "\r\n"
+     * @return false if no complete line is buffered
+     */
+    bool next_line(std::string_view &line)
+    {
+        while (_scan != _tail)
+        {
+            std::size_t pos = _scan & mask;
+            std::size_t len = std::min(_tail - _scan, Capacity - pos);
+            const void *nl = std::memchr(&_ring[pos], '\n', len);
+            if (!nl)
+            {
+                _scan += len;
+                continue;
+            }
+            std::size_t eol = _scan + (static_cast<const char *>(nl) - &_ring[pos]);
+            std::size_t llen = eol - _head;
+            if (llen && _ring[(eol - 1) & mask] == '\r')
+                --llen;
+
+            std::size_t start = _head & mask;
+            if (start + llen <= Capacity)
+                line = std::string_view(&_ring[start], llen);
+            else
+            {
+                std::size_t first = Capacity - start;
+                std::memcpy(&_linear[0], &_ring[start], first);
+                std::memcpy(&_linear[first], &_ring[0], llen - first);
+                line = std::string_view(&_linear[0], llen);
+            }
+            _head = _scan = eol + 1;
+            return true;
+        }
+        return false;
+    }
+
+    // ring is full without a line end, the line is longer than the ring
+    bool overflow() const
+    {
+        return (_tail - _head) == Capacity;
+    }
+
+    std::size_t pending() const
+    {
+        return _tail - _head;
+    }
+
+    void clear()
+    {
+        _head = _scan = _tail = 0;
+    }
+
+private:
+    static constexpr std::size_t mask = Capacity - 1;
+
+    std::array<char, Capacity>  _ring;
+    std::array<char, Capacity>  _linear;    // wrapped lines are copied here
+    std::size_t                 _head{0};   // first unconsumed byte (free running)
+    std::size_t                 _scan{0};   // next byte to scan for '\n'
+    std::size_t                 _tail{0};   // end of received data
+};
+
+}
+
+#endif // LINE_FRAMER_H
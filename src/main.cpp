@@ -3,7 +3,9 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <mutex>
 #include <thread>
+#include <charconv>
 
 #include "cube_mqtt_client.h"   // stay before the boost includes
 
@@ -12,42 +14,56 @@
 #include <boost/program_options.hpp>
 
 #include "cube_io.h"
+#include "cube_manager.h"
 #include "cube_log.h"
+#include "io_pool.h"
 #include "utils.h"
 
 namespace bpo = boost::program_options;
 
 class cube_logger : public max_eq3::logging_target
 {
+    // several io threads log at once, each one into its own buffer
     class clo : public max_eq3::logtarget_object
     {
         std::ostream &_os;
-        std::ostringstream _tmp;
+        std::mutex &_mtx;
         std::string _prefix;
+
+        static std::ostringstream &tmp()
+        {
+            static thread_local std::ostringstream t;
+            return t;
+        }
     public:
-        clo(std::ostream &os, const std::string &p) : _os(os), _prefix(p) {}
+        clo(std::ostream &os, std::mutex &mtx, const std::string &p) : _os(os), _mtx(mtx), _prefix(p) {}
 
         virtual void sync() override
         {
-            _os << _prefix << ": " << _tmp.str() << std::endl;
-            _tmp.str("");
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _os << _prefix << ": " << tmp().str() << std::endl;
+            }
+            tmp().str("");
         }
 
         virtual std::ostream &get() override {
-            return _tmp;
+            return tmp();
         }
     };
 
+    std::mutex _mtx;
+
 
 #if 0
-    clo _cinf{std::cout, "INF"};
-    clo _cverb{std::cout, "VERB"};
-    clo _cerr{std::cerr, "ERR"};
+    clo _cinf{std::cout, _mtx, "INF"};
+    clo _cverb{std::cout, _mtx, "VERB"};
+    clo _cerr{std::cerr, _mtx, "ERR"};
 #else
     std::ofstream _flog{"xout.log"};
-    clo _cinf{_flog, "INF"};
-    clo _cverb{_flog, "VERB"};
-    clo _cerr{_flog, "ERR"};
+    clo _cinf{_flog, _mtx, "INF"};
+    clo _cverb{_flog, _mtx, "VERB"};
+    clo _cerr{_flog, _mtx, "ERR"};
 #endif
 public:
     cube_logger()
@@ -86,15 +102,10 @@ std::ostream &operator << (std::ostream &s, const max_eq3::timestamped_valve_pos
 class cube_io_callback
         : public max_eq3::cube_event_target
 {
-public:
-    using roommap = std::map<std::string, max_eq3::room_sp>;
-private:
     max_eq3::device_sp device;
-    roommap rooms;
 
     cube_logger &_log;
     max_eq3::mqtt_client &_max_mqtt_client;
-    mutable std::mutex   _mtx;
 
 public:
     cube_io_callback(cube_logger &l, max_eq3::mqtt_client &mqtt_client)
@@ -113,10 +124,6 @@ public:
     }
     virtual void room_changed(max_eq3::room_sp rsp) override
     {
-        {
-            std::unique_lock<std::mutex> l(_mtx);
-            rooms[rsp->name] = rsp;            
-        }
         std::cout << "rchanged " << rsp->name
                   << " m:" << max_eq3::mode_as_string(rsp->mode)
                   << " s:" << rsp->set_temp
@@ -160,12 +167,6 @@ public:
             _log.info()->get() << "unspecified room change triggered\n";
     }
 
-    roommap getroominfo() const
-    {
-        std::unique_lock<std::mutex> l(_mtx);
-        return rooms;
-    }
-
     virtual void connected()  override
     {
         _log.info()->get() << __PRETTY_FUNCTION__ << std::endl;
@@ -175,22 +176,19 @@ public:
         _log.info()->get() << __PRETTY_FUNCTION__ << std::endl;
     }    
 
-    bool has_room(const std::string &room) const
+    void loginfo(std::ostream &os, const max_eq3::room_table &rt)
     {
-        return rooms.find(room) != rooms.end();
-    }
-
-    void loginfo(std::ostream &os)
-    {
-        roommap tmp = getroominfo();
-        os << "rooms:\n";
-        for (const auto &v: tmp)
+        os << "rooms";
+        if (rt.rooms.size())
+            os << " of cube " << rt.rooms.front()->cube;
+        os << ":\n";
+        for (const auto &r: rt.rooms)
         {
-            os << "  " << std::setw(25) << v.first
-               << " m: " << std::setw(8) << max_eq3::mode_as_string(v.second->mode); // << int(v.second->mode)
-            os << " set(" << v.second->set_temp
-               << ") act(" << v.second->actual_temp;
-            os << ") valve(" << v.second->valve_pos << ")"; // .first << "%: " << timeinfo(v.second->valve_pos.second);
+            os << "  " << std::setw(25) << r->name
+               << " m: " << std::setw(8) << max_eq3::mode_as_string(r->mode); // << int(r->mode)
+            os << " set(" << r->set_temp
+               << ") act(" << r->actual_temp;
+            os << ") valve(" << r->valve_pos << " max " << r->valve_max << "%)"; // .first << "%: " << timeinfo(r->valve_pos.second);
             os << std::endl;
         }
         os << std::endl;
@@ -200,14 +198,35 @@ public:
 int main(int argc, char *argv[])
 {
     bpo::options_description desc("Options");
-    std::string cubeserial;
+    std::vector<std::string> cubeserials;
     std::string mqtthost = "localhost";
     std::string mqttport = "1883";
+    std::string capturefile;
+    std::string replayfile;
+    std::string statefile;
+    double replayspeed = 1.0;
+    max_eq3::io_pool_config iocfg;
+    std::string iocpus;
+    unsigned settle_ms = 250;
+    max_eq3::refresh_config pollcfg;
+    unsigned pollmin = unsigned(pollcfg.min.count());
+    unsigned pollmax = unsigned(pollcfg.max.count());
     desc.add_options()
             ("help,h",                            "show help")
-            ("serial,s", bpo::value<std::string>(&cubeserial), "identifies cube by serial no")
+            ("serial,s", bpo::value<std::vector<std::string>>(&cubeserials)->composing(), "identifies cube by serial no, repeat for several cubes")
+            ("all,a",                             "serve every cube that answers the discovery")
             ("mqtthost,m", bpo::value<std::string>(&mqtthost), "mqtt server host")
             ("mqttport,p", bpo::value<std::string>(&mqttport), "mqtt server port")
+            ("capture,c", bpo::value<std::string>(&capturefile), "record the cube sessions into capture files <capture><serial>")
+            ("replay,r", bpo::value<std::string>(&replayfile), "replay a capture file instead of connecting a cube")
+            ("replay-speed", bpo::value<double>(&replayspeed), "replay time scale, 0: no delays (default 1.0)")
+            ("state", bpo::value<std::string>(&statefile), "state files <state><serial> for a warm start, updated on change")
+            ("io-threads", bpo::value<unsigned>(&iocfg.threads), "io threads for the cubes and mqtt, 0: one per core (default 1)")
+            ("io-cpus", bpo::value<std::string>(&iocpus), "pin the io threads to these cpus, e.g. 2,3")
+            ("io-priority", bpo::value<int>(&iocfg.priority), "realtime priority (SCHED_FIFO 1..99) of the io threads")
+            ("poll-min", bpo::value<unsigned>(&pollmin), "shortest poll interval in s, after commands and schedule switches (default 10)")
+            ("poll-max", bpo::value<unsigned>(&pollmax), "longest poll interval in s while nothing changes (default 300)")
+            ("settle", bpo::value<unsigned>(&settle_ms), "ms a room's temp/mode changes settle before one command is sent, 0: at once (default 250)")
         ;
 
     bpo::variables_map vm;
@@ -216,29 +235,100 @@ int main(int argc, char *argv[])
 
     if (vm.count("help")) {
         std::cout << argv[0]
-                << " controls exactly ONE MAX-EQ3 cube\n"
+                << " controls one or several MAX-EQ3 cubes\n"
                 << " and exposes the sampled data via mqtt\n\n"
                 << desc << "\n";
         return 1;
     }
 
-    std::cout << "using mqtt host at " << mqtthost << ":" << mqttport << std::endl;
-
+    std::vector<std::string> cpus;
+    boost::split(cpus, iocpus, boost::is_any_of(","), boost::token_compress_on);
+    for (const auto &c: cpus)
+    {
+        if (c.empty())
+            continue;
+        int cpu = -1;
+        auto [end, ec] = std::from_chars(c.data(), c.data() + c.size(), cpu);
+        if ((ec != std::errc()) || (end != c.data() + c.size()) || (cpu < 0)) {
+            std::cout << argv[0] << ": invalid cpu '" << c << "' in --io-cpus\n\n"
+                    << desc << "\n";
+            return 1;
+        }
+        iocfg.cpus.push_back(cpu);
+    }
 
-    max_eq3::mqtt_client hmc(mqtthost, mqttport);
-    std::thread t([&hmc](){
-            std::cout << "hmc thread function\n";            
-            hmc.run();
-            std::cout << "hmc thread done\n";
-        });
+    std::cout << "using mqtt host at " << mqtthost << ":" << mqttport << std::endl;
 
     cube_logger cl;
     max_eq3::cube_io::set_logger(&cl);
+
+    // the cubes and mqtt share the io threads, each on its own strand
+    max_eq3::io_pool pool(iocfg);
+    std::cout << "running on " << pool.size() << " io threads\n";
+    max_eq3::mqtt_client hmc(pool.io(), mqtthost, mqttport);
+
     cube_io_callback cic(cl, hmc);
-    max_eq3::cube_io cub(&cic, cubeserial);
-    hmc.set_setter([&cub](std::string_view room, std::string_view target, std::string_view data) {
+    std::unique_ptr<max_eq3::cube_io> pcub;         // replay
+    std::unique_ptr<max_eq3::cube_manager> pmgr;    // live cubes
+    std::thread replay_thread;
+    if (replayfile.size())
+    {
+        std::string cubeserial = cubeserials.size() ? cubeserials[0] : std::string();
+        pcub = std::make_unique<max_eq3::cube_io>(&cic, cubeserial, max_eq3::cube_io::offline_t{});
+        replay_thread = std::thread([&pcub, &replayfile, replayspeed](){
+                std::size_t lines = pcub->replay(replayfile, replayspeed);
+                std::cout << "replay of " << replayfile << " done, " << lines << " lines\n";
+            });
+    }
+    else
+    {
+        max_eq3::cube_manager_config mcfg;
+        mcfg.serials = cubeserials;
+        mcfg.max_cubes = (cubeserials.empty() && !vm.count("all")) ? 1 : 0;  // the first cube found
+        mcfg.state_prefix = statefile;
+        mcfg.capture_prefix = capturefile;
+        mcfg.commands.settle = std::chrono::milliseconds(settle_ms);
+        pollcfg.min = std::chrono::seconds(pollmin);
+        pollcfg.max = std::chrono::seconds(pollmax);
+        mcfg.refresh = pollcfg;
+        pmgr = std::make_unique<max_eq3::cube_manager>(&cic, mcfg, pool);
+    }
+
+    // rooms are given as "<serial>/<room>" or by name alone
+    auto find_room = [&pcub, &pmgr](std::string_view serial, std::string_view room) {
+        if (pmgr)
+            return serial.size() ? pmgr->find_room(serial, room) : pmgr->find_room(room);
+        return max_eq3::managed_room{pcub.get(), pcub->find_room(room)};
+    };
+    auto cubes = [&pcub, &pmgr]() {
+        std::vector<max_eq3::cube_io *> result;
+        if (pmgr)
+        {
+            for (const auto &serial: pmgr->serials())
+                result.push_back(pmgr->cube(serial));
+        }
+        else
+            result.push_back(pcub.get());
+        return result;
+    };
+
+    // the results of a command as they come, on the io thread
+    auto report = [](std::string_view room) {
+        return [room = std::string(room)](const max_eq3::command_result &r) {
+            std::cout << room << ": " << max_eq3::to_string(r.status) << ", duty cycle "
+                      << r.duty_cycle << "%, " << r.free_slots << " free slots" << std::endl;
+        };
+    };
+
+    hmc.set_setter([&find_room, &report](std::string_view cube, std::string_view room, std::string_view target, std::string_view data) {
 
-        std::cout << "setter for room " << room << " target " << target << " data " << data << std::endl;
+        std::cout << "setter for room " << room << " of " << cube << " target " << target << " data " << data << std::endl;
+        max_eq3::managed_room mr = find_room(cube, room);
+        if (!mr)
+        {
+            std::cerr << "unknown room " << room << " of " << cube << std::endl;
+            return;
+        }
         if (target == "temp")
         {
             // std::string parms(cmd.begin() + 5, cmd.end());
@@ -246,7 +336,7 @@ int main(int argc, char *argv[])
             double temp;
             is >> temp;
             std::cout << "set temp for " << room << " to " << temp << std::endl;
-            cub.change_temp(std::string(room.begin(), room.end()), temp);
+            mr.cube->change_temp(mr.room, temp, max_eq3::command_priority::normal, report(room));
         }
         else if (target == "mode")
         {            
@@ -261,7 +351,7 @@ int main(int argc, char *argv[])
             if (m)
             {
                 std::cout << "change mode for " << room << " to " << mode_as_string(*m) << std::endl;
-                cub.change_mode(std::string(room.begin(), room.end()), *m);
+                mr.cube->change_mode(mr.room, *m, max_eq3::command_priority::normal, report(room));
             }
         }
 
@@ -281,14 +371,37 @@ int main(int argc, char *argv[])
         if (cmdstring == "help")
         {
             std::cout << "commands:\n"
-                      << "    temp <room> <temperature>      # example: temp livingroom 17.5\n"
+                      << "    temp <room> <temperature>      # example: temp livingroom 17.5, room may be <serial>/<room>\n"
                       << "    mode <room> <mode>             # tmode :== manual | auto | boost\n"
                       << "    status                         # show current status\n"
+                      << "    history <room> [series] [n]    # last n changes, series :== act | set | valve | mode\n"
+                      << "    queue                          # commands waiting for the duty cycle budget\n"
+                      << "    poll                           # current poll interval and its reason\n"
                       << "    quit                           # exit program\n";
         }
         else if (cmdstring == "status")
         {
-            cic.loginfo(std::cout);
+            for (max_eq3::cube_io *cio: cubes())
+                cic.loginfo(std::cout, *cio->rooms());
+        }
+        else if (cmdstring == "queue")
+        {
+            for (max_eq3::cube_io *cio: cubes())
+            {
+                max_eq3::command_queue_state st = cio->commands();
+                std::cout << st.depth << " commands queued, duty cycle " << st.duty_cycle
+                          << "%, " << st.free_slots << " free slots, a new one is sent in about "
+                          << st.estimated_delay.count() << " ms" << std::endl;
+            }
+        }
+        else if (cmdstring == "poll")
+        {
+            for (max_eq3::cube_io *cio: cubes())
+            {
+                max_eq3::refresh_state st = cio->refresh();
+                std::cout << "polled every " << st.interval.count() << " s ("
+                          << max_eq3::to_string(st.reason) << ")" << std::endl;
+            }
         }
         else if (cmdstring.substr(0,4) == "temp")
         {
@@ -301,7 +414,11 @@ int main(int argc, char *argv[])
 
                 try {
                     double temp = boost::lexical_cast<double>(cmdstring);
-                    cub.change_temp(roomname, temp);
+                    max_eq3::managed_room mr = find_room(std::string_view(), roomname);
+                    if (mr)
+                        mr.cube->change_temp(mr.room, temp, max_eq3::command_priority::normal, report(roomname));
+                    else
+                        std::cerr << "unknown room " << roomname << std::endl;
                 } catch(boost::bad_lexical_cast &e) {
                     std::cerr << "error reading temperature: " << e.what() << std::endl;
                 }
@@ -337,7 +454,67 @@ int main(int argc, char *argv[])
                     std::cerr << "mode set invalid parameter: " << cmdstring << std::endl;
                     continue;
                 }
-                cub.change_mode(roomname, mode);
+                max_eq3::managed_room mr = find_room(std::string_view(), roomname);
+                if (mr)
+                    mr.cube->change_mode(mr.room, mode, max_eq3::command_priority::normal, report(roomname));
+                else
+                    std::cerr << "unknown room " << roomname << std::endl;
+            }
+        }
+        else if (cmdstring.substr(0,7) == "history")
+        {
+            cmdstring.erase(0,8);
+            std::string roomname;
+            if (parse_room(cmdstring, roomname))
+            {
+                boost::trim(cmdstring);
+                std::vector<std::string> args;
+                if (cmdstring.size())
+                    boost::split(args, cmdstring, boost::is_space(), boost::token_compress_on);
+
+                max_eq3::history_query q;
+                q.last_n = 10;
+                if (args.size() > 0)
+                {
+                    if (args[0] == "act")
+                        q.series = max_eq3::history_series::act_temp;
+                    else if (args[0] == "set")
+                        q.series = max_eq3::history_series::set_temp;
+                    else if (args[0] == "valve")
+                        q.series = max_eq3::history_series::valve_pos;
+                    else if (args[0] == "mode")
+                        q.series = max_eq3::history_series::mode;
+                    else
+                    {
+                        std::cerr << "history invalid series: " << args[0] << std::endl;
+                        continue;
+                    }
+                }
+                if (args.size() > 1)
+                {
+                    try {
+                        q.last_n = boost::lexical_cast<std::size_t>(args[1]);
+                    } catch(boost::bad_lexical_cast &e) {
+                        std::cerr << "error reading sample count: " << e.what() << std::endl;
+                        continue;
+                    }
+                }
+
+                max_eq3::managed_room mr = find_room(std::string_view(), roomname);
+                if (!mr)
+                {
+                    std::cerr << "unknown room " << roomname << std::endl;
+                    continue;
+                }
+                auto now = std::chrono::system_clock::now();
+                std::vector<max_eq3::history_sample> samples = mr.cube->history(mr.room, q);
+                for (const auto &hs: samples)
+                    std::cout << "  -" << std::setw(6)
+                              << std::chrono::duration_cast<std::chrono::minutes>(now - hs.time).count()
+                              << " min: " << hs.value << std::endl;
+                max_eq3::history_stats st = max_eq3::summarize(samples, now);
+                std::cout << st.samples << " samples min " << st.min
+                          << " max " << st.max << " avg " << st.avg << std::endl;
             }
         }
         else if (cmdstring.size())
@@ -346,9 +523,11 @@ int main(int argc, char *argv[])
         }
     }
     std::cout << "left cmd loop\n";
+    if (replay_thread.joinable())
+        replay_thread.join();
+    pmgr.reset();
     hmc.stop();
+    pool.stop();
     std::cout << "stopped\n";
-
-    t.join();
     return 0;
 }
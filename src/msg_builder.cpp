@@ -0,0 +1,186 @@
+
+#include <cstdio>
+
+#include "msg_builder.h"
+#include "cube_proto.h"
+#include "base64.h"
+
+namespace max_eq3 {
+
+namespace {
+
+void append_base64(std::string &out, const uint8_t *data, std::size_t len)
+{
+    std::size_t pos = out.size();
+    out.resize(pos + base64::encoded_size(len));
+    base64::encode(data, len, &out[pos]);
+}
+
+void append_rfaddr(std::vector<uint8_t> &bin, rfaddr_t addr)
+{
+    bin.push_back(uint8_t(addr >> 16));
+    bin.push_back(uint8_t(addr >> 8));
+    bin.push_back(uint8_t(addr));
+}
+
+template <std::size_t Offset>
+void put_week_program(uint8_t *p, const week_schedule &ws)
+{
+    p += Offset;
+    for (unsigned u = 0; u < DAYS_A_WEEK; ++u)
+        for (unsigned x = 0; x < SCHED_POINTS; ++x, p += 2)
+            proto::program_point<0>::put(p, ws[u][x]);
+}
+
+}
+
+std::string build_h_msg(const std::string &serial, rfaddr_t rfaddr, uint16_t fwversion,
+                        uint16_t duty_cycle, uint16_t freememslots)
+{
+    char tmp[96];
+    std::snprintf(tmp, sizeof(tmp), "H:%s,%06x,%04x,00000000,00000000,%02x,%x,140c09,0c1e,03,0000",
+                  serial.c_str(), unsigned(rfaddr), unsigned(fwversion),
+                  unsigned(duty_cycle), unsigned(freememslots));
+    return tmp;
+}
+
+std::vector<std::string> build_m_msgs(const std::vector<m_room> &rooms,
+                                      const std::vector<m_device> &devices,
+                                      std::size_t chunk_size)
+{
+    std::vector<uint8_t> bin;
+    bin.push_back(0x56);
+    bin.push_back(0x02);
+    bin.push_back(uint8_t(rooms.size()));
+    for (const m_room &r: rooms)
+    {
+        bin.push_back(r.id);
+        bin.push_back(uint8_t(r.name.size()));
+        bin.insert(bin.end(), r.name.begin(), r.name.end());
+        append_rfaddr(bin, r.group_rfaddr);
+    }
+    bin.push_back(uint8_t(devices.size()));
+    for (const m_device &d: devices)
+    {
+        bin.push_back(uint8_t(d.type));
+        append_rfaddr(bin, d.rfaddr);
+        std::string serial = d.serial;
+        serial.resize(10, ' ');
+        bin.insert(bin.end(), serial.begin(), serial.end());
+        bin.push_back(uint8_t(d.name.size()));
+        bin.insert(bin.end(), d.name.begin(), d.name.end());
+        bin.push_back(d.room_id);
+    }
+    bin.push_back(0x01);
+
+    std::string encoded;
+    append_base64(encoded, bin.data(), bin.size());
+
+    std::size_t cnt = (encoded.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::string> msgs;
+    for (std::size_t idx = 0; idx < cnt; ++idx)
+    {
+        char hdr[16];
+        std::snprintf(hdr, sizeof(hdr), "M:%02x,%02x,", unsigned(idx), unsigned(cnt));
+        msgs.push_back(hdr + encoded.substr(idx * chunk_size, chunk_size));
+    }
+    return msgs;
+}
+
+std::string build_c_msg(const m_device &dev, const thermostat_settings &ts)
+{
+    using namespace proto;
+
+    std::vector<uint8_t> bin;
+    switch (dev.type)
+    {
+    case devicetype::RadiatorThermostat:
+    case devicetype::RadiatorThermostatPlus:
+        bin.resize(c_radiator_thermostat::size);
+        c_radiator_thermostat::comfort::put(bin.data(), ts.comfort);
+        c_radiator_thermostat::eco::put(bin.data(), ts.eco);
+        c_radiator_thermostat::max::put(bin.data(), ts.max);
+        c_radiator_thermostat::min::put(bin.data(), ts.min);
+        c_radiator_thermostat::tofs::put(bin.data(), ts.tofs);
+        put_week_program<c_radiator_thermostat::schedule::offset>(bin.data(), ts.schedule);
+        break;
+    case devicetype::WallThermostat:
+        bin.resize(c_wall_thermostat::size);
+        c_wall_thermostat::comfort::put(bin.data(), ts.comfort);
+        c_wall_thermostat::eco::put(bin.data(), ts.eco);
+        c_wall_thermostat::max::put(bin.data(), ts.max);
+        c_wall_thermostat::min::put(bin.data(), ts.min);
+        put_week_program<c_wall_thermostat::schedule::offset>(bin.data(), ts.schedule);
+        break;
+    default:
+        bin.resize(c_header::size);
+    }
+    uint8_t *p = bin.data();
+    c_header::len::put(p, unsigned(bin.size() - 1));
+    c_header::rfaddr::put(p, dev.rfaddr);
+    c_header::devtype::put(p, unsigned(dev.type));
+    c_header::room_id::put(p, dev.room_id);
+    c_header::fwversion::put(p, 0x19);
+    c_header::test_result::put(p, 0);
+    std::string serial = dev.serial;
+    serial.resize(10, ' ');
+    std::copy(serial.begin(), serial.end(), p + c_header::serial::offset);
+
+    char hdr[16];
+    std::snprintf(hdr, sizeof(hdr), "C:%06x,", unsigned(dev.rfaddr));
+    std::string line(hdr);
+    append_base64(line, bin.data(), bin.size());
+    return line;
+}
+
+std::string build_l_msg(const std::vector<l_submsg_data> &devices)
+{
+    using namespace proto;
+
+    std::vector<uint8_t> bin;
+    bin.reserve(devices.size() * l_record_wt::size);
+    for (const l_submsg_data &d: devices)
+    {
+        std::size_t recsize = l_record::size;
+        if ((d.submsg_src == devicetype::RadiatorThermostat)
+                || (d.submsg_src == devicetype::RadiatorThermostatPlus))
+            recsize = l_record_rt::size;
+        else if (d.submsg_src == devicetype::WallThermostat)
+            recsize = l_record_wt::size;
+
+        std::size_t pos = bin.size();
+        bin.resize(pos + recsize);
+        uint8_t *p = &bin[pos];
+        l_record::len::put(p, unsigned(recsize - 1));
+        l_record::rfaddr::put(p, d.rfaddr);
+        l_record::flags::put(p, d.flags);
+        if (recsize == l_record::size)
+            continue;
+
+        l_record_rt::valve_pos::put(p, d.valve_pos);
+        l_record_rt::set_temp::put(p, d.set_temp);
+        l_record_rt::time_until::put(p, d.minutes_since_midnight / 30);
+        unsigned act = unsigned(std::lround(d.act_temp * 10));
+        if (recsize == l_record_rt::size)
+            bits<field<9, 2>, 0x1ff>::put(p, act);
+        else
+        {
+            l_record_wt::date_until::put(p, d.dateuntil);
+            l_record_wt::act_temp_hi::put(p, act >> 8);
+            l_record_wt::act_temp_lo::put(p, act & 0xff);
+        }
+    }
+
+    std::string line("L:");
+    append_base64(line, bin.data(), bin.size());
+    return line;
+}
+
+std::string build_s_reply(unsigned duty_cycle, bool failed, unsigned freeslots)
+{
+    char tmp[32];
+    std::snprintf(tmp, sizeof(tmp), "S:%02x,%u,%02x", duty_cycle, failed ? 1u : 0u, freeslots);
+    return tmp;
+}
+
+}
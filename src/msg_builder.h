@@ -0,0 +1,45 @@
+#ifndef MSG_BUILDER_H
+#define MSG_BUILDER_H
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "msg_parser.h"
+
+namespace max_eq3 {
+
+/**
+ * Builds the lines a cube sends ("\r\n" not included).
+ * Counterpart to msg_parser, used to generate payloads for
+ * benchmarks and the cube simulator.
+ */
+
+struct thermostat_settings
+{
+    double comfort{21.0};
+    double eco{17.0};
+    double max{30.5};
+    double min{4.5};
+    double tofs{3.5};
+    week_schedule schedule;
+};
+
+std::string build_h_msg(const std::string &serial, rfaddr_t rfaddr, uint16_t fwversion,
+                        uint16_t duty_cycle, uint16_t freememslots);
+
+// M-Msg chunks, the base64 data is split after chunk_size characters
+std::vector<std::string> build_m_msgs(const std::vector<m_room> &rooms,
+                                      const std::vector<m_device> &devices,
+                                      std::size_t chunk_size = 1900);
+
+std::string build_c_msg(const m_device &dev, const thermostat_settings &ts);
+
+// L sub messages are generated according to submsg_src
+std::string build_l_msg(const std::vector<l_submsg_data> &devices);
+
+std::string build_s_reply(unsigned duty_cycle, bool failed, unsigned freeslots);
+
+}
+
+#endif // MSG_BUILDER_H
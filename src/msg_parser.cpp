@@ -0,0 +1,166 @@
+
+
+#include <charconv>
+
+#include "msg_parser.h"
+#include "cube_proto.h"
+#include "cube_log_internal.h"
+#include "io_operator.h"
+#include "utils.h"
+
+namespace max_eq3 {
+
+bool parse_m_header(std::string_view &payload, unsigned &idx, unsigned &cnt)
+{
+    // "<index>,<count>,<data>" index and count in hex
+    std::size_t c1 = payload.find(',');
+    std::size_t c2 = payload.find(',', c1 + 1);
+    if ((c1 == std::string_view::npos) || (c2 == std::string_view::npos))
+        return false;
+    const char *pData = payload.data();
+    if ((std::from_chars(pData, pData + c1, idx, 16).ec != std::errc())
+            || (std::from_chars(pData + c1 + 1, pData + c2, cnt, 16).ec != std::errc()))
+        return false;
+    payload.remove_prefix(c2 + 1);
+    return true;
+}
+
+bool m_response(std::string_view decoded,
+                std::vector<m_room> &roomlist,
+                std::vector<m_device> &devicelist)
+{
+    roomlist.clear();
+    devicelist.clear();
+
+    const uint8_t *pData = reinterpret_cast<const uint8_t *>(decoded.data());
+    const uint8_t *pEnd = pData + decoded.size();
+    auto avail = [&pData, pEnd](std::size_t n) { return std::size_t(pEnd - pData) >= n; };
+
+    // room data
+    if (!avail(3))
+        return false;
+    pData += 2;
+    unsigned roomcnt = *pData++;
+    roomlist.reserve(roomcnt);
+    for (unsigned u = 0; u < roomcnt; ++u)
+    {
+        if (!avail(2) || !avail(2 + pData[1] + 3))
+            return false;
+        m_room &rd = roomlist.emplace_back();
+        rd.id = fromPtr<uint8_t>(pData++);
+        std::size_t namelen = *pData++;
+        rd.name.assign(reinterpret_cast<const char *>(pData), namelen);
+        pData += namelen;
+        rd.group_rfaddr = fromPtr<uint32_t>(pData, 3);
+        pData += 3;
+    }
+    // device data
+    if (!avail(1))
+        return false;
+    unsigned devcnt = *pData++;
+    devicelist.reserve(devcnt);
+    for (unsigned u = 0; u < devcnt; ++u)
+    {
+        if (!avail(15) || !avail(15 + pData[14] + 1))
+            return false;
+        m_device &dd = devicelist.emplace_back();
+        dd.type = devicetype(*pData++);
+        dd.rfaddr = fromPtr<uint32_t>(pData, 3);
+        pData += 3;
+        dd.serial.assign(reinterpret_cast<const char *>(pData), 10);
+        pData += 10;
+        std::size_t namelen = *pData++;
+        dd.name.assign(reinterpret_cast<const char *>(pData), namelen);
+        pData += namelen;
+        dd.room_id = fromPtr<uint8_t>(pData++);
+    }
+    return true;
+}
+
+bool c_response(const uint8_t *pData, std::size_t size, dev_config &devconf)
+{
+    using namespace proto;
+
+    if (size < c_header::size)
+    {
+        LogE("C-Msg too short: " << size)
+        return false;
+    }
+
+    uint8_t len = c_header::len::get(pData);
+    devconf.rfaddr = c_header::rfaddr::get(pData);
+    devconf.devtype = devicetype(c_header::devtype::get(pData));
+    devconf.room_id = c_header::room_id::get(pData);
+    devconf.fwversion = c_header::fwversion::get(pData);
+    devconf.serial = c_header::serial::get(pData);
+
+    LogV("C-msg len " << uint16_t(len)
+              << " rfaddr " << std::hex << devconf.rfaddr << std::dec
+              << " dev " << uint16_t(devconf.devtype)
+              << " room " << uint16_t(devconf.room_id)
+              << " fwv " << uint16_t(devconf.fwversion)
+              << " serial " << devconf.serial)
+
+    switch (devconf.devtype)
+    {
+        case devicetype::Cube:
+            break;
+        case devicetype::RadiatorThermostat:
+        case devicetype::RadiatorThermostatPlus:
+            if (size < c_radiator_thermostat::size)
+                LogE("C-Msg radiatorThermostat too short: " << size)
+            else
+            {
+                using rt = c_radiator_thermostat;
+                radiatorThermostat_config rthc;
+                rthc.comfort = rt::comfort::get(pData);
+                rthc.eco = rt::eco::get(pData);
+                rthc.max = rt::max::get(pData);
+                rthc.min = rt::min::get(pData);
+                rthc.tofs = rt::tofs::get(pData);
+                rt::schedule::get(pData, rthc.schedule);
+                LogV("radiatorThermostat "
+                          << " comfort " << rthc.comfort
+                          << " eco " << rthc.eco
+                          << " min " << rthc.min
+                          << " max " << rthc.max
+                          << " tofs " << rthc.tofs
+                          << " sched\n" << rthc.schedule)
+                devconf.specific = rthc;
+
+            }
+            break;
+        case devicetype::WallThermostat:
+            if (size < c_wall_thermostat::size)
+                LogE("C-Msg wallThermostat too short: " << size)
+            else
+            {
+                using wt = c_wall_thermostat;
+                wallThermostat_config wthc;
+                wthc.comfort = wt::comfort::get(pData);
+                wthc.eco = wt::eco::get(pData);
+                wthc.max = wt::max::get(pData);
+                wthc.min = wt::min::get(pData);
+                wt::schedule::get(pData, wthc.schedule);
+                LogV("wallThermostat "
+                          << " comfort " << wthc.comfort
+                          << " eco " << wthc.eco
+                          << " min " << wthc.min
+                          << " max " << wthc.max
+                          << " sched\n" << wthc.schedule
+                     )
+                devconf.specific = wthc;
+            }
+            break;
+    }
+    return true;
+}
+
+week_schedule get_schedule(const uint8_t *pD)
+{
+    week_schedule ws;
+    proto::week_program<0>::get(pD, ws);
+    return ws;
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef MSG_PARSER_H
+#define MSG_PARSER_H
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cube_io.h"
+#include "dev_store.h"
+
+namespace max_eq3 {
+
+struct m_room
+{
+    uint8_t id;             // 1 .. x
+
+    std::string name;       // name of room
+
+    /**
+     * @brief group_rfaddr
+     * this ist the rfaddr of the device first assigned to this room
+     */
+    rfaddr_t group_rfaddr;
+};
+
+/**
+ * @brief The m_device struct
+ * filled from response 'm'
+ */
+struct m_device
+{
+    devicetype  type;
+    rfaddr_t    rfaddr;
+    std::string serial;
+    std::string name;
+    uint8_t     room_id;
+};
+
+/**
+ * @brief parse_m_header
+ * reads "<index>,<count>," of a M-Msg chunk
+ * @param payload M-Msg without "M:", returns the data part
+ */
+bool parse_m_header(std::string_view &payload, unsigned &idx, unsigned &cnt);
+
+/**
+ * @brief m_response
+ * parses the decoded (joined) M-Msg, the lists are sized from the counts in its header
+ * @return false if the data ends before all rooms and devices were read
+ */
+bool m_response(std::string_view decoded,
+                std::vector<m_room> &roomlist,
+                std::vector<m_device> &devicelist);
+
+/**
+ * @brief c_response
+ * parses a decoded C-Msg, the specific config is only replaced for complete data
+ */
+bool c_response(const uint8_t *pData, std::size_t size, dev_config &devconf);
+
+week_schedule get_schedule(const uint8_t *pD);
+
+}
+
+#endif // MSG_PARSER_H
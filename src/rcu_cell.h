@@ -0,0 +1,142 @@
+#ifndef RCU_CELL_H
+#define RCU_CELL_H
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace max_eq3 {
+
+/**
+ * @brief The rcu_cell class
+ * read-copy-update of an immutable value, one writer thread and any
+ * number of readers.
+ *
+ * A reader registers in the counter of the current epoch and loads the
+ * value pointer, both without locks. The writer swaps in a new value and
+ * retires the old one, it is deleted after the epoch advanced twice, an
+ * advance needs the readers of the epoch it reuses the counter of to be
+ * gone. The writer never waits, retired values just stay a bit longer
+ * while readers hold guards.
+ */
+template <typename T>
+class rcu_cell
+{
+public:
+    class guard
+    {
+    public:
+        guard() = default;
+        guard(guard &&other) noexcept
+            : _counter(std::exchange(other._counter, nullptr))
+            , _value(std::exchange(other._value, nullptr))
+        {}
+        guard &operator=(guard &&other) noexcept
+        {
+            release();
+            _counter = std::exchange(other._counter, nullptr);
+            _value = std::exchange(other._value, nullptr);
+            return *this;
+        }
+        guard(const guard &) = delete;
+        guard &operator=(const guard &) = delete;
+        ~guard() { release(); }
+
+        const T *get() const { return _value; }
+        const T &operator*() const { return *_value; }
+        const T *operator->() const { return _value; }
+        explicit operator bool() const { return _value != nullptr; }
+
+    private:
+        friend class rcu_cell;
+        guard(std::atomic<std::size_t> *counter, const T *value)
+            : _counter(counter)
+            , _value(value)
+        {}
+        void release()
+        {
+            if (_counter)
+                _counter->fetch_sub(1);
+            _counter = nullptr;
+            _value = nullptr;
+        }
+
+        std::atomic<std::size_t>   *_counter{nullptr};
+        const T                    *_value{nullptr};
+    };
+
+    explicit rcu_cell(std::unique_ptr<const T> initial = std::make_unique<const T>())
+        : _current(initial.release())
+    {}
+    rcu_cell(const rcu_cell &) = delete;
+    rcu_cell &operator=(const rcu_cell &) = delete;
+
+    // guards must not outlive the cell
+    ~rcu_cell()
+    {
+        delete _current.load();
+    }
+
+    // any thread
+    guard read() const
+    {
+        for (;;)
+        {
+            uint64_t e = _epoch.load();
+            std::atomic<std::size_t> &counter = _readers[e & 1];
+            counter.fetch_add(1);
+            if (_epoch.load() == e)
+                return guard(&counter, _current.load());
+            counter.fetch_sub(1);       // the epoch advanced meanwhile
+        }
+    }
+
+    // writer thread only
+    void publish(std::unique_ptr<const T> value)
+    {
+        const T *old = _current.exchange(value.release());
+        _retired.emplace_back(old, _epoch.load());
+        reclaim();
+    }
+
+    // writer thread only, the current value
+    const T &current() const
+    {
+        return *_current.load();
+    }
+
+private:
+    void reclaim()
+    {
+        for (unsigned u = 0; u < 2; ++u)
+        {
+            uint64_t e = _epoch.load();
+            if (_readers[(e + 1) & 1].load() != 0)
+                break;
+            _epoch.store(e + 1);
+        }
+        uint64_t e = _epoch.load();
+        std::size_t kept = 0;
+        for (auto &r: _retired)
+        {
+            if (r.second + 2 <= e)
+                r.first.reset();
+            else
+                _retired[kept++] = std::move(r);
+        }
+        _retired.resize(kept);
+    }
+
+    std::atomic<const T *>                  _current;
+    std::atomic<uint64_t>                   _epoch{0};
+    mutable std::atomic<std::size_t>        _readers[2]{};
+    std::vector<std::pair<std::unique_ptr<const T>, uint64_t>>
+                                            _retired;       // value and epoch of retirement
+};
+
+}
+
+#endif // RCU_CELL_H
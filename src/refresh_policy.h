@@ -0,0 +1,138 @@
+#ifndef REFRESH_POLICY_H
+#define REFRESH_POLICY_H
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+
+#include "cube_types.h"
+
+namespace max_eq3 {
+
+enum struct refresh_reason : uint8_t {
+    startup,        // no L-Msg seen yet
+    changing,       // the last L-Msg differed from the one before
+    idle,           // nothing changed for a while, the interval grows
+    command,        // commands were accepted, the valves follow
+    schedule,       // a schedule switches the set temperature soon
+};
+
+inline const char *to_string(refresh_reason r)
+{
+    switch (r)
+    {
+    case refresh_reason::startup:   return "startup";
+    case refresh_reason::changing:  return "changing";
+    case refresh_reason::idle:      return "idle";
+    case refresh_reason::command:   return "command";
+    case refresh_reason::schedule:  return "schedule";
+    }
+    return "unknown";
+}
+
+struct refresh_config
+{
+    std::chrono::seconds    min{10};
+    std::chrono::seconds    base{30};           // while values change
+    std::chrono::seconds    max{300};
+    unsigned                idle_after{2};      // unchanged L-Msgs before the interval grows
+    unsigned                growth{2};          // factor per further unchanged L-Msg
+    std::chrono::seconds    after_command{10};  // once after the read back of commands
+    std::chrono::seconds    schedule_lag{30};   // polled that long after a schedule transition
+};
+
+struct refresh_state
+{
+    std::chrono::seconds    interval{30};
+    refresh_reason          reason{refresh_reason::startup};
+};
+
+/**
+ * @brief next_transition
+ * time until the next switch point of the week schedule, seen from the
+ * local time now. Points end at minutes_since_midnight, 24:00 ends the day
+ * without a switch. Only today and tomorrow are searched.
+ */
+inline std::optional<std::chrono::seconds> next_transition(const week_schedule &ws, const std::tm &now)
+{
+    // days counts from Saturday, tm_wday from Sunday
+    unsigned today = unsigned(now.tm_wday + 1) % DAYS_A_WEEK;
+    long secs = now.tm_hour * 3600L + now.tm_min * 60L + now.tm_sec;
+    for (unsigned d = 0; d < 2; ++d)
+    {
+        for (const schedule_point &sp: ws[(today + d) % DAYS_A_WEEK])
+        {
+            if (sp.minutes_since_midnight >= 24 * 60)
+                break;
+            long at = d * 86400L + sp.minutes_since_midnight * 60L;
+            if (at > secs)
+                return std::chrono::seconds(at - secs);
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief The refresh_policy class
+ * interval of the periodic l: poll. It starts at base, grows by growth
+ * per L-Msg once idle_after of them came unchanged and drops back to base
+ * on the first change. After accepted commands one poll follows at
+ * after_command to catch the valves moving, a schedule transition within
+ * the interval is polled schedule_lag after it. Always within min and max.
+ */
+class refresh_policy
+{
+public:
+    void configure(const refresh_config &cfg)
+    {
+        _cfg = cfg;
+        _interval = _cfg.base;
+    }
+    const refresh_config &config() const { return _cfg; }
+
+    // L-Msg evaluated, changed: it differs from the one before
+    void observed(bool changed)
+    {
+        if (_command_polls)
+            --_command_polls;
+        if (changed)
+        {
+            _unchanged = 0;
+            _interval = _cfg.base;
+            _reason = refresh_reason::changing;
+        }
+        else if (++_unchanged >= _cfg.idle_after)
+        {
+            _interval = std::min(_interval * std::max(_cfg.growth, 1u), _cfg.max);
+            _reason = refresh_reason::idle;
+        }
+    }
+
+    // the read back of the commands and one more poll are short
+    void commanded() { _command_polls = 2; }
+
+    refresh_state next(std::optional<std::chrono::seconds> to_transition) const
+    {
+        refresh_state st{_interval, _reason};
+        if (_command_polls && (_cfg.after_command < st.interval))
+            st = refresh_state{_cfg.after_command, refresh_reason::command};
+        if (to_transition && (*to_transition + _cfg.schedule_lag < st.interval))
+            st = refresh_state{*to_transition + _cfg.schedule_lag, refresh_reason::schedule};
+        st.interval = std::clamp(st.interval, _cfg.min, std::max(_cfg.min, _cfg.max));
+        return st;
+    }
+
+private:
+    refresh_config          _cfg;
+    std::chrono::seconds    _interval{_cfg.base};
+    refresh_reason          _reason{refresh_reason::startup};
+    unsigned                _unchanged{0};
+    unsigned                _command_polls{0};
+};
+
+}
+
+#endif // REFRESH_POLICY_H
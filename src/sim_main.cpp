@@ -0,0 +1,89 @@
+/**
+ * local MAX! Cube simulator
+ *
+ * usage: maxcube2mqtt_sim [options]
+ *
+ * serves the discovery and the tcp protocol of a cube with a generated
+ * house, maxcube2mqtt (or any other client) on this host finds it like
+ * a real cube
+ */
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+#include <boost/program_options.hpp>
+
+#include "cube_sim.h"
+
+namespace bpo = boost::program_options;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+}
+
+int main(int argc, char *argv[])
+{
+    bpo::options_description desc("Options");
+    max_eq3::sim_config cfg;
+    unsigned l_interval_ms = 0;
+    unsigned report_s = 10;
+    desc.add_options()
+            ("help,h",                            "show help")
+            ("serial,s", bpo::value<std::string>(&cfg.serial), "serial no of the simulated cube")
+            ("rooms,r", bpo::value<unsigned>(&cfg.rooms), "number of rooms (default 12)")
+            ("thermostats,t", bpo::value<unsigned>(&cfg.thermostats), "radiator thermostats per room (default 2)")
+            ("no-wallthermostat", "rooms without wall thermostat")
+            ("l-interval,l", bpo::value<unsigned>(&l_interval_ms), "send L-Msgs every n ms unrequested, 0: only on l: (default)")
+            ("seed", bpo::value<unsigned>(&cfg.seed), "seed for temperatures and valve moves")
+            ("quiet", "values don't move by themselves, only by s: commands")
+            ("address", bpo::value<std::string>(&cfg.address), "own address (127.0.0.x) to run several simulators")
+            ("report", bpo::value<unsigned>(&report_s), "statistics every n seconds (default 10)")
+        ;
+
+    bpo::variables_map vm;
+    bpo::store(bpo::parse_command_line(argc, argv, desc), vm);
+    bpo::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << argv[0]
+                << " simulates a MAX-EQ3 cube on this host\n\n"
+                << desc << "\n";
+        return 1;
+    }
+    cfg.wallthermostat = !vm.count("no-wallthermostat");
+    cfg.quiet = vm.count("quiet") > 0;
+    cfg.l_interval = std::chrono::milliseconds(l_interval_ms);
+
+    max_eq3::cube_simulator sim(cfg);
+    if (!sim.start())
+    {
+        std::cerr << "can't open udp port " << cfg.udp_port
+                  << " or tcp port " << cfg.tcp_port << std::endl;
+        return 1;
+    }
+    std::cout << "cube " << cfg.serial << " simulated with " << sim.config().rooms << " rooms" << std::endl;
+
+    std::signal(SIGINT, [](int){ stop_requested = 1; });
+    std::signal(SIGTERM, [](int){ stop_requested = 1; });
+
+    auto next_report = std::chrono::steady_clock::now() + std::chrono::seconds(report_s);
+    while (!stop_requested)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (report_s && (std::chrono::steady_clock::now() >= next_report))
+        {
+            const max_eq3::sim_stats &st = sim.stats();
+            std::cout << "connects " << st.connects
+                      << " lines sent " << st.lines_sent
+                      << " l: " << st.l_cmds
+                      << " s: " << st.s_cmds << " (" << st.s_failed << " failed)" << std::endl;
+            next_report += std::chrono::seconds(report_s);
+        }
+    }
+    sim.stop();
+    return 0;
+}
@@ -1,17 +1,16 @@
 
 #include <cstdint>
+#include <sstream>
 
-#include <boost/archive/iterators/binary_from_base64.hpp>
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
 #include <boost/algorithm/string.hpp>
 
 
 #include "utils.h"
+#include "base64.h"
 
 namespace max_eq3 {
 
-std::string dump(const std::string &in)
+std::string dump(std::string_view in)
 {
     std::ostringstream xs;
     xs << std::setfill('0') << std::hex;
@@ -67,44 +66,31 @@ rfaddr_t rfaddr_from_string(const std::string &data)
     return rv;
 }
 
-std::string decode64(const std::string& s)
+void decode64(std::string_view s, std::string &out)
 {
-    namespace bai = boost::archive::iterators;
-
-    std::stringstream os;
+    out.resize(base64::decoded_size(s.size()));
+    std::size_t len = base64::decode(s.data(), s.size(), reinterpret_cast<uint8_t *>(&out[0]));
+    out.resize(len == base64::invalid ? 0 : len);
+}
 
-    typedef bai::transform_width<bai::binary_from_base64<const char *>, 8, 6> base64_dec;
-    unsigned int size = s.size();
-    // Remove the padding characters, cf. https://svn.boost.org/trac/boost/ticket/5629
-    if (size && s[size - 1] == '=')
-    {
-        --size;
-        if (size && s[size - 1] == '=') --size;
-    }
-    if (size == 0) return std::string();
+std::string decode64(const std::string& s)
+{
+    std::string out;
+    decode64(std::string_view(s), out);
+    return out;
+}
 
-    std::copy(base64_dec(s.data()), base64_dec(s.data() + size),
-              std::ostream_iterator<char>(os));
-    return os.str();
+void encode64(std::string_view s, std::string &out)
+{
+    out.resize(base64::encoded_size(s.size()));
+    base64::encode(reinterpret_cast<const uint8_t *>(s.data()), s.size(), &out[0]);
 }
 
-const std::string base64_padding[] = {"", "==","="};
 std::string encode64(const std::string& s)
 {
-  namespace bai = boost::archive::iterators;
-
-  std::stringstream os;
-
-  // convert binary values to base64 characters
-  typedef bai::base64_from_binary
-  // retrieve 6 bit integers from a sequence of 8 bit bytes
-  <bai::transform_width<const char *, 6, 8> > base64_enc; // compose all the above operations in to a new iterator
-
-  std::copy(base64_enc(s.c_str()), base64_enc(s.c_str() + s.size()),
-            std::ostream_iterator<char>(os));
-
-  os << base64_padding[s.size() % 3];
-  return os.str();
+    std::string out;
+    encode64(std::string_view(s), out);
+    return out;
 }
 
 std::string mode_as_string(opmode m)
@@ -174,6 +160,73 @@ std::string devicetype_as_string(devicetype dt)
     return xs.str();
 }
 
+
+static const char *day_text[7] = {
+    "saturday", "sunday", "monday", "tuesday", "wednesday", "thursday", "friday"
+};
+
+std::string schedule_to_json(const std::string &roomname, const week_schedule &ws)
+{
+    // using namespace boost::property_tree;
+#if defined(format)
+    {
+        "room" : "<roomname>",
+        "saturday" : [
+          {
+            "endtime" : "755",
+            "temp" : "16.0",
+          }
+        ],
+        "tuesday" : [
+          {
+            "endtime" : "755",
+            "temp" : "16.0",
+          },
+          {
+            "endtime" : "755",
+            "temp" : "16.0",
+          }
+        ],
+    }
+#endif
+    std::ostringstream output;
+
+    output << "{\n  \"room\" : \"" << roomname << "\" ,\n";
+
+    bool firstday = true;
+    for (unsigned day = static_cast<unsigned>(days::Saturday);
+                  day <= static_cast<unsigned>(days::Friday); day++)
+    {
+        if (!firstday)
+            output << ",\n";
+        else
+            firstday = false;
+        output << "  \"" << day_text[day] << "\" : [\n";
+        const day_schedule &ds(ws[day]);
+        bool seen_end = false;
+        bool first = true;
+        for (const auto &oneslot: ds)
+        {
+            if (!seen_end)
+            {
+                std::ostringstream sent;
+                if (!first)
+                    sent << ",\n";
+                else
+                    first = false;
+                sent << "    {\n      \"endtime\" : \"" << oneslot.minutes_since_midnight << "\",\n"
+                     << "      \"temp\" : \"" << oneslot.temp << "\"\n    }";
+                seen_end = (oneslot.minutes_since_midnight == 1440);
+                output << sent.str();
+            }
+        }
+        output << "\n  ]";
+    }
+    output << "\n}";
+    // std::cout << "to_json " << roomname << " \n" << output.str() << std::endl;
+    return output.str();
+}
+
 }
 
 bool parse_room(std::string &input, std::string &roomname)
@@ -2,15 +2,18 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
 #include "cube_io.h"
 
 namespace max_eq3 {
-    std::string dump(const std::string &i);
+    std::string dump(std::string_view i);
 
     rfaddr_t rfaddr_from_string(const std::string &data);
     rfaddr_t rfaddr_from_string(const char *pData);
     std::string decode64(const std::string& s);
+    void decode64(std::string_view s, std::string &out);   // reuses the capacity of out
     std::string encode64(const std::string& s);
+    void encode64(std::string_view s, std::string &out);   // reuses the capacity of out
 
     std::string mode_as_string(opmode m);
     opmode mode_from_flags(uint16_t flags);
@@ -19,6 +22,9 @@ namespace max_eq3 {
 
     std::string l_submsg_as_string(const l_submsg_data &smgs);
     std::string devicetype_as_string(devicetype dt);
+
+    // weekplan json object as published per room
+    std::string schedule_to_json(const std::string &roomname, const week_schedule &ws);
 }
 
 template <typename RT>
@@ -0,0 +1,74 @@
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include "base64.h"
+
+using namespace max_eq3;
+
+namespace {
+
+std::string encode(const std::string &bin)
+{
+    std::string out(base64::encoded_size(bin.size()), '\0');
+    out.resize(base64::encode(reinterpret_cast<const uint8_t *>(bin.data()), bin.size(), &out[0]));
+    return out;
+}
+
+bool decode(const std::string &text, std::string &bin)
+{
+    bin.assign(base64::decoded_size(text.size()), '\0');
+    std::size_t n = base64::decode(text.data(), text.size(), reinterpret_cast<uint8_t *>(&bin[0]));
+    if (n == base64::invalid)
+        return false;
+    bin.resize(n);
+    return true;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(base64_tests)
+
+BOOST_AUTO_TEST_CASE(known_vectors)
+{
+    BOOST_TEST(encode("") == "");
+    BOOST_TEST(encode("f") == "Zg==");
+    BOOST_TEST(encode("fo") == "Zm8=");
+    BOOST_TEST(encode("foo") == "Zm9v");
+    BOOST_TEST(encode("foobar") == "Zm9vYmFy");
+
+    std::string bin;
+    BOOST_TEST(decode("Zm9vYg==", bin));
+    BOOST_TEST(bin == "foob");
+    BOOST_TEST(decode("Zm9vYmE", bin));         // incomplete group, no padding
+    BOOST_TEST(bin == "fooba");
+}
+
+// long enough for the vector implementations and their scalar tail
+BOOST_AUTO_TEST_CASE(round_trip_all_lengths)
+{
+    std::string bin;
+    for (unsigned u = 0; u < 300; ++u)
+        bin += char((u * 37 + 11) & 0xff);
+    for (std::size_t len = 0; len <= bin.size(); ++len)
+    {
+        std::string part = bin.substr(0, len);
+        std::string text = encode(part);
+        BOOST_REQUIRE_EQUAL(text.size(), base64::encoded_size(len));
+        std::string back;
+        BOOST_REQUIRE(decode(text, back));
+        BOOST_REQUIRE(back == part);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rejects_characters_outside_the_alphabet)
+{
+    std::string bin;
+    BOOST_TEST(!decode("Zm9v*mFy", bin));
+    std::string longer(96, 'A');
+    longer[70] = '!';
+    BOOST_TEST(!decode(longer, bin));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "capture.h"
+
+using namespace max_eq3;
+
+namespace {
+
+struct temp_file
+{
+    temp_file() : path("maxcube2mqtt_test_" + std::to_string(::getpid()) + ".cap") { std::remove(path.c_str()); }
+    ~temp_file() { std::remove(path.c_str()); }
+    std::string path;
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(capture_tests)
+
+BOOST_AUTO_TEST_CASE(reads_back_what_was_written)
+{
+    temp_file f;
+    {
+        capture_writer w;
+        BOOST_REQUIRE(w.open(f.path));
+        w.write(capture_dir::rx, "H:KEQ0000001,0abcde,0113");
+        w.write(capture_dir::tx, "l:");
+        w.write(capture_dir::rx, "");
+    }
+    {
+        capture_writer w;                       // appends a second session
+        BOOST_REQUIRE(w.open(f.path));
+        w.write(capture_dir::rx, "L:Cw");
+    }
+
+    capture_reader r;
+    BOOST_REQUIRE(r.open(f.path));
+    std::vector<capture_dir> dirs;
+    std::vector<std::string> lines;
+    capture_entry e;
+    while (r.next(e))
+    {
+        dirs.push_back(e.dir);
+        if (e.dir != capture_dir::session)
+            lines.emplace_back(e.line);
+        else
+            BOOST_TEST(e.line.size() == 8u);    // wallclock
+    }
+    BOOST_TEST(!r.truncated());
+    std::vector<capture_dir> expected_dirs{capture_dir::session, capture_dir::rx, capture_dir::tx, capture_dir::rx,
+                                           capture_dir::session, capture_dir::rx};
+    BOOST_TEST((dirs == expected_dirs));
+    std::vector<std::string> expected{"H:KEQ0000001,0abcde,0113", "l:", "", "L:Cw"};
+    BOOST_TEST(lines == expected, boost::test_tools::per_element());
+
+    r.rewind();
+    BOOST_TEST(replay(r, 0.0, [](const capture_entry &){}) == 6u);
+}
+
+BOOST_AUTO_TEST_CASE(torn_last_record)
+{
+    temp_file f;
+    {
+        capture_writer w;
+        BOOST_REQUIRE(w.open(f.path));
+        w.write(capture_dir::rx, "L:0123456789abcdef");
+    }
+    std::FILE *fp = std::fopen(f.path.c_str(), "r+b");
+    BOOST_REQUIRE(fp);
+    std::fseek(fp, 0, SEEK_END);
+    long size = std::ftell(fp);
+    std::fclose(fp);
+    BOOST_REQUIRE_EQUAL(::truncate(f.path.c_str(), size - 12), 0);
+
+    capture_reader r;
+    BOOST_REQUIRE(r.open(f.path));
+    capture_entry e;
+    BOOST_TEST(r.next(e));
+    BOOST_TEST((e.dir == capture_dir::session));
+    BOOST_TEST(!r.next(e));
+    BOOST_TEST(r.truncated());
+}
+
+BOOST_AUTO_TEST_CASE(rejects_foreign_files)
+{
+    temp_file f;
+    std::FILE *fp = std::fopen(f.path.c_str(), "wb");
+    BOOST_REQUIRE(fp);
+    std::fputs("not a capture file at all", fp);
+    std::fclose(fp);
+
+    capture_reader r;
+    BOOST_TEST(!r.open(f.path));
+    capture_writer w;
+    BOOST_TEST(!w.open(f.path));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
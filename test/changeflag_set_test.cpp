@@ -0,0 +1,51 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "cube_types.h"
+
+using namespace max_eq3;
+
+BOOST_AUTO_TEST_SUITE(changeflag_set_tests)
+
+BOOST_AUTO_TEST_CASE(insert_erase_count)
+{
+    changeflag_set s;
+    BOOST_TEST(s.empty());
+    s.insert(changeflags::set_temp);
+    s.insert(changeflags::set_temp);
+    s.insert(changeflags::valve_pos);
+    BOOST_TEST(s.size() == 2u);
+    BOOST_TEST(s.count(changeflags::set_temp));
+    BOOST_TEST(!s.count(changeflags::mode));
+    s.erase(changeflags::set_temp);
+    BOOST_TEST(!s.count(changeflags::set_temp));
+    BOOST_TEST(s.size() == 1u);
+    s.clear();
+    BOOST_TEST(s.empty());
+}
+
+BOOST_AUTO_TEST_CASE(merge_and_compare)
+{
+    changeflag_set a{changeflags::mode};
+    changeflag_set b{changeflags::act_temp, changeflags::mode};
+    BOOST_TEST((a != b));
+    a.insert(b);
+    BOOST_TEST((a == b));
+    BOOST_TEST(a.mask() == b.mask());
+}
+
+BOOST_AUTO_TEST_CASE(iterates_in_enum_order)
+{
+    changeflag_set s{changeflags::valve_pos, changeflags::config, changeflags::act_temp};
+    std::vector<changeflags> seen;
+    for (changeflags f: s)
+        seen.push_back(f);
+    BOOST_TEST(seen.size() == 3u);
+    BOOST_TEST((seen[0] == changeflags::act_temp));
+    BOOST_TEST((seen[1] == changeflags::config));
+    BOOST_TEST((seen[2] == changeflags::valve_pos));
+    BOOST_TEST((changeflag_set().begin() == changeflag_set().end()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "command_queue.h"
+
+using namespace max_eq3;
+using namespace std::chrono_literals;
+
+namespace {
+
+using clock_t_ = command_queue::clock;
+
+command_queue::command make(const std::string &line, command_priority prio = command_priority::normal,
+                            unsigned key = 0)
+{
+    command_queue::command c;
+    c.line = line;
+    c.prio = prio;
+    c.key = key;
+    return c;
+}
+
+struct fixture
+{
+    fixture()
+    {
+        cfg.recovery = 1000ms;
+        q.configure(cfg);
+        q.status(0, 50, now);
+    }
+
+    std::optional<command_queue::command> admit()
+    {
+        clock_t_::time_point retry{};
+        return q.admit(now, retry);
+    }
+
+    command_config              cfg;
+    command_queue               q;
+    clock_t_::time_point        now{clock_t_::now()};
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(command_queue_tests, fixture)
+
+BOOST_AUTO_TEST_CASE(one_in_flight_by_priority)
+{
+    q.push(make("low", command_priority::low), now);
+    q.push(make("high", command_priority::high), now);
+    BOOST_TEST(q.depth() == 2u);
+
+    auto c = admit();
+    BOOST_REQUIRE(c);
+    BOOST_TEST(c->line == "high");
+    BOOST_TEST(!admit().has_value());                       // waits for the S-Msg
+    BOOST_TEST(q.reply(1, false, 50, now));
+    c = admit();
+    BOOST_REQUIRE(c);
+    BOOST_TEST(c->line == "low");
+}
+
+BOOST_AUTO_TEST_CASE(refused_command_is_sent_again_first)
+{
+    q.push(make("a"), now);
+    q.push(make("b"), now);
+    BOOST_REQUIRE(admit());
+    BOOST_TEST(!q.reply(0, true, 50, now));
+    BOOST_TEST(q.depth() == 2u);
+
+    // the budget counts as exhausted (100%), it recovers by cfg.recovery per percent
+    // down to the limit of normal commands
+    BOOST_TEST(!admit().has_value());
+    now += cfg.recovery * (100 - cfg.duty_limit[1]);
+    BOOST_TEST(!admit().has_value());
+    now += cfg.recovery;
+    auto c = admit();
+    BOOST_REQUIRE(c);
+    BOOST_TEST(c->line == "a");
+}
+
+BOOST_AUTO_TEST_CASE(duty_limit_by_priority)
+{
+    q.status(80, 50, now);
+    q.push(make("low", command_priority::low), now);
+    clock_t_::time_point retry{};
+    BOOST_TEST(!q.admit(now, retry).has_value());
+    BOOST_TEST((retry > now));
+
+    q.push(make("normal", command_priority::normal), now);
+    auto c = admit();
+    BOOST_REQUIRE(c);
+    BOOST_TEST(c->line == "normal");
+}
+
+BOOST_AUTO_TEST_CASE(waits_for_a_free_slot)
+{
+    q.status(0, 0, now);
+    q.push(make("a"), now);
+    BOOST_TEST(!admit().has_value());
+    now += cfg.slot_wait;
+    BOOST_TEST(admit().has_value());
+}
+
+BOOST_AUTO_TEST_CASE(same_key_replaces_and_keeps_completions)
+{
+    auto first = make("first", command_priority::low, 3);
+    first.done.push_back(std::make_shared<command_completion>());
+    command_ticket t1 = first.done.back()->ticket();
+    auto second = make("second", command_priority::high, 3);
+    second.done.push_back(std::make_shared<command_completion>());
+    command_ticket t2 = second.done.back()->ticket();
+
+    q.push(std::move(first), now);
+    q.push(make("other", command_priority::normal), now);
+    q.push(std::move(second), now);
+    BOOST_TEST(q.depth() == 2u);
+
+    auto c = admit();
+    BOOST_REQUIRE(c);
+    BOOST_TEST(c->line == "second");            // moved up to high
+    std::optional<command_queue::command> accepted;
+    BOOST_TEST(q.reply(2, false, 49, now, &accepted));
+    BOOST_REQUIRE(accepted);
+    BOOST_TEST(accepted->line == "second");
+    BOOST_TEST((t1.sent.get().status == command_status::accepted));
+    BOOST_TEST((t2.sent.get().status == command_status::accepted));
+    BOOST_TEST(t2.sent.get().free_slots == 49u);
+}
+
+BOOST_AUTO_TEST_CASE(overflow_drops_the_newest_lowest)
+{
+    cfg.max_queued = 2;
+    q.configure(cfg);
+    auto low = make("low", command_priority::low);
+    low.done.push_back(std::make_shared<command_completion>());
+    command_ticket t = low.done.back()->ticket();
+    q.push(make("a"), now);
+    q.push(std::move(low), now);
+    BOOST_TEST(!q.push(make("b"), now));
+    BOOST_TEST(q.depth() == 2u);
+    BOOST_TEST((t.sent.get().status == command_status::dropped));
+    BOOST_TEST((t.confirmed.get().status == command_status::dropped));
+}
+
+BOOST_AUTO_TEST_CASE(completion_resolves_once)
+{
+    std::vector<command_status> seen;
+    command_completion c([&seen](const command_result &r) { seen.push_back(r.status); });
+    command_ticket t = c.ticket();
+    c.notify(command_result{command_status::refused, 100, 50});
+    BOOST_TEST((t.sent.wait_for(0s) == std::future_status::timeout));
+    c.notify(command_result{command_status::accepted, 3, 50});
+    c.notify(command_result{command_status::superseded, 3, 50});
+    c.notify(command_result{command_status::confirmed, 3, 50});
+    BOOST_TEST((t.sent.get().status == command_status::accepted));
+    BOOST_TEST((t.confirmed.get().status == command_status::superseded));
+    BOOST_TEST(seen.size() == 4u);
+}
+
+BOOST_AUTO_TEST_CASE(lost_connection_requeues)
+{
+    q.push(make("a"), now);
+    BOOST_REQUIRE(admit());
+    BOOST_TEST(!q.expired(now));
+    BOOST_TEST(q.expired(now + cfg.reply_timeout));
+    q.lost();
+    BOOST_TEST(!q.busy());
+    BOOST_TEST(q.depth() == 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,138 @@
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include "cube_manager.h"
+#include "cube_sim.h"
+#include "test_house.h"
+
+using namespace max_eq3;
+
+namespace {
+
+// the session of the cube reached steady within the timeout
+bool steady(cube_manager &mgr, const std::string &serial, std::chrono::seconds timeout)
+{
+    auto until = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < until)
+    {
+        cube_io *cio = mgr.cube(serial);
+        if (cio && (cio->session().phase == session_phase::steady))
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(cube_manager_tests)
+
+BOOST_AUTO_TEST_CASE(destruction_quits_the_cubes_and_keeps_the_pool)
+{
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    BOOST_TEST_REQUIRE(sim.start());
+
+    io_pool_config pcfg;
+    pcfg.threads = 2;
+    io_pool pool(pcfg);
+    null_target target;
+    cube_manager_config mcfg;
+    mcfg.serials.push_back(cfg.serial);
+    auto mgr = std::make_unique<cube_manager>(&target, mcfg, pool);
+    BOOST_TEST_REQUIRE(steady(*mgr, cfg.serial, std::chrono::seconds(10)));
+
+    mgr.reset();
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!sim.stats().quits && (std::chrono::steady_clock::now() < until))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    BOOST_TEST(sim.stats().quits == 1u);
+
+    // the pool belongs to the caller, other users (mqtt) still run on it
+    std::promise<void> ran;
+    boost::asio::post(pool.io(), [&ran](){ ran.set_value(); });
+    BOOST_TEST((ran.get_future().wait_for(std::chrono::seconds(2)) == std::future_status::ready));
+}
+
+BOOST_AUTO_TEST_CASE(a_standalone_cube_quits_too)
+{
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    BOOST_TEST_REQUIRE(sim.start());
+    null_target target;
+    {
+        cube_io cio(&target, cfg.serial);
+        auto until = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while ((cio.session().phase != session_phase::steady) && (std::chrono::steady_clock::now() < until))
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        BOOST_TEST_REQUIRE((cio.session().phase == session_phase::steady));
+    }
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!sim.stats().quits && (std::chrono::steady_clock::now() < until))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    BOOST_TEST(sim.stats().quits == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(rooms_are_found_on_every_thread_of_the_pool)
+{
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    BOOST_TEST_REQUIRE(sim.start());
+
+    io_pool_config pcfg;
+    pcfg.threads = 2;
+    io_pool pool(pcfg);
+    null_target target;
+    cube_manager_config mcfg;
+    mcfg.serials.push_back(cfg.serial);
+    cube_manager mgr(&target, mcfg, pool);
+    BOOST_TEST_REQUIRE(steady(mgr, cfg.serial, std::chrono::seconds(10)));
+
+    // one lookup per thread, none of them may wait for a strand of the pool
+    std::promise<managed_room> found[2];
+    for (auto &f: found)
+        boost::asio::post(pool.io(), [&mgr, &f, &cfg](){ f.set_value(mgr.find_room(cfg.serial + "/Room 2")); });
+    for (auto &f: found)
+    {
+        std::future<managed_room> fut = f.get_future();
+        BOOST_TEST_REQUIRE((fut.wait_for(std::chrono::seconds(2)) == std::future_status::ready));
+        managed_room mr = fut.get();
+        BOOST_TEST(bool(mr));
+        BOOST_TEST(mr.room.id == mgr.find_room("Room 2").room.id);
+    }
+    BOOST_TEST(!mgr.find_room(cfg.serial + "/Room 99"));
+}
+
+BOOST_AUTO_TEST_CASE(discovered_cubes_warm_start_on_their_strand)
+{
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    BOOST_TEST_REQUIRE(sim.start());
+    std::string prefix = "cube_manager_test_state_";
+    std::string path = prefix + cfg.serial;
+    std::remove(path.c_str());
+
+    io_pool_config pcfg;
+    pcfg.threads = 2;
+    io_pool pool(pcfg);
+    null_target target;
+    cube_manager_config mcfg;           // no serials, the cube is added by the discovery
+    mcfg.state_prefix = prefix;
+    {
+        cube_manager mgr(&target, mcfg, pool);
+        BOOST_TEST_REQUIRE(steady(mgr, cfg.serial, std::chrono::seconds(10)));
+    }
+    // the state of the session was kept for the next start
+    cube_io offline(&target, cfg.serial, cube_io::offline_t{});
+    BOOST_TEST(offline.warm_start(path) > 0u);
+    BOOST_TEST(offline.rooms()->rooms.size() == cfg.rooms);
+    BOOST_TEST(bool(offline.find_room("Room 12")));
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
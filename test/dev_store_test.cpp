@@ -0,0 +1,83 @@
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include "dev_store.h"
+
+using namespace max_eq3;
+
+BOOST_AUTO_TEST_SUITE(dev_store_tests)
+
+BOOST_AUTO_TEST_CASE(rfaddr_index_finds_inserted)
+{
+    rfaddr_index idx;
+    BOOST_TEST(idx.find(0x123456) == rfaddr_index::npos);
+    // more than the first table holds, the index grows on the way
+    for (rfaddr_t a = 0; a < 200; ++a)
+        idx.insert(0x100000 + a * 0x40, a);
+    BOOST_TEST(idx.size() == 200u);
+    for (rfaddr_t a = 0; a < 200; ++a)
+        BOOST_TEST(idx.find(0x100000 + a * 0x40) == a);
+    BOOST_TEST(idx.find(0x100001) == rfaddr_index::npos);
+    BOOST_TEST(idx.find(0) == rfaddr_index::npos);
+}
+
+BOOST_AUTO_TEST_CASE(insert_keeps_the_slot_of_a_known_device)
+{
+    device_data_store ds;
+    std::size_t a = ds.insert(0x0abcde);
+    std::size_t b = ds.insert(0x0abcdf);
+    BOOST_TEST(a != b);
+    BOOST_TEST(ds.insert(0x0abcde) == a);
+    BOOST_TEST(ds.dev_rfaddr.size() == 2u);
+    BOOST_TEST(ds.devconf[b].rfaddr == 0x0abcdfu);
+    BOOST_TEST(ds.find(0x0abcd0) == device_data_store::npos);
+}
+
+BOOST_AUTO_TEST_CASE(room_of_a_device)
+{
+    device_data_store ds;
+    std::size_t slot = ds.insert(0x0abcde);
+    BOOST_TEST(!ds.room_of(slot));
+    ds.add_room(3).name = "Bath";
+    ds.set_room(slot, 3);
+    BOOST_TEST(ds.room_from_rfaddr(0x0abcde) == "Bath");
+    BOOST_TEST(ds.room_from_rfaddr(0x0abcdf).empty());
+    BOOST_TEST(!ds.has_room(2));
+}
+
+BOOST_AUTO_TEST_CASE(room_name_index_finds_rooms)
+{
+    device_data_store ds;
+    for (unsigned id = 1; id <= 40; ++id)
+        ds.add_room(id).name = "Room " + std::to_string(id);
+    ds.index_rooms();
+    for (unsigned id = 1; id <= 40; ++id)
+        BOOST_TEST(ds.room_id("Room " + std::to_string(id)) == id);
+    BOOST_TEST(ds.room_id("Room 41") == 0u);
+    BOOST_TEST(ds.room_id("") == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(room_generation_changes_with_the_rooms_only)
+{
+    device_data_store ds;
+    ds.add_room(1).name = "Bath";
+    ds.add_room(2).name = "Kitchen";
+    ds.index_rooms();
+    unsigned gen = ds.room_generation;
+
+    ds.index_rooms();                       // the same M-Msg again
+    BOOST_TEST(ds.room_generation == gen);
+
+    ds.roomconf[2].name = "Office";
+    ds.index_rooms();
+    BOOST_TEST(ds.room_generation == gen + 1);
+    BOOST_TEST(ds.room_id("Kitchen") == 0u);
+    BOOST_TEST(ds.room_id("Office") == 2u);
+
+    ds.add_room(3).name = "Hall";
+    ds.index_rooms();
+    BOOST_TEST(ds.room_generation == gen + 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
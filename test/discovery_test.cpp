@@ -0,0 +1,70 @@
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <set>
+
+#include "discovery.h"
+
+using namespace max_eq3;
+using namespace std::chrono_literals;
+
+namespace {
+
+// d is within the +-20% jitter of nominal
+bool jittered(std::chrono::milliseconds d, std::chrono::milliseconds nominal)
+{
+    return (d.count() >= nominal.count() * 8 / 10) && (d.count() <= nominal.count() * 12 / 10);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(discovery_tests)
+
+BOOST_AUTO_TEST_CASE(request_names_the_serial_or_any_cube)
+{
+    std::string any = discovery_request(std::string());
+    BOOST_TEST(any == std::string("eQ3Max*\0**********I", 19));
+    std::string one = discovery_request("KEQ0123456");
+    BOOST_TEST(one == std::string("eQ3Max*\0KEQ0123456I", 19));
+}
+
+BOOST_AUTO_TEST_CASE(backoff_is_immediate_then_doubles_up_to_max)
+{
+    reconnect_backoff b(100ms, 1000ms);
+    BOOST_TEST(b.next().count() == 0);
+    BOOST_TEST(jittered(b.next(), 100ms));
+    BOOST_TEST(jittered(b.next(), 200ms));
+    BOOST_TEST(jittered(b.next(), 400ms));
+    BOOST_TEST(jittered(b.next(), 800ms));
+    for (unsigned u = 0; u < 40; ++u)
+        BOOST_TEST(jittered(b.next(), 1000ms));
+    BOOST_TEST(b.failures() == 45u);
+}
+
+BOOST_AUTO_TEST_CASE(backoff_starts_over_after_reset)
+{
+    reconnect_backoff b(100ms, 1000ms);
+    for (unsigned u = 0; u < 6; ++u)
+        b.next();
+    b.reset();
+    BOOST_TEST(b.failures() == 0u);
+    BOOST_TEST(b.next().count() == 0);
+    BOOST_TEST(jittered(b.next(), 100ms));
+}
+
+BOOST_AUTO_TEST_CASE(backoff_jitter_spreads_the_retries)
+{
+    // gateways restarted together must not retry in lock step
+    std::set<long> delays;
+    for (unsigned u = 0; u < 20; ++u)
+    {
+        reconnect_backoff b(1000ms, 5000ms);
+        b.next();
+        delays.insert(long(b.next().count()));
+    }
+    BOOST_TEST(delays.size() > 1u);
+    BOOST_TEST(*delays.begin() >= 800);
+    BOOST_TEST(*delays.rbegin() <= 1200);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <vector>
+
+#include "history.h"
+
+using namespace max_eq3;
+using namespace std::chrono_literals;
+
+namespace {
+
+const history_ring::clock::time_point t0 = history_ring::clock::time_point(1600000000s);
+
+std::vector<history_sample> all(const history_ring &h)
+{
+    std::vector<history_sample> out;
+    h.query(history_query{}, out);
+    return out;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(history_tests)
+
+BOOST_AUTO_TEST_CASE(only_changes_are_recorded)
+{
+    history_ring h(8);
+    BOOST_TEST(h.empty());
+    BOOST_TEST(h.add(t0, 21.5));
+    BOOST_TEST(!h.add(t0 + 1s, 21.5));
+    BOOST_TEST(!h.add(t0 + 2s, 21.52));     // rounded to tenths
+    BOOST_TEST(h.add(t0 + 3s, 21.0));
+    BOOST_TEST(h.size() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(deltas_restore_the_samples)
+{
+    history_ring h(16);
+    const double values[] = {20.0, 20.5, 19.8, 23.1, 5.0, 30.5};
+    for (unsigned u = 0; u < 6; ++u)
+        h.add(t0 + u * 1250ms, values[u]);
+    auto s = all(h);
+    BOOST_TEST_REQUIRE(s.size() == 6u);
+    for (unsigned u = 0; u < 6; ++u)
+    {
+        BOOST_TEST(s[u].value == values[u], boost::test_tools::tolerance(1e-9));
+        BOOST_TEST((s[u].time == t0 + u * 1250ms));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(full_ring_folds_the_oldest_into_the_base)
+{
+    history_ring h(4);
+    for (unsigned u = 0; u < 10; ++u)
+        h.add(t0 + u * 1min, 10.0 + u);
+    BOOST_TEST(h.size() == 4u);
+    auto s = all(h);
+    BOOST_TEST_REQUIRE(s.size() == 4u);
+    for (unsigned u = 0; u < 4; ++u)
+    {
+        BOOST_TEST(s[u].value == 16.0 + u, boost::test_tools::tolerance(1e-9));
+        BOOST_TEST((s[u].time == t0 + (6 + u) * 1min));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(query_window_and_last_n)
+{
+    history_ring h(32);
+    for (unsigned u = 0; u < 10; ++u)
+        h.add(t0 + u * 1min, 10.0 + u);
+
+    history_query q;
+    q.from = t0 + 2min;
+    q.to = t0 + 5min;
+    std::vector<history_sample> out;
+    h.query(q, out);
+    BOOST_TEST_REQUIRE(out.size() == 4u);
+    BOOST_TEST(out.front().value == 12.0, boost::test_tools::tolerance(1e-9));
+    BOOST_TEST(out.back().value == 15.0, boost::test_tools::tolerance(1e-9));
+
+    q = history_query{};
+    q.last_n = 3;
+    out.clear();
+    h.query(q, out);
+    BOOST_TEST_REQUIRE(out.size() == 3u);
+    BOOST_TEST(out.front().value == 17.0, boost::test_tools::tolerance(1e-9));
+}
+
+BOOST_AUTO_TEST_CASE(summarize_weights_by_time_held)
+{
+    std::vector<history_sample> s{{t0, 20.0}, {t0 + 30min, 22.0}};
+    history_stats st = summarize(s, t0 + 2h);
+    BOOST_TEST(st.samples == 2u);
+    BOOST_TEST(st.min == 20.0);
+    BOOST_TEST(st.max == 22.0);
+    // 20 for 30 min, 22 for 90 min
+    BOOST_TEST(st.avg == 21.5, boost::test_tools::tolerance(1e-9));
+    BOOST_TEST(summarize({}, t0).samples == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
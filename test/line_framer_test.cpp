@@ -0,0 +1,85 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "line_framer.h"
+
+using namespace max_eq3;
+
+namespace {
+
+template <std::size_t Capacity>
+void feed(line_framer<Capacity> &framer, const std::string &data)
+{
+    auto bufs = framer.prepare();
+    std::size_t n = 0;
+    for (auto &b: bufs)
+    {
+        std::size_t len = std::min(b.size(), data.size() - n);
+        std::memcpy(b.data(), data.data() + n, len);
+        n += len;
+    }
+    BOOST_REQUIRE_EQUAL(n, data.size());
+    framer.commit(n);
+}
+
+template <std::size_t Capacity>
+std::vector<std::string> lines(line_framer<Capacity> &framer)
+{
+    std::vector<std::string> result;
+    std::string_view line;
+    while (framer.next_line(line))
+        result.emplace_back(line);
+    return result;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(line_framer_tests)
+
+BOOST_AUTO_TEST_CASE(splits_lines_and_strips_crlf)
+{
+    line_framer<64> framer;
+    feed(framer, "H:abc\r\nL:def\r\nM:");
+    std::vector<std::string> expected{"H:abc", "L:def"};
+    std::vector<std::string> got = lines(framer);
+    BOOST_TEST(got == expected, boost::test_tools::per_element());
+    BOOST_TEST(framer.pending() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(keeps_partial_line_for_the_next_read)
+{
+    line_framer<64> framer;
+    feed(framer, "L:ab");
+    BOOST_TEST(lines(framer).empty());
+    feed(framer, "cd\n");
+    std::vector<std::string> got = lines(framer);
+    BOOST_REQUIRE_EQUAL(got.size(), 1u);
+    BOOST_TEST(got[0] == "L:abcd");
+}
+
+BOOST_AUTO_TEST_CASE(joins_a_line_wrapping_the_ring)
+{
+    line_framer<16> framer;
+    feed(framer, "0123456789\r\n");
+    BOOST_TEST(lines(framer).size() == 1u);
+    feed(framer, "abcdefghij\r\n");
+    std::vector<std::string> got = lines(framer);
+    BOOST_REQUIRE_EQUAL(got.size(), 1u);
+    BOOST_TEST(got[0] == "abcdefghij");
+}
+
+BOOST_AUTO_TEST_CASE(reports_overflow)
+{
+    line_framer<8> framer;
+    feed(framer, "01234567");
+    BOOST_TEST(lines(framer).empty());
+    BOOST_TEST(framer.overflow());
+    framer.clear();
+    BOOST_TEST(!framer.overflow());
+    BOOST_TEST(framer.pending() == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include "cubio_io_p.h"
+
+using namespace max_eq3;
+
+BOOST_AUTO_TEST_SUITE(m_msg_assembler_tests)
+
+BOOST_AUTO_TEST_CASE(single_chunk)
+{
+    m_msg_assembler m;
+    BOOST_TEST(m.add(0, 1, "VgIC"));
+    std::string joined;
+    m.joined(joined);
+    BOOST_TEST(joined == "VgIC");
+}
+
+BOOST_AUTO_TEST_CASE(chunks_out_of_order)
+{
+    m_msg_assembler m;
+    BOOST_TEST(!m.add(0, 3, "aa"));
+    BOOST_TEST(!m.add(2, 3, "cc"));
+    BOOST_TEST(!m.add(2, 3, "cc"));             // repeated, still missing one
+    BOOST_TEST(m.add(1, 3, "bb"));
+    std::string joined;
+    m.joined(joined);
+    BOOST_TEST(joined == "aabbcc");
+}
+
+BOOST_AUTO_TEST_CASE(empty_chunk_counts)
+{
+    m_msg_assembler m;
+    BOOST_TEST(!m.add(0, 2, "aa"));
+    BOOST_TEST(m.add(1, 2, ""));
+    std::string joined;
+    m.joined(joined);
+    BOOST_TEST(joined == "aa");
+}
+
+BOOST_AUTO_TEST_CASE(restarts_with_index_zero)
+{
+    m_msg_assembler m;
+    BOOST_TEST(!m.add(0, 2, "old"));
+    BOOST_TEST(!m.add(0, 2, "aa"));
+    BOOST_TEST(m.add(1, 2, "bb"));
+    std::string joined;
+    m.joined(joined);
+    BOOST_TEST(joined == "aabb");
+
+    m.reset();
+    BOOST_TEST(!m.add(1, 2, "bb"));
+    BOOST_TEST(m.add(0, 2, "aa") == false);     // index 0 starts over
+    BOOST_TEST(m.add(1, 2, "bb"));
+}
+
+BOOST_AUTO_TEST_CASE(ignores_index_out_of_range)
+{
+    m_msg_assembler m;
+    BOOST_TEST(!m.add(0, 2, "aa"));
+    BOOST_TEST(!m.add(5, 2, "xx"));
+    BOOST_TEST(m.add(1, 2, "bb"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
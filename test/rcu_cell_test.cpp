@@ -0,0 +1,85 @@
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "rcu_cell.h"
+
+using namespace max_eq3;
+
+namespace {
+
+// counts the live instances
+struct tracked
+{
+    static std::atomic<int> alive;
+
+    explicit tracked(unsigned v = 0) : value(v) { ++alive; }
+    ~tracked() { --alive; }
+
+    unsigned value;
+};
+
+std::atomic<int> tracked::alive{0};
+
+}
+
+BOOST_AUTO_TEST_SUITE(rcu_cell_tests)
+
+BOOST_AUTO_TEST_CASE(readers_see_the_published_value)
+{
+    rcu_cell<tracked> cell(std::make_unique<const tracked>(1));
+    BOOST_TEST(cell.read()->value == 1u);
+    cell.publish(std::make_unique<const tracked>(2));
+    BOOST_TEST(cell.read()->value == 2u);
+    BOOST_TEST(cell.current().value == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(a_guard_keeps_its_value)
+{
+    {
+        rcu_cell<tracked> cell(std::make_unique<const tracked>(1));
+        auto g = cell.read();
+        for (unsigned u = 2; u < 10; ++u)
+            cell.publish(std::make_unique<const tracked>(u));
+        BOOST_TEST(g->value == 1u);             // still valid while held
+        BOOST_TEST(cell.read()->value == 9u);
+
+        g = rcu_cell<tracked>::guard();
+        cell.publish(std::make_unique<const tracked>(10));
+        cell.publish(std::make_unique<const tracked>(11));
+        // without readers at most the values of the last two epochs are kept
+        BOOST_TEST(tracked::alive.load() <= 3);
+    }
+    BOOST_TEST(tracked::alive.load() <= 2);     // retired ones go with the cell
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_readers)
+{
+    rcu_cell<tracked> cell(std::make_unique<const tracked>(0));
+    std::atomic<bool> done{false};
+    std::atomic<unsigned> errors{0};
+    std::vector<std::thread> readers;
+    for (unsigned r = 0; r < 3; ++r)
+        readers.emplace_back([&]() {
+            unsigned last = 0;
+            while (!done)
+            {
+                auto g = cell.read();
+                if (g->value < last)
+                    ++errors;                   // published values only grow
+                last = g->value;
+            }
+        });
+    for (unsigned u = 1; u <= 20000; ++u)
+        cell.publish(std::make_unique<const tracked>(u));
+    done = true;
+    for (auto &t: readers)
+        t.join();
+    BOOST_TEST(errors.load() == 0u);
+    BOOST_TEST(cell.read()->value == 20000u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,90 @@
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <ctime>
+
+#include "refresh_policy.h"
+
+using namespace max_eq3;
+using namespace std::chrono_literals;
+
+BOOST_AUTO_TEST_SUITE(refresh_policy_tests)
+
+BOOST_AUTO_TEST_CASE(grows_while_idle_and_resets_on_change)
+{
+    refresh_policy p;
+    p.configure(refresh_config{});
+    BOOST_TEST((p.next(std::nullopt).reason == refresh_reason::startup));
+    BOOST_TEST(p.next(std::nullopt).interval.count() == 30);
+
+    p.observed(false);
+    BOOST_TEST(p.next(std::nullopt).interval.count() == 30);    // idle_after 2
+    p.observed(false);
+    BOOST_TEST(p.next(std::nullopt).interval.count() == 60);
+    BOOST_TEST((p.next(std::nullopt).reason == refresh_reason::idle));
+    for (unsigned u = 0; u < 10; ++u)
+        p.observed(false);
+    BOOST_TEST(p.next(std::nullopt).interval.count() == 300);   // max
+
+    p.observed(true);
+    BOOST_TEST(p.next(std::nullopt).interval.count() == 30);
+    BOOST_TEST((p.next(std::nullopt).reason == refresh_reason::changing));
+}
+
+BOOST_AUTO_TEST_CASE(short_after_commands)
+{
+    refresh_policy p;
+    p.configure(refresh_config{});
+    for (unsigned u = 0; u < 5; ++u)
+        p.observed(false);
+    p.commanded();
+    BOOST_TEST(p.next(std::nullopt).interval.count() == 10);
+    BOOST_TEST((p.next(std::nullopt).reason == refresh_reason::command));
+    p.observed(false);
+    BOOST_TEST(p.next(std::nullopt).interval.count() == 10);
+    p.observed(false);
+    BOOST_TEST((p.next(std::nullopt).reason == refresh_reason::idle));
+}
+
+BOOST_AUTO_TEST_CASE(schedule_transition_within_limits)
+{
+    refresh_config cfg;
+    cfg.schedule_lag = 5s;
+    refresh_policy p;
+    p.configure(cfg);
+    refresh_state st = p.next(0s);
+    BOOST_TEST((st.reason == refresh_reason::schedule));
+    BOOST_TEST(st.interval.count() == 10);      // 5 s clamped to min
+    for (unsigned u = 0; u < 5; ++u)
+        p.observed(false);
+    st = p.next(100s);
+    BOOST_TEST((st.reason == refresh_reason::schedule));
+    BOOST_TEST(st.interval.count() == 105);
+    BOOST_TEST((p.next(400s).reason == refresh_reason::idle));
+}
+
+BOOST_AUTO_TEST_CASE(next_transition_of_the_week_schedule)
+{
+    week_schedule ws{};
+    for (auto &day: ws)
+    {
+        for (auto &sp: day)
+            sp.minutes_since_midnight = 24 * 60;
+        day[0].minutes_since_midnight = 6 * 60;
+        day[1].minutes_since_midnight = 22 * 60;
+    }
+    std::tm now{};
+    now.tm_wday = 1;
+    now.tm_hour = 5;
+    now.tm_min = 59;
+    auto t = next_transition(ws, now);
+    BOOST_REQUIRE(t);
+    BOOST_TEST(t->count() == 60);
+
+    now.tm_hour = 23;                           // 23:59, tomorrow 06:00
+    t = next_transition(ws, now);
+    BOOST_REQUIRE(t);
+    BOOST_TEST(t->count() == 6 * 3600 + 60);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include "cube_io.h"
+#include "cube_sim.h"
+#include "discovery.h"
+#include "test_house.h"
+
+using namespace max_eq3;
+using namespace std::chrono_literals;
+
+namespace {
+
+// polls the session of the cube until pred holds or the timeout passed
+template <typename P>
+bool wait_session(cube_io &cio, std::chrono::milliseconds timeout, P pred)
+{
+    auto until = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < until)
+    {
+        if (pred(cio.session()))
+            return true;
+        std::this_thread::sleep_for(5ms);
+    }
+    return pred(cio.session());
+}
+
+bool is_steady(const session_timing &t) { return t.phase == session_phase::steady; }
+
+}
+
+BOOST_AUTO_TEST_SUITE(session_tests)
+
+BOOST_AUTO_TEST_CASE(reaches_steady_and_again_after_a_reboot)
+{
+    sim_config cfg;
+    cube_simulator sim(cfg);
+    BOOST_TEST_REQUIRE(sim.start());
+    null_target target;
+    cube_io cio(&target, cfg.serial);
+    BOOST_TEST_REQUIRE(wait_session(cio, 10000ms, is_steady));
+    session_timing t = cio.session();
+    BOOST_TEST(t.connect.count() > 0);
+    BOOST_TEST(t.handshake.count() > 0);
+    BOOST_TEST(t.reconnects == 0u);
+    BOOST_TEST(t.timeouts == 0u);
+    BOOST_TEST(cio.rooms()->rooms.size() == cfg.rooms);
+
+    sim.stop();
+    BOOST_TEST_REQUIRE(wait_session(cio, 2000ms, [](const session_timing &s) { return !is_steady(s); }));
+    BOOST_TEST_REQUIRE(sim.start());
+    BOOST_TEST_REQUIRE(wait_session(cio, 10000ms, is_steady));
+    t = cio.session();
+    BOOST_TEST(t.reconnects >= 1u);
+    BOOST_TEST(t.outage.count() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(an_unknown_cube_times_out_the_discovery)
+{
+    null_target target;
+    cube_io cio(&target, "KEQ9999999");
+    session_config sc;
+    sc.discover_timeout = 100ms;
+    cio.configure_session(sc);
+    // the first wait may still use the default timeout
+    BOOST_TEST(wait_session(cio, 3000ms, [](const session_timing &s) { return s.timeouts >= 3; }));
+    BOOST_TEST((cio.session().phase == session_phase::discover));
+}
+
+BOOST_AUTO_TEST_CASE(calls_return_without_the_discovery_port)
+{
+    // the port is taken without reuse, the cube can't bind it
+    boost::asio::io_context io;
+    boost::asio::ip::udp::socket taken(io);
+    boost::system::error_code ec;
+    taken.open(boost::asio::ip::udp::v4(), ec);
+    taken.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), discovery_port), ec);
+    BOOST_TEST_REQUIRE(!ec);
+
+    null_target target;
+    auto done = std::async(std::launch::async, [&target]() {
+        cube_io cio(&target, "KEQ0000001");
+        for (unsigned u = 0; u < 10; ++u)
+            cio.session();
+        return cio.session().phase;
+    });
+    BOOST_TEST_REQUIRE((done.wait_for(2s) == std::future_status::ready));
+    BOOST_TEST((done.get() == session_phase::idle));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
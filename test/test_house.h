@@ -0,0 +1,76 @@
+#ifndef TEST_HOUSE_H
+#define TEST_HOUSE_H
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cube_io.h"
+#include "msg_builder.h"
+
+namespace max_eq3 {
+
+/**
+ * @brief The test_house struct
+ * rooms with a wall thermostat and radiator thermostats each, the lines a
+ * cube sends for them are built by msg_builder
+ */
+struct test_house
+{
+    std::vector<m_room>         rooms;
+    std::vector<m_device>       devices;
+    std::vector<l_submsg_data>  values;         // by device
+
+    explicit test_house(unsigned room_count = 2, unsigned thermostats = 2)
+    {
+        rfaddr_t addr = 0x100000;
+        for (uint8_t id = 1; id <= room_count; ++id)
+        {
+            rooms.push_back(m_room{id, "Room " + std::to_string(id), addr});
+            devices.push_back(m_device{devicetype::WallThermostat, addr++,
+                                       "WT0000" + std::to_string(1000 + id), "Wall " + std::to_string(id), id});
+            for (unsigned u = 0; u < thermostats; ++u)
+                devices.push_back(m_device{devicetype::RadiatorThermostat, addr++,
+                                           "RT0000" + std::to_string(2000 + id * 10 + u),
+                                           "Radiator " + std::to_string(id), id});
+        }
+        for (const m_device &d: devices)
+        {
+            l_submsg_data ld;
+            ld.submsg_src = d.type;
+            ld.rfaddr = d.rfaddr;
+            ld.flags = 0x1018;              // auto
+            ld.valve_pos = 0;
+            ld.set_temp = 21.0;
+            ld.act_temp = 20.5;
+            ld.dateuntil = 0;
+            ld.minutes_since_midnight = 0;
+            values.push_back(ld);
+        }
+    }
+
+    std::vector<std::string> m_lines() const { return build_m_msgs(rooms, devices); }
+    std::string l_line() const { return build_l_msg(values); }
+
+    void inject_config(cube_io &cio) const
+    {
+        for (const std::string &m: m_lines())
+            cio.inject(m);
+        thermostat_settings ts;
+        for (const m_device &d: devices)
+            cio.inject(build_c_msg(d, ts));
+    }
+};
+
+class null_target : public cube_event_target
+{
+public:
+    void device_info(device_sp) override {}
+    void room_changed(room_sp) override {}
+    void connected() override {}
+    void disconnected() override {}
+};
+
+}
+
+#endif // TEST_HOUSE_H
@@ -0,0 +1,9 @@
+/**
+ * unit tests of the protocol building blocks
+ *
+ * usage: maxcube2mqtt_test [boost.test options], run by ctest (header only
+ * boost.test, this file holds its implementation)
+ */
+
+#define BOOST_TEST_MODULE maxcube2mqtt
+#include <boost/test/included/unit_test.hpp>
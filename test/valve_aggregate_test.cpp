@@ -0,0 +1,67 @@
+#include <boost/test/unit_test.hpp>
+
+#include "test_house.h"
+
+using namespace max_eq3;
+
+namespace {
+
+// sets the valves of the radiator thermostats of Room 1 and sends the L-Msg
+room_sp valves(cube_io &cio, test_house &house, uint16_t first, uint16_t second)
+{
+    house.values[1].valve_pos = first;
+    house.values[2].valve_pos = second;
+    cio.inject(house.l_line());
+    return cio.rooms()->find("Room 1");
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(valve_aggregate_tests)
+
+BOOST_AUTO_TEST_CASE(min_max_follow_every_l_msg)
+{
+    test_house house;
+    null_target target;
+    cube_io cio(&target, "KEQ0000001", cube_io::offline_t{});
+    house.inject_config(cio);
+
+    room_sp r = valves(cio, house, 30, 70);
+    BOOST_TEST_REQUIRE(r);
+    BOOST_TEST(r->valve_min == 30u);
+    BOOST_TEST(r->valve_max == 70u);
+    BOOST_TEST(r->valve_pos.first == 50u);
+
+    r = valves(cio, house, 80, 10);
+    BOOST_TEST(r->valve_min == 10u);
+    BOOST_TEST(r->valve_max == 80u);
+
+    // the thermostat holding the max closes, the max has to drop with it
+    r = valves(cio, house, 40, 10);
+    BOOST_TEST(r->valve_min == 10u);
+    BOOST_TEST(r->valve_max == 40u);
+
+    r = valves(cio, house, 50, 50);
+    BOOST_TEST(r->valve_min == 50u);
+    BOOST_TEST(r->valve_max == 50u);
+}
+
+BOOST_AUTO_TEST_CASE(rooms_are_aggregated_apart)
+{
+    test_house house;
+    null_target target;
+    cube_io cio(&target, "KEQ0000001", cube_io::offline_t{});
+    house.inject_config(cio);
+    house.values[4].valve_pos = 90;             // radiators of Room 2
+    house.values[5].valve_pos = 20;
+    valves(cio, house, 5, 15);
+
+    room_sp r2 = cio.rooms()->find("Room 2");
+    BOOST_TEST_REQUIRE(r2);
+    BOOST_TEST(r2->valve_min == 20u);
+    BOOST_TEST(r2->valve_max == 90u);
+    room_sp r1 = cio.rooms()->find("Room 1");
+    BOOST_TEST(r1->valve_max == 15u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,90 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test_house.h"
+
+using namespace max_eq3;
+
+namespace {
+
+struct state_file
+{
+    std::string path{"warm_start_test." + std::to_string(::getpid()) + ".state"};
+
+    state_file() { std::remove(path.c_str()); }
+    ~state_file() { std::remove(path.c_str()); }
+
+    bool exists() const
+    {
+        std::FILE *fp = std::fopen(path.c_str(), "rb");
+        if (fp)
+            std::fclose(fp);
+        return fp != nullptr;
+    }
+
+    // a save replaces the file
+    ino_t inode() const
+    {
+        struct stat st;
+        return (::stat(path.c_str(), &st) == 0) ? st.st_ino : 0;
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(warm_start_tests)
+
+BOOST_AUTO_TEST_CASE(state_round_trip)
+{
+    state_file f;
+    test_house house(3);
+    for (unsigned u = 0; u < 3; ++u)
+        house.values[u].set_temp = 23.5;            // the devices of Room 1
+    null_target target;
+    {
+        cube_io cio(&target, "KEQ0000001", cube_io::offline_t{});
+        BOOST_TEST(cio.warm_start(f.path) == 0u);           // no state yet
+        house.inject_config(cio);
+        cio.inject(house.l_line());
+    }                                                       // written on destruction
+    BOOST_TEST_REQUIRE(f.exists());
+
+    cube_io cio(&target, "KEQ0000001", cube_io::offline_t{});
+    // the M-Msg, one C-Msg per device and the L-Msg
+    BOOST_TEST(cio.warm_start(f.path) == 2 + house.devices.size());
+    auto view = cio.rooms();
+    BOOST_TEST_REQUIRE(view->rooms.size() == 3u);
+    room_sp r = view->find("Room 1");
+    BOOST_TEST_REQUIRE(r);
+    BOOST_TEST(r->set_temp.first == 23.5);
+    BOOST_TEST(r->actual_temp.first == 20.5);
+    BOOST_TEST(r->schedule != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(restoring_does_not_rewrite_the_state)
+{
+    state_file f;
+    test_house house;
+    null_target target;
+    {
+        cube_io cio(&target, "KEQ0000001", cube_io::offline_t{});
+        cio.warm_start(f.path);
+        house.inject_config(cio);
+        cio.inject(house.l_line());
+    }
+    {
+        ino_t before = f.inode();
+        cube_io cio(&target, "KEQ0000001", cube_io::offline_t{});
+        BOOST_TEST(cio.warm_start(f.path) > 0u);
+        BOOST_TEST(f.inode() == before);                    // not replaced while it was read
+        std::remove(f.path.c_str());
+    }
+    // nothing changed after the restore, so nothing was written
+    BOOST_TEST(!f.exists());
+}
+
+BOOST_AUTO_TEST_SUITE_END()